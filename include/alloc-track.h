@@ -0,0 +1,45 @@
+#ifndef __ALLOC_TRACK_H__
+#define __ALLOC_TRACK_H__
+
+/**
+ * Allocation accounting, built with -DALLOC_TRACK. Allocations of the packet path go through the
+ * track_* macros with the subsystem that makes them, and alloc_track_report prints allocations,
+ * frees, bytes and peak live bytes per subsystem with the allocations per packet. Sizes are
+ * taken from malloc_usable_size, so memory from a tracked call can still be released with a
+ * plain free, only its accounting is lost. Without ALLOC_TRACK the macros are the libc calls.
+ * */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef enum alloc_site
+{
+    ALLOC_SITE_DYNAMIC_BUFFER = 0, /* raw packet bytes from the reader */
+    ALLOC_SITE_ETHERNET,           /* decoded Ethernet frames */
+    ALLOC_SITE_IPV4,               /* decoded IPv4 datagrams */
+    ALLOC_SITE_UDP,                /* decoded UDP packets */
+    ALLOC_SITE_HASH_NODE,          /* hash table chain nodes */
+    ALLOC_SITE_HASH_TABLE,         /* hash table bucket and chain link arrays */
+    ALLOC_SITE_FLOW_TABLE,         /* packet counter flow records and bitmaps */
+    ALLOC_SITE_PACKET_ARENA,       /* packet arena blocks for decoded headers */
+    ALLOC_SITES
+} alloc_site_t;
+
+#ifdef ALLOC_TRACK
+void *alloc_track_calloc(alloc_site_t site, size_t count, size_t size);
+void *alloc_track_realloc(alloc_site_t site, void *ptr, size_t size);
+void alloc_track_free(alloc_site_t site, void *ptr);
+void alloc_track_print_report(uint64_t packets);
+
+    #define track_calloc(site, count, size) alloc_track_calloc(site, count, size)
+    #define track_realloc(site, ptr, size) alloc_track_realloc(site, ptr, size)
+    #define track_free(site, ptr) alloc_track_free(site, ptr)
+    #define alloc_track_report(packets) alloc_track_print_report(packets)
+#else
+    #define track_calloc(site, count, size) calloc(count, size)
+    #define track_realloc(site, ptr, size) realloc(ptr, size)
+    #define track_free(site, ptr) free(ptr)
+    #define alloc_track_report(packets)
+#endif
+
+#endif /* __ALLOC_TRACK_H__ */
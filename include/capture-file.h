@@ -0,0 +1,25 @@
+#ifndef __CAPTURE_FILE_H__
+#define __CAPTURE_FILE_H__
+
+#include <stdbool.h>
+
+#include "dynamic-buffer.h"
+#include "pcap-file.h"
+#include "wireshark-to-buffer.h"
+
+/* A Wireshark hex dump or a pcap capture, read packet by packet through the same calls */
+typedef struct capture_file
+{
+    wireshark_file_t *ws_file; /* set for hex dumps */
+    pcap_file_t *pcap_file;    /* set for pcap captures */
+} capture_file_t;
+
+capture_file_t *capture_file_create(const char *file_path, bool direct);
+bool capture_file_seek(capture_file_t *capture, long offset);
+bool capture_file_readable(capture_file_t *capture);
+long capture_file_position(const capture_file_t *capture);
+bool capture_file_read_packet(capture_file_t *capture, dynamic_buffer_t *buffer);
+dynamic_buffer_t *capture_file_get_next_packet(capture_file_t *capture);
+void capture_file_free(capture_file_t **capture_p);
+
+#endif /* __CAPTURE_FILE_H__ */
@@ -0,0 +1,51 @@
+#ifndef __CAPTURE_INGEST_H__
+#define __CAPTURE_INGEST_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu-affinity.h"
+#include "ethernet-frame.h"
+#include "hierarchical-heavy-hitter.h"
+#include "ingest-metrics.h"
+#include "packet-counter.h"
+
+#define INGEST_RANGE_END_OF_FILE -1L
+
+typedef struct ingest_stats
+{
+    uint64_t packet_total; /* packets read from the file */
+    uint64_t packet_valid; /* valid IPv4 UDP packets counted */
+} ingest_stats_t;
+
+typedef struct ingest_config
+{
+    unsigned jobs;                       /* worker threads, 0 for one per online CPU */
+    bool verbose;                        /* print buffered lines for every packet */
+    bool heavy_hitters;                  /* track hierarchical heavy hitters per worker */
+    uint64_t max_entries;                /* flow limit split between the workers, 0 for none */
+    packet_counter_sink_t overflow_sink; /* receives flows evicted from worker counters */
+    void *overflow_context;              /* passed to overflow_sink */
+    ingest_metrics_t *metrics;           /* live counts shared by all workers, can be NULL */
+    unsigned decoders;                   /* decoder threads of the pipeline, 0 to not pipeline */
+    unsigned counters;                   /* counter threads of the pipeline */
+    uint64_t chunk_size;                 /* bytes per packet range task, 0 to claim whole files */
+    bool direct_io;                      /* read pcap captures with O_DIRECT */
+    const cpu_list_t *cpus;              /* CPUs threads are pinned to in order, NULL for none */
+    bool table_stats;                    /* print the pipeline shard tables before merging */
+} ingest_config_t;
+
+bool ingest_expand_paths(char *const *args, size_t arg_count, char ***paths_p, size_t *count_p);
+void ingest_free_paths(char ***paths_p, size_t count);
+uint64_t ingest_total_bytes(char *const *paths, size_t count);
+ingest_invalid_reason_t ingest_invalid_reason(const ethernet_frame_t *frame,
+                                              const ipv4_datagram_t *datagram);
+bool ingest_file_range(const char *file_path, long start, long end, const ingest_config_t *config,
+                       packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats);
+bool ingest_file(const char *file_path, const ingest_config_t *config, packet_counter_t *counter,
+                 hhh_t *hhh, ingest_stats_t *stats);
+bool ingest_files(char *const *paths, size_t count, const ingest_config_t *config,
+                  packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats);
+
+#endif /* __CAPTURE_INGEST_H__ */
@@ -3,9 +3,12 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <time.h>
 
 #define COMMON_DATA_PRINT_COL 32
+#define NANOSECONDS_PER_SECOND 1000000000L
 
 void print_data_f(uint8_t *data, size_t data_len);
+double timespec_seconds_between(const struct timespec *start, const struct timespec *end);
 
 #endif /* __COMMON_H__ */
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef __COUNTER_SNAPSHOT_H__
+#define __COUNTER_SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packet-counter.h"
+
+/**
+ * Snapshot file layout, all integers little endian:
+ *   counter_snapshot_header_t
+ *   flow_count records sorted by key, each an 8 byte key (source then destination address in
+ *   network order) followed by the packet count as an unsigned LEB128 varint.
+ * */
+#define COUNTER_SNAPSHOT_MAGIC "PKTCSNAP"
+#define COUNTER_SNAPSHOT_MAGIC_LENGTH 8
+#define COUNTER_SNAPSHOT_VERSION 1
+#define COUNTER_SNAPSHOT_KEY_LENGTH (IP_ADDRESS_LENGTH * 2)
+
+#pragma pack(push, 1)
+typedef struct counter_snapshot_header
+{
+    char magic[COUNTER_SNAPSHOT_MAGIC_LENGTH];
+    uint32_t version;
+    uint32_t key_length;
+    uint64_t flow_count;
+    uint64_t packet_count;
+} counter_snapshot_header_t;
+#pragma pack(pop)
+
+typedef struct counter_snapshot
+{
+    const uint8_t *map;    /* read only mapping of the whole file */
+    size_t map_length;     /* length of the mapping */
+    size_t position;       /* offset of the next record */
+    uint64_t flow_count;   /* number of records in the file */
+    uint64_t packet_count; /* sum of all counts */
+    uint64_t flows_read;   /* number of records returned by counter_snapshot_next */
+    const char *file_path;
+} counter_snapshot_t;
+
+bool counter_snapshot_write(packet_counter_t *counter, const char *file_path);
+counter_snapshot_t *counter_snapshot_open(const char *file_path);
+bool counter_snapshot_next(counter_snapshot_t *snapshot, ip_addr_t *src, ip_addr_t *dest,
+                           uint64_t *count);
+void counter_snapshot_close(counter_snapshot_t **snapshot_p);
+bool counter_snapshot_load(const char *file_path, packet_counter_t *counter);
+bool counter_snapshot_merge(const char *const *input_paths, size_t input_count,
+                            const char *output_path);
+
+#endif /* __COUNTER_SNAPSHOT_H__ */
@@ -0,0 +1,21 @@
+#ifndef __CPU_AFFINITY_H__
+#define __CPU_AFFINITY_H__
+
+#include <stdbool.h>
+
+#define CPU_AFFINITY_MAX_CPUS 1024  /* highest CPU number + 1 that can be pinned to */
+#define CPU_AFFINITY_MAX_NODES 1024 /* bits of the NUMA node masks passed to the kernel */
+
+/* CPUs in the order threads are pinned to them */
+typedef struct cpu_list
+{
+    unsigned count;
+    unsigned cpus[CPU_AFFINITY_MAX_CPUS];
+} cpu_list_t;
+
+bool cpu_list_parse(const char *str, cpu_list_t *list);
+int cpu_affinity_node_of(unsigned cpu);
+unsigned cpu_affinity_node_count(void);
+bool cpu_affinity_pin(const cpu_list_t *list, unsigned index);
+
+#endif /* __CPU_AFFINITY_H__ */
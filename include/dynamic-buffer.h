@@ -5,15 +5,27 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#define DYNAMIC_BUFFER_INLINE_SIZE 1536 /* holds a full Ethernet frame of a 1500 byte MTU */
+
+/**
+ * Buffers made by dynamic_buffer_create carry DYNAMIC_BUFFER_INLINE_SIZE bytes of storage in the
+ * same allocation, and data points there as long as the contents fit. A buffer declared on the
+ * stack has no inline storage and can wrap memory owned by someone else, then it must not grow.
+ * */
 typedef struct dynamic_buffer
 {
-    uint8_t *data;   /* buffer data */
-    size_t size;     /* size of the data */
-    size_t capacity; /* capacity of the buffer */
+    uint8_t *data;          /* buffer data, inline_data while it fits there */
+    size_t size;            /* size of the data */
+    size_t capacity;        /* capacity of the buffer */
+    size_t inline_capacity; /* bytes of inline_data, 0 if the buffer has none */
+    uint8_t inline_data[];  /* small buffer storage following the struct */
 } dynamic_buffer_t;
 
 dynamic_buffer_t *dynamic_buffer_create(size_t initial_capacity);
 bool dynamic_buffer_resize(dynamic_buffer_t *buf, size_t new_capacity);
+bool dynamic_buffer_reserve(dynamic_buffer_t *buf, size_t capacity);
+bool dynamic_buffer_shrink(dynamic_buffer_t *buf);
+void dynamic_buffer_reset(dynamic_buffer_t *buf);
 bool dynamic_buffer_add_data(dynamic_buffer_t *buf, const uint8_t *data, size_t data_size);
 void dynamic_buffer_free(dynamic_buffer_t **buf_p);
 
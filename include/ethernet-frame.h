@@ -2,6 +2,7 @@
 #define __ETHERNET_FRAME_H__
 
 #include "dynamic-buffer.h"
+#include "packet-arena.h"
 
 #define MAC_LENGTH 6
 
@@ -32,6 +33,8 @@ typedef struct ethernet_frame
 } ethernet_frame_t;
 
 ethernet_frame_t *ethernet_frame_from_dynamic_buffer(dynamic_buffer_t *buffer);
+ethernet_frame_t *ethernet_frame_from_dynamic_buffer_arena(dynamic_buffer_t *buffer,
+                                                         packet_arena_t *arena);
 void ethernet_frame_free(ethernet_frame_t **frame_p);
 void print_mac(mac_address_t *mac);
 void print_ethernet(ethernet_frame_t *frame, bool print_data);
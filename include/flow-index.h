@@ -0,0 +1,49 @@
+#ifndef __FLOW_INDEX_H__
+#define __FLOW_INDEX_H__
+
+/**
+ * Chained hash table of 32-bit record indices. The records live in an array owned by the caller,
+ * which passes it to every call, and every record starts with its key. Buckets and chain links
+ * hold a record index + 1, 0 ending a chain, and the link of a record is kept in an array next to
+ * the records. A stored flow costs a 4 byte link and its share of the 4 byte buckets, with no
+ * allocation of its own, and growing or moving the records leaves the index untouched.
+ * */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hash-table.h"
+
+#define FLOW_INDEX_NONE UINT32_MAX /* not a record, returned for keys that are not stored */
+
+typedef struct flow_index
+{
+    uint32_t *buckets;      /* index + 1 of the first record of every chain, 0 if empty */
+    uint32_t *next;         /* index + 1 of the record after every record in its chain */
+    uint64_t capacity;      /* number of buckets */
+    uint64_t size;          /* records stored */
+    uint64_t next_capacity; /* records next has room for */
+    hash_func_t hash_func;
+    size_t key_length;      /* bytes of the key at the start of every record */
+    size_t record_size;     /* distance between two records */
+    uint64_t lookups;       /* searches by get and get_many */
+    uint64_t comparisons;   /* keys compared by those searches */
+    uint64_t rehash_count;  /* number of times the buckets were resized */
+    uint64_t rehash_ns;     /* time spent resizing */
+} flow_index_t;
+
+flow_index_t *flow_index_create(uint64_t capacity, hash_func_t hash_func, size_t key_length,
+                                size_t record_size);
+uint32_t flow_index_get(flow_index_t *index, const void *records, const void *key);
+size_t flow_index_get_many(flow_index_t *index, const void *records, const void *const *keys,
+                           uint32_t *results, size_t count);
+bool flow_index_add(flow_index_t *index, const void *records, uint32_t record);
+bool flow_index_remove(flow_index_t *index, const void *records, uint32_t record);
+void flow_index_renumber(flow_index_t *index, const uint32_t *new_index, uint32_t count);
+void flow_index_get_stats(flow_index_t *index, HashTableStats_t *stats);
+void print_flow_index_stats(FILE *stream, flow_index_t *index);
+void flow_index_free(flow_index_t **index_p);
+
+#endif /* __FLOW_INDEX_H__ */
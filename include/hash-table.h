@@ -1,6 +1,9 @@
 #ifndef __HASH_TABLE_H__
 #define __HASH_TABLE_H__
 
+#include <stddef.h>
+#include <stdio.h>
+
 #include "singly-linked-list.h"
 
 typedef uint64_t (*hash_func_t)(const void *key, uint64_t true_hash_size);
@@ -12,6 +15,8 @@ typedef struct HashNode
     const void *data;
 } HashNode_t;
 
+#define HASH_TABLE_CHAIN_HISTOGRAM 8 /* chain lengths 0 to 6, and 7 or longer */
+
 typedef struct HashTable
 {
     uint64_t capacity;
@@ -20,12 +25,35 @@ typedef struct HashTable
     match_func_t match_func;
     free_data_t free_node;
     HashNode_t **table;
+    uint64_t lookups;      /* searches by get and get_many */
+    uint64_t comparisons;  /* keys compared by those searches */
+    uint64_t rehash_count; /* number of times the table was resized */
+    uint64_t rehash_ns;    /* time spent resizing */
 } HashTable_t;
 
+typedef struct HashTableStats
+{
+    uint64_t size;
+    uint64_t capacity;
+    double load_factor;
+    uint64_t max_chain;
+    uint64_t chain_histogram[HASH_TABLE_CHAIN_HISTOGRAM]; /* buckets by chain length */
+    uint64_t rehash_count;
+    double rehash_seconds;
+    uint64_t lookups;
+    double comparisons_per_lookup;
+} HashTableStats_t;
+
 HashTable_t *hash_table_create(uint64_t, hash_func_t, match_func_t, free_data_t);
 const void *hash_table_get_item(HashTable_t *hash_table, const void *key);
+size_t hash_table_get_many(HashTable_t *hash_table, const void *const *keys, const void **results,
+                           size_t count);
 bool hash_table_add_item(HashTable_t *hash_table, const void *key, const void *data);
 bool hash_table_remove_item(HashTable_t *hash_table, const void *key);
+void hash_table_get_stats(HashTable_t *hash_table, HashTableStats_t *stats);
+uint64_t hash_table_grown_capacity(uint64_t capacity);
+void print_hash_stats(FILE *stream, const HashTableStats_t *stats);
 void hash_table_free(HashTable_t **hash_table_p);
+void print_hash_table_stats(FILE *stream, HashTable_t *hash_table);
 
 #endif /* __HASH_TABLE_H__*/
\ No newline at end of file
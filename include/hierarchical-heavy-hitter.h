@@ -0,0 +1,50 @@
+#ifndef __HIERARCHICAL_HEAVY_HITTER_H__
+#define __HIERARCHICAL_HEAVY_HITTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ipv4-packet.h"
+
+#define HHH_LEVELS 5              /* /32, /24, /16, /8 and /0 prefixes */
+#define HHH_DEFAULT_COUNTERS 1024 /* Space-Saving counters kept for every level */
+
+typedef enum hhh_dimension
+{
+    HHH_SOURCE = 0,
+    HHH_DESTINATION,
+    HHH_DIMENSIONS
+} hhh_dimension_t;
+
+typedef struct space_saving_entry
+{
+    uint32_t prefix; /* masked address in host byte order */
+    uint32_t slot;   /* position of this entry in the lookup index */
+    uint64_t count;  /* over-estimated count */
+    uint64_t error;  /* maximum over-estimation of count */
+} space_saving_entry_t;
+
+typedef struct space_saving
+{
+    uint32_t capacity;           /* maximum number of monitored prefixes */
+    uint32_t size;               /* number of monitored prefixes */
+    uint32_t index_mask;         /* index size - 1, index size is a power of two */
+    uint32_t *index;             /* open addressing index, heap position + 1 or 0 if empty */
+    space_saving_entry_t *heap;  /* min heap ordered by count */
+} space_saving_t;
+
+typedef struct hhh
+{
+    uint64_t total;                                       /* number of updates */
+    uint64_t random_state;                                /* xorshift state for level sampling */
+    space_saving_t levels[HHH_DIMENSIONS][HHH_LEVELS];   /* level 0 is the most specific */
+} hhh_t;
+
+hhh_t *hhh_create(uint32_t counters);
+void hhh_update(hhh_t *hhh, const ip_addr_t *src, const ip_addr_t *dest);
+void hhh_merge(hhh_t *hhh, hhh_t *other);
+void hhh_free(hhh_t **hhh_p);
+void print_hhh(FILE *stream, hhh_t *hhh, double threshold);
+
+#endif /* __HIERARCHICAL_HEAVY_HITTER_H__ */
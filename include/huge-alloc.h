@@ -0,0 +1,41 @@
+#ifndef __HUGE_ALLOC_H__
+#define __HUGE_ALLOC_H__
+
+/**
+ * Large arrays backed by 2 MB pages, to cut TLB misses on big flow and hash tables. Arrays of
+ * at least HUGE_ALLOC_THRESHOLD bytes are mapped with MAP_HUGETLB from the reserved huge page
+ * pool, or else mapped 2 MB aligned and marked with MADV_HUGEPAGE for transparent huge pages.
+ * Smaller arrays come from calloc through the allocation tracking macros. The caller passes the
+ * size back on realloc and free, as the path is chosen from it.
+ * */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "alloc-track.h"
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+#define HUGE_ALLOC_THRESHOLD HUGE_PAGE_SIZE /* smaller arrays would waste most of a huge page */
+
+typedef enum huge_alloc_path
+{
+    HUGE_ALLOC_HUGETLB = 0, /* MAP_HUGETLB, huge pages reserved in the pool */
+    HUGE_ALLOC_THP,         /* anonymous mapping with MADV_HUGEPAGE */
+    HUGE_ALLOC_SMALL,       /* below the threshold, from calloc */
+    HUGE_ALLOC_PATHS
+} huge_alloc_path_t;
+
+typedef struct huge_alloc_stats
+{
+    uint64_t allocations[HUGE_ALLOC_PATHS]; /* arrays allocated by every path */
+    uint64_t bytes[HUGE_ALLOC_PATHS];       /* bytes allocated by every path, mappings rounded */
+} huge_alloc_stats_t;
+
+void *huge_calloc(alloc_site_t site, size_t count, size_t size);
+void *huge_realloc(alloc_site_t site, void *ptr, size_t old_size, size_t new_size);
+void huge_free(alloc_site_t site, void *ptr, size_t size);
+void huge_alloc_get_stats(huge_alloc_stats_t *stats);
+void print_huge_alloc_stats(FILE *stream);
+
+#endif /* __HUGE_ALLOC_H__ */
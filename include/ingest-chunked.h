@@ -0,0 +1,14 @@
+#ifndef __INGEST_CHUNKED_H__
+#define __INGEST_CHUNKED_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "capture-ingest.h"
+
+#define INGEST_MIN_CHUNK_SIZE 4096 /* smaller ranges would mostly hold partial packets */
+
+bool ingest_chunked_files(char *const *paths, size_t count, const ingest_config_t *config,
+                          packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats);
+
+#endif /* __INGEST_CHUNKED_H__ */
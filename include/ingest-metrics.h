@@ -0,0 +1,66 @@
+#ifndef __INGEST_METRICS_H__
+#define __INGEST_METRICS_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define INGEST_METRICS_DEFAULT_INTERVAL 10 /* seconds between two metrics files */
+#define INGEST_METRICS_PUBLISH_PACKETS 1024 /* packets a worker counts before publishing */
+
+typedef enum ingest_invalid_reason
+{
+    INGEST_INVALID_ETHERNET = 0,   /* frame could not be decoded */
+    INGEST_INVALID_NON_IPV4,       /* ethertype is not IPv4 */
+    INGEST_INVALID_IPV4_MALFORMED, /* IPv4 datagram could not be decoded */
+    INGEST_INVALID_NON_UDP,        /* IPv4 datagram does not carry UDP */
+    INGEST_INVALID_REASONS
+} ingest_invalid_reason_t;
+
+/* Counts of one worker that are not yet visible in the shared metrics */
+typedef struct ingest_metrics_delta
+{
+    uint64_t packets_read;
+    uint64_t packets_valid;
+    uint64_t bytes_read;
+    uint64_t invalid[INGEST_INVALID_REASONS];
+    uint64_t flows;          /* live flows of the worker counter when last published */
+    uint64_t table_capacity; /* hash table buckets of the worker counter when last published */
+} ingest_metrics_delta_t;
+
+typedef struct ingest_metrics
+{
+    atomic_uint_fast64_t packets_read;
+    atomic_uint_fast64_t packets_valid;
+    atomic_uint_fast64_t bytes_read;
+    atomic_uint_fast64_t invalid[INGEST_INVALID_REASONS];
+    atomic_int_fast64_t flows;          /* flows in all counters */
+    atomic_int_fast64_t table_capacity; /* hash table buckets of all counters */
+} ingest_metrics_t;
+
+typedef struct metrics_writer
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool stopping;
+    unsigned interval;          /* seconds between two files */
+    char *file_path;            /* file read by the textfile collector */
+    char *temp_path;            /* written first, then renamed over file_path */
+    ingest_metrics_t *metrics;  /* shared counts of the run */
+    uint64_t last_bytes_read;   /* bytes_read when the previous file was written */
+    struct timespec last_write; /* when the previous file was written */
+} metrics_writer_t;
+
+ingest_metrics_t *ingest_metrics_create(void);
+void ingest_metrics_publish(ingest_metrics_t *metrics, ingest_metrics_delta_t *delta,
+                            uint64_t flows, uint64_t table_capacity);
+void ingest_metrics_set_table(ingest_metrics_t *metrics, uint64_t flows, uint64_t table_capacity);
+void ingest_metrics_free(ingest_metrics_t **metrics_p);
+metrics_writer_t *metrics_writer_start(const char *file_path, unsigned interval,
+                                       ingest_metrics_t *metrics);
+void metrics_writer_stop(metrics_writer_t **writer_p);
+
+#endif /* __INGEST_METRICS_H__ */
@@ -0,0 +1,15 @@
+#ifndef __INGEST_PIPELINE_H__
+#define __INGEST_PIPELINE_H__
+
+#include <stdbool.h>
+
+#include "capture-ingest.h"
+
+#define PIPELINE_BATCH_SIZE 64     /* packets or flows moved through a ring at once */
+#define PIPELINE_RING_CAPACITY 64  /* batches queued between two stages before backpressure */
+#define PIPELINE_MAX_THREADS 64    /* limit for decoder and for counter threads */
+
+bool ingest_pipeline_file(const char *file_path, const ingest_config_t *config,
+                          packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats);
+
+#endif /* __INGEST_PIPELINE_H__ */
@@ -0,0 +1,31 @@
+#ifndef __INGEST_PROGRESS_H__
+#define __INGEST_PROGRESS_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ingest-metrics.h"
+
+#define INGEST_PROGRESS_INTERVAL_MS 1000 /* time between two progress lines */
+
+typedef struct ingest_progress
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    bool stopping;
+    bool terminal;               /* stderr is a terminal, the line is redrawn in place */
+    uint64_t total_bytes;        /* size of all input files, 0 if unknown */
+    ingest_metrics_t *metrics;   /* shared counts of the run */
+    uint64_t last_packets_read;  /* packets_read at the previous line */
+    uint64_t last_bytes_read;    /* bytes_read at the previous line */
+    struct timespec start;       /* when reporting started, for the average rate */
+    struct timespec last_update; /* when the previous line was printed */
+} ingest_progress_t;
+
+ingest_progress_t *ingest_progress_start(ingest_metrics_t *metrics, uint64_t total_bytes);
+void ingest_progress_stop(ingest_progress_t **progress_p);
+
+#endif /* __INGEST_PROGRESS_H__ */
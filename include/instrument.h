@@ -0,0 +1,72 @@
+#ifndef __INSTRUMENT_H__
+#define __INSTRUMENT_H__
+
+/**
+ * Per stage timing, built with -DINSTRUMENT. Every thread accumulates cycles and calls in thread
+ * local counters, which are summed when the thread calls instrument_thread_done and printed by
+ * instrument_report. Without INSTRUMENT every macro expands to nothing.
+ * */
+
+#include <stdint.h>
+
+typedef enum instrument_stage
+{
+    INSTRUMENT_READ = 0,   /* reading capture lines, without hex decoding */
+    INSTRUMENT_HEX_DECODE, /* hex text to bytes */
+    INSTRUMENT_ETHERNET,   /* ethernet_frame_from_dynamic_buffer */
+    INSTRUMENT_IPV4,       /* ipv4_datagram_from_ethernet_frame */
+    INSTRUMENT_KEY,        /* building flow keys from datagrams */
+    INSTRUMENT_LOOKUP,     /* hash table lookups of flows */
+    INSTRUMENT_INSERT,     /* inserting new flows, including eviction */
+    INSTRUMENT_STAGES
+} instrument_stage_t;
+
+#ifdef INSTRUMENT
+    #if defined(__x86_64__) || defined(__i386__)
+        #include <x86intrin.h>
+        #define INSTRUMENT_UNIT "cycles"
+static inline uint64_t instrument_now(void)
+{
+    return __rdtsc();
+}
+    #else
+        #include <time.h>
+        #define INSTRUMENT_UNIT "ns"
+static inline uint64_t instrument_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+    #endif
+
+void instrument_record(instrument_stage_t stage, uint64_t ticks, uint64_t calls);
+void instrument_flush_thread(void);
+void instrument_print_report(void);
+
+    #define instrument_declare(total) uint64_t total = 0
+    #define instrument_start(start) uint64_t start = instrument_now()
+    #define instrument_add(total, start) (total) += instrument_now() - (start)
+    #define instrument_stop(stage, start) instrument_record(stage, instrument_now() - (start), 1)
+    #define instrument_stop_many(stage, start, calls) \
+        instrument_record(stage, instrument_now() - (start), calls)
+    #define instrument_stop_excluding(stage, start, excluded) \
+        instrument_record(stage, instrument_now() - (start) - (excluded), 1)
+    #define instrument_record_total(stage, total) instrument_record(stage, total, 1)
+    #define instrument_thread_done() instrument_flush_thread()
+    #define instrument_report() instrument_print_report()
+#else
+    #define instrument_declare(total)
+    #define instrument_start(start)
+    #define instrument_add(total, start)
+    #define instrument_stop(stage, start)
+    #define instrument_stop_many(stage, start, calls)
+    #define instrument_stop_excluding(stage, start, excluded)
+    #define instrument_record_total(stage, total)
+    #define instrument_thread_done()
+    #define instrument_report()
+#endif
+
+#endif /* __INSTRUMENT_H__ */
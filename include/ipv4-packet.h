@@ -66,6 +66,8 @@ typedef struct ipv4_datagram
 } ipv4_datagram_t;
 
 ipv4_datagram_t *ipv4_datagram_from_ethernet_frame(ethernet_frame_t *frame);
+ipv4_datagram_t *ipv4_datagram_from_ethernet_frame_arena(ethernet_frame_t *frame,
+                                                         packet_arena_t *arena);
 void ipv4_datagram_free(ipv4_datagram_t **datagram_p);
 int print_ip_addr(ip_addr_t *ip);
 void print_ipv4(ipv4_datagram_t *datagram, bool print_data);
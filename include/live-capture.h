@@ -0,0 +1,32 @@
+#ifndef __LIVE_CAPTURE_H__
+#define __LIVE_CAPTURE_H__
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "capture-ingest.h"
+
+#define LIVE_CAPTURE_BLOCK_SIZE (1 << 20) /* bytes per ring block, a multiple of the page size */
+#define LIVE_CAPTURE_BLOCK_COUNT 64       /* blocks in the ring */
+#define LIVE_CAPTURE_FRAME_SIZE 2048      /* nominal frame size, V3 packs frames tighter */
+#define LIVE_CAPTURE_BLOCK_TIMEOUT_MS 100 /* a partly filled block is handed over after this */
+
+typedef struct live_capture
+{
+    int fd;
+    const char *ifname;
+    bool loopback;        /* outgoing copies are skipped, the incoming ones are counted */
+    uint8_t *ring;        /* LIVE_CAPTURE_BLOCK_COUNT blocks shared with the kernel */
+    size_t ring_size;
+    unsigned next_block;  /* block to read next */
+    uint64_t drops;       /* packets the kernel dropped because the ring was full */
+} live_capture_t;
+
+live_capture_t *live_capture_open(const char *ifname);
+bool live_capture_run(live_capture_t *capture, const ingest_config_t *config,
+                      packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats,
+                      volatile sig_atomic_t *stop);
+void live_capture_free(live_capture_t **capture_p);
+
+#endif /* __LIVE_CAPTURE_H__ */
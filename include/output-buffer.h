@@ -0,0 +1,27 @@
+#ifndef __OUTPUT_BUFFER_H__
+#define __OUTPUT_BUFFER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define OUTPUT_BUFFER_DEFAULT_SIZE (1 << 20)
+
+typedef struct output_buffer
+{
+    FILE *stream;    /* where the buffer is flushed to */
+    char *data;      /* buffered text */
+    size_t size;     /* bytes waiting to be flushed */
+    size_t capacity; /* size of data */
+} output_buffer_t;
+
+output_buffer_t *output_buffer_create(FILE *stream, size_t capacity);
+bool output_buffer_write(output_buffer_t *out, const char *data, size_t length);
+bool output_buffer_puts(output_buffer_t *out, const char *str);
+bool output_buffer_putc(output_buffer_t *out, char c);
+bool output_buffer_put_u64(output_buffer_t *out, uint64_t value);
+size_t output_buffer_format_u64(uint64_t value, char *out);
+bool output_buffer_flush(output_buffer_t *out);
+void output_buffer_free(output_buffer_t **out_p);
+
+#endif /* __OUTPUT_BUFFER_H__ */
@@ -0,0 +1,32 @@
+#ifndef __PACKET_ARENA_H__
+#define __PACKET_ARENA_H__
+
+#include <stddef.h>
+
+#include "alloc-track.h"
+
+#define PACKET_ARENA_BLOCK_SIZE (64 * 1024) /* covers a batch of full size frames */
+
+typedef struct packet_arena_block
+{
+    struct packet_arena_block *next; /* next block, kept over resets for reuse */
+    size_t size;                     /* usable bytes in data */
+    max_align_t data[];
+} packet_arena_block_t;
+
+typedef struct packet_arena
+{
+    packet_arena_block_t *first;   /* first block, where a reset starts again */
+    packet_arena_block_t *current; /* block allocations are bumped from */
+    size_t used;                   /* bytes taken from the current block */
+    size_t block_size;             /* usable size of new blocks */
+} packet_arena_t;
+
+packet_arena_t *packet_arena_create(size_t block_size);
+void *packet_arena_alloc(packet_arena_t *arena, size_t size);
+void *packet_arena_calloc(packet_arena_t *arena, alloc_site_t site, size_t count, size_t size);
+void packet_arena_release(packet_arena_t *arena, alloc_site_t site, void *ptr);
+void packet_arena_reset(packet_arena_t *arena);
+void packet_arena_free(packet_arena_t **arena_p);
+
+#endif /* __PACKET_ARENA_H__ */
@@ -1,28 +1,60 @@
 #ifndef __PACKET_COUNTER_H__
 #define __PACKET_COUNTER_H__
 
-#include "hash-table.h"
+#include "flow-index.h"
+#include "flow-table.h"
 #include "ipv4-packet.h"
 #include "singly-linked-list.h"
 
+#define PACKET_COUNTER_BATCH_SIZE 32 /* datagrams looked up together by increase_many */
+
 typedef struct packet_node
 {
-    ListNode_t node;      /* linked list base */
-    ip_addr_t src;        /* source ip address */
+    ip_addr_t src;        /* source ip address, src and dest together are the hash key */
     ip_addr_t dest;       /* destination ip address */
-    uint64_t ref_counter; /* how many packets with this source and destination */
+    uint64_t ref_counter; /* how many packets with this source and destination, 0 if evicted */
 } packet_node_t;
 
+/* Source and destination of a flow, laid out like the start of packet_node_t */
+typedef struct packet_flow_key
+{
+    ip_addr_t src;
+    ip_addr_t dest;
+} packet_flow_key_t;
+
+/* Receives the final count of every flow evicted from a size limited counter */
+typedef void (*packet_counter_sink_t)(void *context, const ip_addr_t *src, const ip_addr_t *dest,
+                                      uint64_t count);
+
 typedef struct packet_counter
 {
-    packet_node_t *linked_list; /* head of the linked list */
-    HashTable_t *hash_table;    /* hash table pointing to linked list nodes*/
-    free_data_t list_node_free; /* function to free the linked list nodes */
-    void *(*hash_key_from_ipv4)(ipv4_datagram_t *);
+    packet_node_t *flows;                /* flow records in insertion order */
+    uint32_t flow_count;                 /* records in use, including evicted holes */
+    uint32_t flow_capacity;              /* records allocated */
+    uint32_t holes;                      /* evicted records not compacted yet */
+    uint32_t clock_hand;                 /* index of the next eviction candidate */
+    uint64_t *referenced;                /* CLOCK reference bits, one per record */
+    flow_index_t *index;                 /* hash table mapping keys to record indices */
+    uint64_t max_entries;                /* flows kept before evicting, 0 for unlimited */
+    uint64_t evicted;                    /* number of flows evicted so far */
+    packet_counter_sink_t overflow_sink; /* where evicted flows are written, can be NULL */
+    void *overflow_context;              /* passed to overflow_sink */
 } packet_counter_t;
 
 packet_counter_t *packet_counter_create();
+bool packet_counter_set_limit(packet_counter_t *counter, uint64_t max_entries,
+                              packet_counter_sink_t sink, void *context);
+uint64_t packet_counter_entries_for_memory(uint64_t max_bytes);
+uint64_t packet_counter_hash_key(const void *key, uint64_t true_hash_size);
 void packet_counter_increase(packet_counter_t *counter, ipv4_datagram_t *datagram);
+void packet_counter_increase_many(packet_counter_t *counter, ipv4_datagram_t *const *datagrams,
+                                  size_t count);
+void packet_counter_add(packet_counter_t *counter, const ip_addr_t *src, const ip_addr_t *dest,
+                        uint64_t count);
+void packet_counter_add_many(packet_counter_t *counter, const packet_flow_key_t *keys,
+                             size_t count);
+void packet_counter_merge(packet_counter_t *counter, packet_counter_t *other);
+void packet_counter_merge_flows(packet_counter_t *counter, const flow_table_t *table);
 void packet_counter_free(packet_counter_t **counter_p);
 void print_packet_counter_hash_table(packet_counter_t *counter);
 void print_packet_counter_linked_list(packet_counter_t *counter);
@@ -0,0 +1,57 @@
+#ifndef __PCAP_FILE_H__
+#define __PCAP_FILE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dynamic-buffer.h"
+#include "uring-reader.h"
+
+#define PCAP_MAGIC 0xa1b2c3d4      /* microsecond timestamps */
+#define PCAP_MAGIC_NANO 0xa1b23c4d /* nanosecond timestamps */
+#define PCAP_VERSION_MAJOR 2
+#define PCAP_VERSION_MINOR 4
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_MAX_RECORD_LEN 262144 /* larger records are treated as a corrupt file */
+
+#pragma pack(push, 1)
+typedef struct pcap_file_header
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+} pcap_file_header_t;
+
+typedef struct pcap_record_header
+{
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} pcap_record_header_t;
+#pragma pack(pop)
+
+typedef struct pcap_file
+{
+    long current_pos;      /* bytes of the file consumed */
+    long file_length;
+    const char *file_path;
+    uring_reader_t *reader;
+    const uint8_t *chunk;  /* buffer of the reader being parsed */
+    size_t chunk_length;
+    size_t chunk_pos;
+    bool swapped;          /* written on a host of the other byte order */
+} pcap_file_t;
+
+bool pcap_file_probe(const char *file_path);
+pcap_file_t *pcap_file_create(const char *file_path, bool direct);
+bool pcap_file_readable(pcap_file_t *pcap_file);
+void pcap_file_free(pcap_file_t **pcap_file_p);
+bool pcap_file_read_packet(pcap_file_t *pcap_file, dynamic_buffer_t *buffer);
+dynamic_buffer_t *pcap_file_get_next_packet(pcap_file_t *pcap_file);
+
+#endif /* __PCAP_FILE_H__ */
@@ -0,0 +1,39 @@
+#ifndef __REPORT_EXPORT_H__
+#define __REPORT_EXPORT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "packet-counter.h"
+
+/**
+ * Binary export layout: an 8 byte magic, a little endian uint32 version and a little endian
+ * uint32 record size, followed by one fixed size record per flow. A record holds the source and
+ * destination addresses in network order and the count as a little endian uint64.
+ * */
+#define REPORT_BINARY_MAGIC "PKTCREC1"
+#define REPORT_BINARY_MAGIC_LENGTH 8
+#define REPORT_BINARY_VERSION 1
+
+#define REPORT_PATH_STDOUT "-"
+
+typedef enum report_format
+{
+    REPORT_FORMAT_CSV = 0,
+    REPORT_FORMAT_JSON_LINES,
+    REPORT_FORMAT_BINARY
+} report_format_t;
+
+#pragma pack(push, 1)
+typedef struct report_binary_record
+{
+    ip_addr_t src;
+    ip_addr_t dest;
+    uint64_t count;
+} report_binary_record_t;
+#pragma pack(pop)
+
+bool report_format_from_string(const char *name, report_format_t *format);
+bool report_export(packet_counter_t *counter, report_format_t format, const char *file_path);
+
+#endif /* __REPORT_EXPORT_H__ */
@@ -0,0 +1,35 @@
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SPSC_RING_CACHE_LINE 64
+
+/**
+ * Bounded single producer, single consumer queue of pointers. Only one thread may push and only
+ * one thread may pop. The producer closes the ring once it is done, and the consumer sees it as
+ * drained when it is closed and empty.
+ * */
+typedef struct spsc_ring
+{
+    _Alignas(SPSC_RING_CACHE_LINE) atomic_size_t head; /* next slot written by the producer */
+    size_t cached_tail;                                /* producer copy of tail */
+    _Alignas(SPSC_RING_CACHE_LINE) atomic_size_t tail; /* next slot read by the consumer */
+    size_t cached_head;                                /* consumer copy of head */
+    _Alignas(SPSC_RING_CACHE_LINE) atomic_bool closed; /* no more pushes will come */
+    size_t mask;                                       /* capacity - 1, capacity is a power of 2 */
+    void **slots;
+} spsc_ring_t;
+
+spsc_ring_t *spsc_ring_create(size_t capacity);
+bool spsc_ring_try_push(spsc_ring_t *ring, void *item);
+void spsc_ring_push(spsc_ring_t *ring, void *item);
+void *spsc_ring_try_pop(spsc_ring_t *ring);
+void spsc_ring_close(spsc_ring_t *ring);
+bool spsc_ring_drained(spsc_ring_t *ring);
+void spsc_ring_backoff(unsigned *spins);
+void spsc_ring_free(spsc_ring_t **ring_p);
+
+#endif /* __SPSC_RING_H__ */
@@ -0,0 +1,20 @@
+#ifndef __UDP_LISTENER_H__
+#define __UDP_LISTENER_H__
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdbool.h>
+
+#include "capture-ingest.h"
+
+#define UDP_LISTENER_BATCH 64            /* datagrams received by one recvmmsg call */
+#define UDP_LISTENER_MAX_THREADS 64      /* SO_REUSEPORT sockets, one thread each */
+#define UDP_LISTENER_POLL_MS 100         /* how often an idle listener checks the stop flag */
+#define UDP_LISTENER_BUFFER_SIZE (8 << 20) /* requested socket receive buffer */
+
+bool udp_listener_parse_address(const char *str, struct sockaddr_in *address);
+bool udp_listener_run(const struct sockaddr_in *address, unsigned threads,
+                      const ingest_config_t *config, packet_counter_t *counter, hhh_t *hhh,
+                      ingest_stats_t *stats, volatile sig_atomic_t *stop);
+
+#endif /* __UDP_LISTENER_H__ */
@@ -23,6 +23,8 @@ typedef struct udp_packet
 } udp_packet_t;
 
 udp_packet_t *udp_packet_from_ipv4_datagram(ipv4_datagram_t *datagram);
+udp_packet_t *udp_packet_from_ipv4_datagram_arena(ipv4_datagram_t *datagram,
+                                                  packet_arena_t *arena);
 void udp_packet_free(udp_packet_t **packet_p);
 void print_udp(udp_packet_t *packet, bool print_data);
 
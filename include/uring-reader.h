@@ -0,0 +1,67 @@
+#ifndef __URING_READER_H__
+#define __URING_READER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define URING_READER_BUFFERS 8                 /* reads kept in flight */
+#define URING_READER_BUFFER_SIZE (1 << 20)     /* bytes per read, a multiple of the alignment */
+#define URING_READER_ALIGNMENT 4096            /* buffer and offset alignment for O_DIRECT */
+
+typedef enum uring_slot_state
+{
+    URING_SLOT_FREE = 0,
+    URING_SLOT_IN_FLIGHT,
+    URING_SLOT_READY
+} uring_slot_state_t;
+
+typedef struct uring_slot
+{
+    uint8_t *data;            /* aligned buffer, registered with the ring when possible */
+    uint64_t chunk;           /* chunk number, the file offset divided by the buffer size */
+    size_t filled;            /* bytes read so far */
+    uring_slot_state_t state;
+} uring_slot_t;
+
+/* Submission and completion rings shared with the kernel */
+typedef struct uring_queues
+{
+    int fd;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;             /* same as sq_map with IORING_FEAT_SINGLE_MMAP */
+    size_t cq_map_size;
+    void *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    void *cqes;
+    bool fixed_buffers;       /* buffers registered, reads use IORING_OP_READ_FIXED */
+} uring_queues_t;
+
+typedef struct uring_reader
+{
+    int fd;
+    off_t file_length;
+    bool direct;              /* opened with O_DIRECT */
+    bool use_uring;           /* false if io_uring is not available, reads are then pread */
+    bool read_error;          /* a read failed, the file is not read any further */
+    uring_queues_t queues;
+    uring_slot_t slots[URING_READER_BUFFERS];
+    uint64_t next_submit;     /* next chunk to read */
+    uint64_t next_consume;    /* next chunk handed to the caller */
+    bool holding;             /* the caller still holds chunk next_consume - 1 */
+} uring_reader_t;
+
+uring_reader_t *uring_reader_open(const char *file_path, bool direct);
+const uint8_t *uring_reader_next(uring_reader_t *reader, size_t *length);
+void uring_reader_free(uring_reader_t **reader_p);
+
+#endif /* __URING_READER_H__ */
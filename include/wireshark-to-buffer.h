@@ -15,7 +15,9 @@ typedef struct wireshark_file
 
 wireshark_file_t *wireshark_file_create(const char *file_path);
 bool wireshark_file_readable(wireshark_file_t *ws_file);
+long wireshark_file_packet_start(wireshark_file_t *ws_file, long offset);
 void wireshark_file_free(wireshark_file_t **ws_file_p);
+bool wireshark_file_read_packet(wireshark_file_t *ws_file, dynamic_buffer_t *buffer);
 dynamic_buffer_t *wireshark_file_get_next_packet(wireshark_file_t *ws_file);
 
 #endif /* __WIRESHARK_TO_BUFFER_H__*/
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef __WORK_POOL_H__
+#define __WORK_POOL_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "cpu-affinity.h"
+
+struct work_pool;
+
+/* A task runs on worker, and may submit more tasks to the pool */
+typedef void (*work_task_func_t)(struct work_pool *pool, unsigned worker, void *arg);
+
+typedef struct work_task
+{
+    work_task_func_t func;
+    void *arg;
+} work_task_t;
+
+/* Owner pushes and pops at the bottom, thieves take the oldest task from the top */
+typedef struct work_deque
+{
+    pthread_mutex_t lock;
+    work_task_t *tasks; /* circular buffer */
+    size_t capacity;    /* size of tasks, a power of two */
+    size_t top;         /* index of the oldest task */
+    size_t bottom;      /* index after the newest task */
+} work_deque_t;
+
+typedef struct work_pool
+{
+    unsigned worker_count;
+    work_deque_t *deques;    /* one per worker */
+    pthread_t *threads;
+    const cpu_list_t *cpus;  /* worker i is pinned to the i-th CPU, NULL for no pinning */
+    atomic_size_t pending;   /* tasks submitted and not finished yet */
+    atomic_uint next_worker; /* deque receiving the next task submitted from outside */
+    pthread_mutex_t idle_lock;
+    pthread_cond_t work_ready; /* signaled on submit and when the last task finishes */
+    size_t submitted;          /* tasks queued so far, protected by idle_lock */
+} work_pool_t;
+
+work_pool_t *work_pool_create(unsigned worker_count, const cpu_list_t *cpus);
+bool work_pool_submit(work_pool_t *pool, int worker, work_task_func_t func, void *arg);
+bool work_pool_run(work_pool_t *pool);
+void work_pool_free(work_pool_t **pool_p);
+
+#endif /* __WORK_POOL_H__ */
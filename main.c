@@ -1,95 +1,576 @@
+#include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
 
-#include "debug.h"
+#include "alloc-track.h"
+#include "capture-ingest.h"
+#include "counter-snapshot.h"
+#include "hierarchical-heavy-hitter.h"
+#include "huge-alloc.h"
+#include "ingest-chunked.h"
+#include "ingest-metrics.h"
+#include "ingest-pipeline.h"
+#include "ingest-progress.h"
+#include "instrument.h"
+#include "live-capture.h"
 #include "packet-counter.h"
-#include "udp-packet.h"
-#include "wireshark-to-buffer.h"
+#include "report-export.h"
+#include "udp-listener.h"
 
-#define ARGUMENT_LENGTH 2
-#define ARGUMENT_FILE_PATH_INDEX 1
-#define FILE_EXISTS 0
+#define OPTION_STRING "H:e:M:o:s:l:j:P:c:C:i:u:T:qpDSf:w:m:t:"
+
+#define STDOUT_BUFFER_SIZE (1 << 16)
+
+#define SIZE_SUFFIX_KILO 1024ULL
 
 packet_counter_t *counter = NULL;
+hhh_t *heavy_hitters = NULL;
+static volatile sig_atomic_t live_stop = 0;
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-q] [-p] [-D] [-S] [-j jobs [-c bytes] | -P decoders[:counters]] "
+            "[-C cpus] [-H threshold] [-e entries | -M bytes] [-o file] [-l snapshot] "
+            "[-s snapshot] [-f csv|jsonl|bin [-w file]] [-m file [-t seconds]] "
+            "<file_path|directory|glob>... | -i interface [-T seconds] | "
+            "-u [address:]port [-T seconds]\n",
+            program);
+    fprintf(stderr, "  -q            quiet, print only the final report\n");
+    fprintf(stderr, "  -p            print throughput, progress and ETA on stderr every second\n");
+    fprintf(stderr, "  -D            read pcap files with O_DIRECT, bypassing the page cache\n");
+    fprintf(stderr, "  -S            print hash table statistics with the report\n");
+    fprintf(stderr, "  -j jobs       worker threads for multiple files, default one per CPU\n");
+    fprintf(stderr, "  -c bytes      split files into packet ranges of this size (K, M, G suffix) "
+                    "for the workers\n");
+    fprintf(stderr, "  -P d[:c]      pipeline reading, decoding on d threads and counting on c "
+                    "threads\n");
+    fprintf(stderr, "  -C cpus       pin threads to these CPUs in order, e.g. 0-3,8 (reader, "
+                    "decoders and counters with -P)\n");
+    fprintf(stderr, "  -i interface  count live traffic of the interface until interrupted\n");
+    fprintf(stderr, "  -u address    count datagrams sent to this UDP [address:]port, on -j "
+                    "SO_REUSEPORT threads\n");
+    fprintf(stderr, "  -T seconds    stop live counting after this time\n");
+    fprintf(stderr, "  -H threshold  report hierarchical heavy hitter prefixes above this share "
+                    "of the traffic (0 to 1)\n");
+    fprintf(stderr, "  -e entries    keep at most this many flows, evicting cold ones\n");
+    fprintf(stderr, "  -M bytes      keep the flow table within this memory (K, M, G suffix)\n");
+    fprintf(stderr, "  -o file       write final counts of evicted flows to file\n");
+    fprintf(stderr, "  -l snapshot   start from the counts stored in a snapshot\n");
+    fprintf(stderr, "  -s snapshot   write the final counts to a binary snapshot\n");
+    fprintf(stderr, "  -f format     export the flows as csv, jsonl or bin records\n");
+    fprintf(stderr, "  -w file       write the export to file instead of stdout\n");
+    fprintf(stderr, "  -m file       keep Prometheus metrics of the run in file\n");
+    fprintf(stderr, "  -t seconds    interval between metrics updates, default %d\n",
+            INGEST_METRICS_DEFAULT_INTERVAL);
+}
+
+/* Parses a positive integer with an optional K, M or G binary suffix */
+static bool parse_size(const char *str, uint64_t *value)
+{
+    char *endptr = NULL;
+    unsigned long long parsed = 0;
+
+    parsed = strtoull(str, &endptr, 10);
+
+    if (endptr == str || parsed == 0)
+    {
+        return false;
+    }
+
+    switch (*endptr)
+    {
+        case 'G':
+        case 'g':
+            parsed *= SIZE_SUFFIX_KILO;
+            /* fall through */
+        case 'M':
+        case 'm':
+            parsed *= SIZE_SUFFIX_KILO;
+            /* fall through */
+        case 'K':
+        case 'k':
+            parsed *= SIZE_SUFFIX_KILO;
+            endptr++;
+            break;
+        default:
+            break;
+    }
+
+    *value = parsed;
+
+    return *endptr == '\0';
+}
+
+static void stop_live_capture(int signal_number)
+{
+    (void)signal_number;
+    live_stop = 1;
+}
+
+static void write_evicted_flow(void *context, const ip_addr_t *src, const ip_addr_t *dest,
+                               uint64_t count)
+{
+    fprintf((FILE *)context, "%u.%u.%u.%u %u.%u.%u.%u %" PRIu64 "\n", src->byte[0], src->byte[1],
+            src->byte[2], src->byte[3], dest->byte[0], dest->byte[1], dest->byte[2],
+            dest->byte[3], count);
+}
 
 int main(int argc, char *argv[])
 {
-    const char *ws_file_path = NULL;
-    wireshark_file_t *ws_file = NULL;
-    dynamic_buffer_t *buf = NULL;
-    ethernet_frame_t *frame = NULL;
-    ipv4_datagram_t *datagram = NULL;
+    char **ws_file_paths = NULL;
+    size_t ws_file_count = 0;
+    ingest_stats_t *stats = NULL;
+    ingest_config_t config = {0};
     uint64_t packet_total = 0;
     uint64_t packet_valid = 0;
-#ifdef DEBUG
-    udp_packet_t *packet = NULL;
-#endif
+    double hhh_threshold = 0;
+    uint64_t max_entries = 0;
+    uint64_t max_memory = 0;
+    uint64_t jobs = 0;
+    uint64_t chunk_size = 0;
+    cpu_list_t cpu_list = {0};
+    bool pin_threads = false;
+    const char *interface = NULL;
+    live_capture_t *live = NULL;
+    uint64_t live_seconds = 0;
+    const char *listen_address = NULL;
+    struct sockaddr_in listen_sockaddr;
+    const char *overflow_path = NULL;
+    FILE *overflow_file = NULL;
+    FILE *report = stdout;
+    const char *load_path = NULL;
+    const char *snapshot_path = NULL;
+    report_format_t export_format = REPORT_FORMAT_CSV;
+    const char *export_path = NULL;
+    bool export = false;
+    const char *metrics_path = NULL;
+    uint64_t metrics_interval = INGEST_METRICS_DEFAULT_INTERVAL;
+    ingest_metrics_t *metrics = NULL;
+    metrics_writer_t *metrics_writer = NULL;
+    ingest_progress_t *progress = NULL;
+    bool show_progress = false;
+    bool table_stats = false;
+    bool direct_io = false;
+    unsigned decoders = 0;
+    unsigned counters = 0;
+    bool quiet = false;
+    int option = 0;
+    int exit_status = EXIT_FAILURE;
+    bool failed = false; /* an input or output failed, the rest of the report is still done */
+    size_t i = 0;
 
-    if (argc != ARGUMENT_LENGTH)
+    while ((option = getopt(argc, argv, OPTION_STRING)) != -1)
     {
-        fprintf(stderr, "Usage: %s <file_path>\n", argv[0]);
+        switch (option)
+        {
+            case 'H':
+                hhh_threshold = strtod(optarg, NULL);
+
+                if (hhh_threshold <= 0 || hhh_threshold > 1)
+                {
+                    fprintf(stderr, "Heavy hitter threshold must be between 0 and 1\n");
+
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'e':
+                if (!parse_size(optarg, &max_entries))
+                {
+                    fprintf(stderr, "Invalid maximum number of entries: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'M':
+                if (!parse_size(optarg, &max_memory))
+                {
+                    fprintf(stderr, "Invalid memory limit: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'o':
+                overflow_path = optarg;
+                break;
+            case 'l':
+                load_path = optarg;
+                break;
+            case 's':
+                snapshot_path = optarg;
+                break;
+            case 'q':
+                quiet = true;
+                break;
+            case 'p':
+                show_progress = true;
+                break;
+            case 'S':
+                table_stats = true;
+                break;
+            case 'D':
+                direct_io = true;
+                break;
+            case 'f':
+                if (!report_format_from_string(optarg, &export_format))
+                {
+                    fprintf(stderr, "Unknown export format: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                export = true;
+                break;
+            case 'w':
+                export_path = optarg;
+                break;
+            case 'm':
+                metrics_path = optarg;
+                break;
+            case 't':
+                if (!parse_size(optarg, &metrics_interval) || metrics_interval > UINT_MAX)
+                {
+                    fprintf(stderr, "Invalid metrics interval: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'P':
+                if (sscanf(optarg, "%u:%u", &decoders, &counters) < 1 || decoders == 0 ||
+                    decoders > PIPELINE_MAX_THREADS || counters > PIPELINE_MAX_THREADS)
+                {
+                    fprintf(stderr, "Invalid pipeline threads: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'c':
+                if (!parse_size(optarg, &chunk_size) || chunk_size < INGEST_MIN_CHUNK_SIZE ||
+                    chunk_size > LONG_MAX)
+                {
+                    fprintf(stderr, "Invalid chunk size: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'C':
+                if (!cpu_list_parse(optarg, &cpu_list))
+                {
+                    fprintf(stderr, "Invalid CPU list: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                pin_threads = true;
+                break;
+            case 'i':
+                interface = optarg;
+                break;
+            case 'u':
+                if (!udp_listener_parse_address(optarg, &listen_sockaddr))
+                {
+                    fprintf(stderr, "Invalid UDP address: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                listen_address = optarg;
+                break;
+            case 'T':
+                if (!parse_size(optarg, &live_seconds) || live_seconds > UINT_MAX)
+                {
+                    fprintf(stderr, "Invalid capture time: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            case 'j':
+                if (!parse_size(optarg, &jobs))
+                {
+                    fprintf(stderr, "Invalid number of jobs: %s\n", optarg);
+
+                    return EXIT_FAILURE;
+                }
+
+                break;
+            default:
+                print_usage(argv[0]);
+
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* stdout is line buffered on a terminal, which costs a write for every report line */
+    setvbuf(stdout, NULL, _IOFBF, STDOUT_BUFFER_SIZE);
+
+    if (export_path != NULL && !export)
+    {
+        fprintf(stderr, "An export file needs an export format.\n");
 
         return EXIT_FAILURE;
     }
 
-    ws_file_path = argv[ARGUMENT_FILE_PATH_INDEX];
+    if (export && export_path == NULL)
+    {
+        export_path = REPORT_PATH_STDOUT;
+        quiet = true; /* the export owns stdout */
+    }
 
-    if (access(ws_file_path, F_OK) != FILE_EXISTS)
+    if ((optind != argc) + (interface != NULL) + (listen_address != NULL) != 1)
     {
-        perror("File does not exist\n");
+        print_usage(argv[0]);
 
         return EXIT_FAILURE;
     }
 
+    if (optind != argc &&
+        !ingest_expand_paths(&argv[optind], argc - optind, &ws_file_paths, &ws_file_count))
+    {
+        return EXIT_FAILURE;
+    }
+
+    /* A live capture is reported like a single input */
+    stats = (ingest_stats_t *)calloc((optind == argc) ? 1 : ws_file_count, sizeof(ingest_stats_t));
     counter = packet_counter_create(); /* uses linked list and hash table to count packets */
-    ws_file = wireshark_file_create(ws_file_path); /* wireshark file object to get packets*/
 
-    while (wireshark_file_readable(ws_file))
+    if (stats == NULL || counter == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for counting.\n");
+        goto cleanup;
+    }
+
+    if (max_memory != 0)
+    {
+        max_entries = packet_counter_entries_for_memory(max_memory);
+    }
+
+    if (overflow_path != NULL)
+    {
+        overflow_file = fopen(overflow_path, "w");
+
+        if (overflow_file == NULL)
+        {
+            perror("Unable to open overflow file");
+            goto cleanup;
+        }
+    }
+
+    config.jobs = (unsigned)jobs;
+    /* lines of several files or ranges would interleave, and pipeline stages do not print */
+    config.verbose = !quiet && ws_file_count == 1 && decoders == 0 && chunk_size == 0;
+    config.heavy_hitters = hhh_threshold > 0;
+    config.max_entries = max_entries;
+    config.overflow_sink = (overflow_file != NULL) ? write_evicted_flow : NULL;
+    config.overflow_context = overflow_file;
+    config.decoders = decoders;
+    config.counters = counters;
+    config.chunk_size = chunk_size;
+    config.direct_io = direct_io;
+    config.cpus = pin_threads ? &cpu_list : NULL;
+    config.table_stats = table_stats;
+
+    if (metrics_path != NULL || show_progress)
+    {
+        metrics = ingest_metrics_create();
+
+        if (metrics == NULL)
+        {
+            goto cleanup;
+        }
+
+        config.metrics = metrics;
+    }
+
+    if (metrics_path != NULL)
     {
-        packet_total++;
-        printf("Packet %" PRIu64 "\n", packet_total);
+        metrics_writer = metrics_writer_start(metrics_path, (unsigned)metrics_interval, metrics);
 
-        buf = wireshark_file_get_next_packet(ws_file);
-        frame = ethernet_frame_from_dynamic_buffer(buf);
-        if_debug_call(print_ethernet, frame, false);
-        dynamic_buffer_free(&buf);
-        datagram = ipv4_datagram_from_ethernet_frame(frame);
-        if_debug_call(print_ipv4, datagram, false);
-        ethernet_frame_free(&frame);
+        if (metrics_writer == NULL)
+        {
+            fprintf(stderr, "Unable to write metrics to %s\n", metrics_path);
+            goto cleanup;
+        }
+    }
 
-        if (datagram != NULL && datagram->header->protocol == IPV4_PROTOCOL_UDP)
+    if (show_progress)
+    {
+        progress = ingest_progress_start(metrics,
+                                         ingest_total_bytes(ws_file_paths, ws_file_count));
+    }
+
+    packet_counter_set_limit(counter, config.max_entries, config.overflow_sink,
+                             config.overflow_context);
+
+    if (load_path != NULL && !counter_snapshot_load(load_path, counter))
+    {
+        fprintf(stderr, "Unable to load snapshot: %s\n", load_path);
+        goto cleanup;
+    }
+
+    if (config.heavy_hitters)
+    {
+        heavy_hitters = hhh_create(HHH_DEFAULT_COUNTERS); /* bounded memory prefix counters */
+
+        if (heavy_hitters == NULL)
         {
-            packet_valid++;
-            packet_counter_increase(counter, datagram);
-#ifdef DEBUG
-            packet = udp_packet_from_ipv4_datagram(datagram);
-            print_udp(packet, true);
-            udp_packet_free(&packet);
-#else
-            printf("  Packet valid, counted\n");
-#endif
+            fprintf(stderr, "Unable to create heavy hitter detector\n");
+            goto cleanup;
         }
-        else
+    }
+
+    if (interface != NULL || listen_address != NULL)
+    {
+        live = (interface != NULL) ? live_capture_open(interface) : NULL;
+
+        if (interface != NULL && live == NULL)
+        {
+            goto cleanup;
+        }
+
+        signal(SIGINT, stop_live_capture);
+        signal(SIGTERM, stop_live_capture);
+        signal(SIGALRM, stop_live_capture);
+        alarm((unsigned)live_seconds); /* 0 keeps counting until interrupted */
+
+        if (live != NULL)
+        {
+            cpu_affinity_pin(config.cpus, 0);
+            failed = !live_capture_run(live, &config, counter, heavy_hitters, stats, &live_stop);
+        }
+        else if (!udp_listener_run(&listen_sockaddr, (jobs != 0) ? (unsigned)jobs : 1, &config,
+                                   counter, heavy_hitters, stats, &live_stop))
         {
-            printf("  Packet invalid, ignored\n");
+            fprintf(stderr, "Unable to receive on %s\n", listen_address);
+            failed = true;
         }
 
-        printf("\n");
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+    }
+    else if (!ingest_files(ws_file_paths, ws_file_count, &config, counter, heavy_hitters, stats))
+    {
+        fprintf(stderr, "Some capture files could not be read.\n");
+        failed = true;
+    }
 
-        ipv4_datagram_free(&datagram);
+    ingest_progress_stop(&progress);
+    metrics_writer_stop(&metrics_writer); /* the last write has the final counts */
+
+    if (export && !report_export(counter, export_format, export_path))
+    {
+        goto cleanup;
     }
 
-    wireshark_file_free(&ws_file);
+    /* An export to stdout replaces the tables and totals, the other reports go to stderr */
+    report = (export && strcmp(export_path, REPORT_PATH_STDOUT) == 0) ? stderr : stdout;
 
-    print_packet_counter_hash_table(counter);
-    print_packet_counter_linked_list(counter);
+    if (report == stdout)
+    {
+        print_packet_counter_hash_table(counter);
+        print_packet_counter_linked_list(counter);
+    }
+
+    if (table_stats)
+    {
+        print_flow_index_stats(report, counter->index);
+        print_huge_alloc_stats(report);
+    }
+
+    if (snapshot_path != NULL && !counter_snapshot_write(counter, snapshot_path))
+    {
+        failed = true;
+    }
+
+    if (counter->evicted != 0)
+    {
+        fprintf(report, "%" PRIu64 " cold flows were evicted to stay within %" PRIu64 " entries.\n",
+                counter->evicted, max_entries);
+    }
+
+    if (heavy_hitters != NULL)
+    {
+        print_hhh(report, heavy_hitters, hhh_threshold);
+    }
+
+    if (live != NULL || listen_address != NULL)
+    {
+        packet_total = stats[0].packet_total;
+    }
+
+    for (i = 0; i < ws_file_count; i++)
+    {
+        packet_total += stats[i].packet_total;
+        packet_valid += stats[i].packet_valid;
+    }
+
+    if (report == stdout)
+    {
+        if (live != NULL)
+        {
+            printf("There was total %" PRIu64 " packets on interface %s\n",
+                   stats[0].packet_total, interface);
+            printf("Out of which %" PRIu64 " packets were valid IPv4 UDP packet.\n",
+                   stats[0].packet_valid);
+            printf("The kernel dropped %" PRIu64 " packets.\n", live->drops);
+        }
+
+        if (listen_address != NULL)
+        {
+            printf("There was total %" PRIu64 " datagrams received on %s\n",
+                   stats[0].packet_total, listen_address);
+        }
+
+        for (i = 0; i < ws_file_count; i++)
+        {
+            printf("There was total %" PRIu64 " packets in file %s\n", stats[i].packet_total,
+                   ws_file_paths[i]);
+            printf("Out of which %" PRIu64 " packets were valid IPv4 UDP packet.\n",
+                   stats[i].packet_valid);
+        }
+
+        if (ws_file_count > 1)
+        {
+            printf("In all %zu files there was total %" PRIu64 " packets, %" PRIu64
+                   " valid IPv4 UDP packets.\n",
+                   ws_file_count, packet_total, packet_valid);
+        }
+    }
+
+    instrument_report(); /* per stage timing of -DINSTRUMENT builds */
+    alloc_track_report(packet_total); /* heap traffic of -DALLOC_TRACK builds */
+    exit_status = failed ? EXIT_FAILURE : EXIT_SUCCESS;
+
+cleanup:
+    ingest_progress_stop(&progress);
+    metrics_writer_stop(&metrics_writer);
+    ingest_metrics_free(&metrics);
     packet_counter_free(&counter);
+    hhh_free(&heavy_hitters);
+    live_capture_free(&live);
+
+    if (overflow_file != NULL)
+    {
+        fclose(overflow_file);
+        overflow_file = NULL;
+    }
+
+    free(stats);
+    stats = NULL;
 
-    printf("There was total %" PRIu64 " packets in file %s\n", packet_total, ws_file_path);
-    printf("Out of which %" PRIu64 " packets were valid IPv4 UDP packet.\n", packet_valid);
+    ingest_free_paths(&ws_file_paths, ws_file_count);
 
-    return EXIT_SUCCESS;
+    return exit_status;
 }
@@ -0,0 +1,147 @@
+#include "alloc-track.h"
+
+#ifdef ALLOC_TRACK
+
+    #include <inttypes.h>
+    #include <malloc.h>
+    #include <stdatomic.h>
+    #include <stdio.h>
+
+typedef struct alloc_counter
+{
+    atomic_uint_fast64_t allocs;
+    atomic_uint_fast64_t frees;
+    atomic_uint_fast64_t bytes;      /* bytes allocated, including reallocations */
+    atomic_int_fast64_t live_bytes;  /* bytes allocated and not freed yet */
+    atomic_int_fast64_t peak_bytes;  /* highest live_bytes of this site */
+} alloc_counter_t;
+
+static const char *const site_names[ALLOC_SITES] = {
+    "dynamic buffer", "ethernet frame", "ipv4 datagram", "udp packet",
+    "hash node",      "hash table",     "flow table",    "packet arena",
+};
+
+static alloc_counter_t site_counters[ALLOC_SITES];
+static atomic_int_fast64_t total_live_bytes;
+static atomic_int_fast64_t total_peak_bytes;
+
+static void alloc_track_update_peak(atomic_int_fast64_t *peak, int_fast64_t live)
+{
+    int_fast64_t current = atomic_load_explicit(peak, memory_order_relaxed);
+
+    while (live > current &&
+           !atomic_compare_exchange_weak_explicit(peak, &current, live, memory_order_relaxed,
+                                                  memory_order_relaxed))
+    {
+    }
+}
+
+static void alloc_track_add(alloc_site_t site, size_t bytes)
+{
+    alloc_counter_t *counter = &site_counters[site];
+    int_fast64_t live = 0;
+
+    atomic_fetch_add_explicit(&counter->allocs, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counter->bytes, bytes, memory_order_relaxed);
+    live = atomic_fetch_add_explicit(&counter->live_bytes, (int_fast64_t)bytes,
+                                     memory_order_relaxed) + (int_fast64_t)bytes;
+    alloc_track_update_peak(&counter->peak_bytes, live);
+    live = atomic_fetch_add_explicit(&total_live_bytes, (int_fast64_t)bytes,
+                                     memory_order_relaxed) + (int_fast64_t)bytes;
+    alloc_track_update_peak(&total_peak_bytes, live);
+}
+
+static void alloc_track_remove(alloc_site_t site, size_t bytes)
+{
+    atomic_fetch_add_explicit(&site_counters[site].frees, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&site_counters[site].live_bytes, (int_fast64_t)bytes,
+                              memory_order_relaxed);
+    atomic_fetch_sub_explicit(&total_live_bytes, (int_fast64_t)bytes, memory_order_relaxed);
+}
+
+void *alloc_track_calloc(alloc_site_t site, size_t count, size_t size)
+{
+    void *ptr = calloc(count, size);
+
+    if (ptr != NULL)
+    {
+        alloc_track_add(site, malloc_usable_size(ptr));
+    }
+
+    return ptr;
+}
+
+/* A reallocation is accounted as a free of the old block and an allocation of the new one */
+void *alloc_track_realloc(alloc_site_t site, void *ptr, size_t size)
+{
+    size_t old_size = (ptr != NULL) ? malloc_usable_size(ptr) : 0;
+    void *new_ptr = realloc(ptr, size);
+
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+
+    if (ptr != NULL)
+    {
+        alloc_track_remove(site, old_size);
+    }
+
+    alloc_track_add(site, malloc_usable_size(new_ptr));
+
+    return new_ptr;
+}
+
+void alloc_track_free(alloc_site_t site, void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    alloc_track_remove(site, malloc_usable_size(ptr));
+    free(ptr);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       alloc_track_print_report
+ *
+ *   Input:      packets      Packets read, to report allocations per packet
+ *
+ *   Return:     None
+ *
+ *   Description:            Prints allocations, frees, bytes, live and peak live bytes of
+ *                           every subsystem on stderr.
+ ******************************************************************************/
+void alloc_track_print_report(uint64_t packets)
+{
+    uint64_t allocs = 0;
+    uint64_t all_allocs = 0;
+    uint32_t i = 0;
+
+    fprintf(stderr, "%-16s %14s %14s %16s %14s %14s %12s\n", "allocation site", "allocs", "frees",
+            "bytes", "live bytes", "peak bytes", "per packet");
+
+    for (i = 0; i < ALLOC_SITES; i++)
+    {
+        allocs = atomic_load(&site_counters[i].allocs);
+        all_allocs += allocs;
+        fprintf(stderr,
+                "%-16s %14" PRIu64 " %14" PRIu64 " %16" PRIu64 " %14" PRId64 " %14" PRId64
+                " %12.3f\n",
+                site_names[i], allocs, (uint64_t)atomic_load(&site_counters[i].frees),
+                (uint64_t)atomic_load(&site_counters[i].bytes),
+                (int64_t)atomic_load(&site_counters[i].live_bytes),
+                (int64_t)atomic_load(&site_counters[i].peak_bytes),
+                (packets != 0) ? (double)allocs / (double)packets : 0.0);
+    }
+
+    fprintf(stderr,
+            "%" PRIu64 " allocations for %" PRIu64 " packets, %.3f per packet, peak %" PRId64
+            " live bytes\n",
+            all_allocs, packets, (packets != 0) ? (double)all_allocs / (double)packets : 0.0,
+            (int64_t)atomic_load(&total_peak_bytes));
+}
+
+#endif /* ALLOC_TRACK */
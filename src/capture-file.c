@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "capture-file.h"
+
+/*****************************************************************************
+ *
+ *   Name:       capture_file_create
+ *
+ *   Input:      file_path    Wireshark hex dump or pcap capture
+ *               direct       Read pcap captures with O_DIRECT where supported
+ *
+ *   Return:     Success      A pointer to the new capture_file_t
+ *               Failed       NULL
+ *
+ *   Description:            Opens a capture with the reader matching its format. pcap
+ *                           files are recognized by their magic number.
+ ******************************************************************************/
+capture_file_t *capture_file_create(const char *file_path, bool direct)
+{
+    capture_file_t *capture = NULL;
+
+    if (file_path == NULL)
+    {
+        return NULL;
+    }
+
+    capture = (capture_file_t *)calloc(1, sizeof(capture_file_t));
+
+    if (capture == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for capture_file_t\n");
+
+        return NULL;
+    }
+
+    if (pcap_file_probe(file_path))
+    {
+        capture->pcap_file = pcap_file_create(file_path, direct);
+    }
+    else
+    {
+        capture->ws_file = wireshark_file_create(file_path);
+    }
+
+    if (capture->pcap_file == NULL && capture->ws_file == NULL)
+    {
+        free(capture);
+        capture = NULL;
+    }
+
+    return capture;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       capture_file_seek
+ *
+ *   Input:      capture      Capture file
+ *               offset       Offset of a packet, see wireshark_file_packet_start
+ *
+ *   Return:     Success      true
+ *               Failed       false for a pcap capture and an offset other than 0
+ *
+ *   Description:            Moves to the packet at offset. pcap records are only found
+ *                           by reading the ones before, so pcap captures are read whole.
+ ******************************************************************************/
+bool capture_file_seek(capture_file_t *capture, long offset)
+{
+    if (capture == NULL)
+    {
+        return false;
+    }
+
+    if (capture->pcap_file != NULL)
+    {
+        return offset == 0;
+    }
+
+    capture->ws_file->current_pos = offset;
+
+    return true;
+}
+
+bool capture_file_readable(capture_file_t *capture)
+{
+    if (capture == NULL)
+    {
+        return false;
+    }
+
+    return (capture->pcap_file != NULL) ? pcap_file_readable(capture->pcap_file)
+                                        : wireshark_file_readable(capture->ws_file);
+}
+
+long capture_file_position(const capture_file_t *capture)
+{
+    if (capture == NULL)
+    {
+        return 0;
+    }
+
+    return (capture->pcap_file != NULL) ? capture->pcap_file->current_pos
+                                        : capture->ws_file->current_pos;
+}
+
+bool capture_file_read_packet(capture_file_t *capture, dynamic_buffer_t *buffer)
+{
+    if (capture == NULL)
+    {
+        return false;
+    }
+
+    return (capture->pcap_file != NULL) ? pcap_file_read_packet(capture->pcap_file, buffer)
+                                        : wireshark_file_read_packet(capture->ws_file, buffer);
+}
+
+dynamic_buffer_t *capture_file_get_next_packet(capture_file_t *capture)
+{
+    if (capture == NULL)
+    {
+        return NULL;
+    }
+
+    return (capture->pcap_file != NULL) ? pcap_file_get_next_packet(capture->pcap_file)
+                                        : wireshark_file_get_next_packet(capture->ws_file);
+}
+
+void capture_file_free(capture_file_t **capture_p)
+{
+    if (capture_p == NULL || (*capture_p) == NULL)
+    {
+        return;
+    }
+
+    pcap_file_free(&(*capture_p)->pcap_file);
+    wireshark_file_free(&(*capture_p)->ws_file);
+
+    free((*capture_p));
+    (*capture_p) = NULL;
+
+    return;
+}
@@ -0,0 +1,681 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <glob.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "capture-file.h"
+#include "capture-ingest.h"
+#include "debug.h"
+#include "ingest-chunked.h"
+#include "ingest-pipeline.h"
+#include "instrument.h"
+#include "output-buffer.h"
+#include "packet-arena.h"
+#include "udp-packet.h"
+
+#define GLOB_CHARACTERS "*?["
+#define STAT_OK 0
+
+typedef struct ingest_worker
+{
+    pthread_t thread;
+    unsigned index;                /* position of the worker CPU in config->cpus */
+    const ingest_config_t *config;
+    char *const *paths;       /* all files of the run */
+    size_t path_count;        /* number of files of the run */
+    atomic_size_t *next_path; /* index of the next file nobody has claimed yet */
+    ingest_stats_t *stats;    /* per file statistics, indexed like paths */
+    packet_counter_t *counter;
+    hhh_t *hhh;
+    bool success;
+} ingest_worker_t;
+
+static bool ingest_append_path(char ***paths_p, size_t *count_p, size_t *capacity_p,
+                               const char *path)
+{
+    char **new_paths = NULL;
+    size_t new_capacity = 0;
+
+    if (*count_p == *capacity_p)
+    {
+        new_capacity = (*capacity_p == 0) ? 8 : *capacity_p * 2;
+        new_paths = (char **)realloc(*paths_p, new_capacity * sizeof(char *));
+
+        if (new_paths == NULL)
+        {
+            return false;
+        }
+
+        *paths_p = new_paths;
+        *capacity_p = new_capacity;
+    }
+
+    (*paths_p)[*count_p] = strdup(path);
+
+    if ((*paths_p)[*count_p] == NULL)
+    {
+        return false;
+    }
+
+    (*count_p)++;
+
+    return true;
+}
+
+static int ingest_directory_filter(const struct dirent *entry)
+{
+    return entry->d_name[0] != '.';
+}
+
+static bool ingest_append_directory(char ***paths_p, size_t *count_p, size_t *capacity_p,
+                                    const char *directory)
+{
+    struct dirent **entries = NULL;
+    struct stat entry_stat;
+    char *path = NULL;
+    int entry_count = 0;
+    int i = 0;
+    bool success = true;
+
+    entry_count = scandir(directory, &entries, ingest_directory_filter, alphasort);
+
+    if (entry_count < 0)
+    {
+        fprintf(stderr, "Unable to read directory: %s\n", directory);
+
+        return false;
+    }
+
+    for (i = 0; i < entry_count; i++)
+    {
+        if (success && asprintf(&path, "%s/%s", directory, entries[i]->d_name) >= 0)
+        {
+            if (stat(path, &entry_stat) == STAT_OK && S_ISREG(entry_stat.st_mode))
+            {
+                success = ingest_append_path(paths_p, count_p, capacity_p, path);
+            }
+
+            free(path);
+            path = NULL;
+        }
+
+        free(entries[i]);
+    }
+
+    free(entries);
+    entries = NULL;
+
+    return success;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_expand_paths
+ *
+ *   Input:      args         Command line arguments naming files, directories or globs
+ *               arg_count    Number of arguments
+ *   Output:     paths_p      Newly allocated array of capture file paths
+ *               count_p      Number of capture file paths
+ *
+ *   Return:     Success      true
+ *               Failed       false if an argument does not name any file
+ *
+ *   Description:            Directories are expanded to their regular files in name order
+ *                           and patterns that the shell did not expand are globbed here.
+ *                           The result is freed with ingest_free_paths.
+ ******************************************************************************/
+bool ingest_expand_paths(char *const *args, size_t arg_count, char ***paths_p, size_t *count_p)
+{
+    size_t i = 0;
+    size_t j = 0;
+    size_t capacity = 0;
+    struct stat arg_stat;
+    glob_t glob_result;
+    bool success = true;
+
+    if (args == NULL || paths_p == NULL || count_p == NULL)
+    {
+        return false;
+    }
+
+    *paths_p = NULL;
+    *count_p = 0;
+
+    for (i = 0; i < arg_count && success; i++)
+    {
+        if (stat(args[i], &arg_stat) == STAT_OK)
+        {
+            if (S_ISDIR(arg_stat.st_mode))
+            {
+                success = ingest_append_directory(paths_p, count_p, &capacity, args[i]);
+            }
+            else
+            {
+                success = ingest_append_path(paths_p, count_p, &capacity, args[i]);
+            }
+        }
+        else if (strpbrk(args[i], GLOB_CHARACTERS) != NULL &&
+                 glob(args[i], 0, NULL, &glob_result) == 0)
+        {
+            for (j = 0; j < glob_result.gl_pathc && success; j++)
+            {
+                success = ingest_append_path(paths_p, count_p, &capacity,
+                                             glob_result.gl_pathv[j]);
+            }
+
+            globfree(&glob_result);
+        }
+        else
+        {
+            fprintf(stderr, "File does not exist: %s\n", args[i]);
+            success = false;
+        }
+    }
+
+    if (success && *count_p == 0)
+    {
+        fprintf(stderr, "No capture files found.\n");
+        success = false;
+    }
+
+    if (!success)
+    {
+        ingest_free_paths(paths_p, *count_p);
+        *count_p = 0;
+    }
+
+    return success;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_free_paths
+ *
+ *   Input:      paths_p      A pointer to the array returned by ingest_expand_paths
+ *               count        Number of paths in the array
+ *
+ *   Return:     None
+ *
+ *   Description:            Frees the paths and the array, and sets the array to NULL.
+ ******************************************************************************/
+void ingest_free_paths(char ***paths_p, size_t count)
+{
+    size_t i = 0;
+
+    if (paths_p == NULL || *paths_p == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        free((*paths_p)[i]);
+        (*paths_p)[i] = NULL;
+    }
+
+    free(*paths_p);
+    *paths_p = NULL;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_total_bytes
+ *
+ *   Input:      paths        Capture file paths
+ *               count        Number of paths
+ *
+ *   Return:     Sum of the file sizes, files that cannot be read count as empty
+ *
+ *   Description:            Used to estimate how much of the input is left.
+ ******************************************************************************/
+uint64_t ingest_total_bytes(char *const *paths, size_t count)
+{
+    struct stat path_stat;
+    uint64_t total = 0;
+    size_t i = 0;
+
+    for (i = 0; paths != NULL && i < count; i++)
+    {
+        if (stat(paths[i], &path_stat) == STAT_OK)
+        {
+            total += (uint64_t)path_stat.st_size;
+        }
+    }
+
+    return total;
+}
+
+static void ingest_flush_batch(packet_counter_t *counter, ipv4_datagram_t **batch,
+                               size_t *batch_size, packet_arena_t *arena)
+{
+    packet_counter_increase_many(counter, batch, *batch_size);
+    *batch_size = 0;
+    packet_arena_reset(arena); /* the batch and the packets skipped since the last one */
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_invalid_reason
+ *
+ *   Input:      frame        Decoded frame of the packet, can be NULL
+ *               datagram     Decoded datagram of the frame, can be NULL
+ *
+ *   Return:     Why the packet is not a valid IPv4 UDP packet
+ *
+ *   Description:            Classifies a packet that was not counted, for the metrics.
+ ******************************************************************************/
+ingest_invalid_reason_t ingest_invalid_reason(const ethernet_frame_t *frame,
+                                              const ipv4_datagram_t *datagram)
+{
+    if (frame == NULL || frame->header == NULL)
+    {
+        return INGEST_INVALID_ETHERNET;
+    }
+
+    if (datagram == NULL)
+    {
+        return (frame->header->ethertype != ETHERTYPE_IPV4) ? INGEST_INVALID_NON_IPV4
+                                                            : INGEST_INVALID_IPV4_MALFORMED;
+    }
+
+    return INGEST_INVALID_NON_UDP;
+}
+
+static uint64_t ingest_counter_flows(const packet_counter_t *counter)
+{
+    return counter->flow_count - counter->holes;
+}
+
+static void ingest_publish_metrics(const ingest_config_t *config, ingest_metrics_delta_t *delta,
+                                   const packet_counter_t *counter, long *published_pos,
+                                   long current_pos)
+{
+    delta->bytes_read = (uint64_t)(current_pos - *published_pos);
+    *published_pos = current_pos;
+    ingest_metrics_publish(config->metrics, delta, ingest_counter_flows(counter),
+                           counter->index->capacity);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_file_range
+ *
+ *   Input:      file_path    Wireshark hex dump or pcap capture to read
+ *               start        Offset of the first packet to read, a packet boundary. pcap
+ *                            captures can only be read from 0
+ *               end          Packets starting at or after this offset are left out,
+ *                            INGEST_RANGE_END_OF_FILE to read to the end
+ *               config       Ingest options, verbose and metrics are used here
+ *               counter      Counter receiving valid IPv4 UDP packets
+ *               hhh          Heavy hitter detector to update, can be NULL
+ *   Output:     stats        Packets read and counted from the range
+ *
+ *   Return:     Success      true
+ *               Failed       false if the file could not be opened
+ *
+ *   Description:            Decodes every packet starting in the range and counts the
+ *                           valid ones. Bounds are found with wireshark_file_packet_start.
+ ******************************************************************************/
+bool ingest_file_range(const char *file_path, long start, long end, const ingest_config_t *config,
+                       packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats)
+{
+    capture_file_t *capture = NULL;
+    dynamic_buffer_t *buf = NULL;
+    ethernet_frame_t *frame = NULL;
+    ipv4_datagram_t *datagram = NULL;
+    ipv4_datagram_t *batch[PACKET_COUNTER_BATCH_SIZE] = {0};
+    size_t batch_size = 0;
+    packet_arena_t *arena = NULL;
+    output_buffer_t *out = NULL;
+    ingest_metrics_delta_t delta = {0};
+    long published_pos = 0;
+    bool valid = false;
+#ifdef DEBUG
+    udp_packet_t *packet = NULL;
+#endif
+
+    if (file_path == NULL || config == NULL || counter == NULL || stats == NULL || start < 0)
+    {
+        return false;
+    }
+
+    capture = capture_file_create(file_path, config->direct_io); /* hex dump or pcap reader */
+
+    if (capture == NULL)
+    {
+        return false;
+    }
+
+    if (!capture_file_seek(capture, start))
+    {
+        fprintf(stderr, "Unable to read %s from offset %ld.\n", file_path, start);
+        capture_file_free(&capture);
+
+        return false;
+    }
+
+    arena = packet_arena_create(0); /* decoded packets live until their batch is counted */
+    buf = dynamic_buffer_create(DYNAMIC_BUFFER_INLINE_SIZE); /* reused for every packet */
+
+    if (arena == NULL || buf == NULL)
+    {
+        packet_arena_free(&arena);
+        dynamic_buffer_free(&buf);
+        capture_file_free(&capture);
+
+        return false;
+    }
+
+    published_pos = start;
+
+    /* Table gauges are published as changes, the counter as it is now was already published */
+    delta.flows = ingest_counter_flows(counter);
+    delta.table_capacity = counter->index->capacity;
+
+    if (config->verbose)
+    {
+        /* Per packet lines are collected and written in large chunks, not printf per line */
+        out = output_buffer_create(stdout, OUTPUT_BUFFER_DEFAULT_SIZE);
+
+        if (out == NULL)
+        {
+            fprintf(stderr, "Unable to allocate output buffer, per packet lines disabled.\n");
+        }
+    }
+
+    while (capture_file_readable(capture) &&
+           (end == INGEST_RANGE_END_OF_FILE || capture_file_position(capture) < end))
+    {
+        stats->packet_total++;
+
+        if (out != NULL)
+        {
+            output_buffer_puts(out, "Packet ");
+            output_buffer_put_u64(out, stats->packet_total);
+            output_buffer_putc(out, '\n');
+#ifdef DEBUG
+            output_buffer_flush(out); /* packet details are printed with printf */
+#endif
+        }
+
+        valid = capture_file_read_packet(capture, buf);
+        instrument_start(ethernet_start);
+        frame = valid ? ethernet_frame_from_dynamic_buffer_arena(buf, arena) : NULL;
+        instrument_stop(INSTRUMENT_ETHERNET, ethernet_start);
+        if_debug_call(print_ethernet, frame, false);
+        instrument_start(ipv4_start);
+        datagram = ipv4_datagram_from_ethernet_frame_arena(frame, arena);
+        instrument_stop(INSTRUMENT_IPV4, ipv4_start);
+        if_debug_call(print_ipv4, datagram, false);
+        valid = (datagram != NULL && datagram->header->protocol == IPV4_PROTOCOL_UDP);
+
+        if (!valid)
+        {
+            delta.invalid[ingest_invalid_reason(frame, datagram)]++;
+        }
+
+        frame = NULL;
+
+        if (valid)
+        {
+            stats->packet_valid++;
+            delta.packets_valid++;
+            hhh_update(hhh, &datagram->header->source_address,
+                       &datagram->header->destination_address);
+#ifdef DEBUG
+            packet = udp_packet_from_ipv4_datagram_arena(datagram, arena);
+            print_udp(packet, true);
+            packet = NULL;
+#else
+            output_buffer_puts(out, "  Packet valid, counted\n");
+#endif
+        }
+        else
+        {
+            output_buffer_puts(out, "  Packet invalid, ignored\n");
+        }
+
+        output_buffer_putc(out, '\n');
+
+        if (valid)
+        {
+            /* Valid datagrams are counted in batches so that flow lookups can be prefetched */
+            batch[batch_size++] = datagram;
+        }
+
+        datagram = NULL;
+
+        /* Counting early keeps the arena in its first block when many packets are skipped */
+        if (batch_size == PACKET_COUNTER_BATCH_SIZE || arena->current != arena->first)
+        {
+            ingest_flush_batch(counter, batch, &batch_size, arena);
+        }
+
+        if (config->metrics != NULL && ++delta.packets_read == INGEST_METRICS_PUBLISH_PACKETS)
+        {
+            ingest_publish_metrics(config, &delta, counter, &published_pos,
+                                   capture_file_position(capture));
+        }
+    }
+
+    ingest_flush_batch(counter, batch, &batch_size, arena);
+
+    if (config->metrics != NULL)
+    {
+        ingest_publish_metrics(config, &delta, counter, &published_pos,
+                               capture_file_position(capture));
+    }
+
+    output_buffer_free(&out);
+    packet_arena_free(&arena);
+    dynamic_buffer_free(&buf);
+    capture_file_free(&capture);
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_file
+ *
+ *   Input:      file_path    Wireshark capture file to read
+ *               config       Ingest options, verbose and metrics are used here
+ *               counter      Counter receiving valid IPv4 UDP packets
+ *               hhh          Heavy hitter detector to update, can be NULL
+ *   Output:     stats        Packets read and counted from the file
+ *
+ *   Return:     Success      true
+ *               Failed       false if the file could not be opened
+ *
+ *   Description:            Decodes every packet of the file and counts the valid ones.
+ ******************************************************************************/
+bool ingest_file(const char *file_path, const ingest_config_t *config, packet_counter_t *counter,
+                 hhh_t *hhh, ingest_stats_t *stats)
+{
+    return ingest_file_range(file_path, 0, INGEST_RANGE_END_OF_FILE, config, counter, hhh, stats);
+}
+
+static void *ingest_worker_run(void *arg)
+{
+    ingest_worker_t *worker = (ingest_worker_t *)arg;
+    ingest_metrics_delta_t delta = {0};
+    size_t index = 0;
+
+    worker->success = true;
+    cpu_affinity_pin(worker->config->cpus, worker->index);
+    ingest_metrics_publish(worker->config->metrics, &delta, ingest_counter_flows(worker->counter),
+                           worker->counter->index->capacity);
+
+    /* Files are claimed one at a time so that a few large files do not leave workers idle */
+    while ((index = atomic_fetch_add(worker->next_path, 1)) < worker->path_count)
+    {
+        if (worker->config->decoders != 0)
+        {
+            worker->success = ingest_pipeline_file(worker->paths[index], worker->config,
+                                                   worker->counter, worker->hhh,
+                                                   &worker->stats[index]) &&
+                              worker->success;
+        }
+        else if (!ingest_file(worker->paths[index], worker->config, worker->counter, worker->hhh,
+                              &worker->stats[index]))
+        {
+            worker->success = false;
+        }
+    }
+
+    instrument_thread_done();
+
+    return NULL;
+}
+
+static void ingest_worker_destroy(ingest_worker_t *worker, packet_counter_t *counter)
+{
+    if (worker->counter != counter)
+    {
+        packet_counter_free(&worker->counter);
+        hhh_free(&worker->hhh);
+    }
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_files
+ *
+ *   Input:      paths        Wireshark capture files to read
+ *               count        Number of files
+ *               config       Ingest options
+ *               counter      Counter receiving the merged counts of all files
+ *               hhh          Detector receiving the merged heavy hitters, can be NULL
+ *   Output:     stats        Per file statistics, an array of count elements
+ *
+ *   Return:     Success      true
+ *               Failed       false if a file could not be read or a worker not started
+ *
+ *   Description:            Spreads the files over worker threads. Every worker counts
+ *                           into its own packet_counter_t, and the worker counters are
+ *                           merged into counter once all files are done. In pipeline
+ *                           mode the files are read one after another, each by
+ *                           ingest_pipeline_file. With a chunk size the files are split
+ *                           into packet ranges instead, see ingest_chunked_files.
+ ******************************************************************************/
+bool ingest_files(char *const *paths, size_t count, const ingest_config_t *config,
+                  packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats)
+{
+    ingest_worker_t *workers = NULL;
+    atomic_size_t next_path;
+    size_t worker_count = 0;
+    size_t started = 0;
+    size_t i = 0;
+    bool success = true;
+
+    if (paths == NULL || count == 0 || config == NULL || counter == NULL || stats == NULL)
+    {
+        return false;
+    }
+
+    if (config->chunk_size != 0 && config->decoders == 0)
+    {
+        return ingest_chunked_files(paths, count, config, counter, hhh, stats);
+    }
+
+    worker_count = (config->jobs != 0) ? config->jobs : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = (worker_count > count) ? count : worker_count;
+    worker_count = (config->decoders != 0) ? 1 : worker_count; /* the pipeline has its threads */
+    worker_count = (worker_count == 0) ? 1 : worker_count;
+
+    workers = (ingest_worker_t *)calloc(worker_count, sizeof(ingest_worker_t));
+
+    if (workers == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for ingest workers.\n");
+
+        return false;
+    }
+
+    atomic_init(&next_path, 0);
+
+    for (i = 0; i < worker_count; i++)
+    {
+        workers[i].index = (unsigned)i;
+        workers[i].config = config;
+        workers[i].paths = paths;
+        workers[i].path_count = count;
+        workers[i].next_path = &next_path;
+        workers[i].stats = stats;
+
+        if (worker_count == 1)
+        {
+            /* A single worker counts straight into the result, nothing to merge */
+            workers[i].counter = counter;
+            workers[i].hhh = hhh;
+            continue;
+        }
+
+        workers[i].counter = packet_counter_create();
+        workers[i].hhh = (hhh != NULL) ? hhh_create(HHH_DEFAULT_COUNTERS) : NULL;
+
+        if (workers[i].counter == NULL || (hhh != NULL && workers[i].hhh == NULL))
+        {
+            fprintf(stderr, "Unable to create counter for ingest worker.\n");
+            success = false;
+            worker_count = i + 1;
+            break;
+        }
+
+        /* The flow limit is shared by the workers, each keeps its part of it */
+        packet_counter_set_limit(workers[i].counter,
+                                 (config->max_entries + worker_count - 1) / worker_count,
+                                 config->overflow_sink, config->overflow_context);
+    }
+
+    if (success && worker_count == 1)
+    {
+        ingest_worker_run(&workers[0]);
+        success = workers[0].success;
+    }
+    else if (success)
+    {
+        for (started = 0; started < worker_count; started++)
+        {
+            if (pthread_create(&workers[started].thread, NULL, ingest_worker_run,
+                               &workers[started]) != 0)
+            {
+                fprintf(stderr, "Unable to start ingest worker.\n");
+                success = false;
+                break;
+            }
+        }
+
+        /* Workers that did start still drain the remaining files */
+        for (i = 0; i < started; i++)
+        {
+            pthread_join(workers[i].thread, NULL);
+            success = success && workers[i].success;
+            packet_counter_merge(counter, workers[i].counter);
+            hhh_merge(hhh, workers[i].hhh);
+        }
+
+        ingest_metrics_set_table(config->metrics, ingest_counter_flows(counter),
+                                 counter->index->capacity);
+    }
+
+    for (i = 0; i < worker_count; i++)
+    {
+        ingest_worker_destroy(&workers[i], counter);
+    }
+
+    free(workers);
+    workers = NULL;
+
+    return success;
+}
@@ -22,4 +22,11 @@ void print_data_f(uint8_t *data, size_t data_len)
     }
 
     printf("\n");
-}
\ No newline at end of file
+}
+
+/* Seconds elapsed from start to end, both read from the same clock */
+double timespec_seconds_between(const struct timespec *start, const struct timespec *end)
+{
+    return (double)(end->tv_sec - start->tv_sec) +
+           (double)(end->tv_nsec - start->tv_nsec) / NANOSECONDS_PER_SECOND;
+}
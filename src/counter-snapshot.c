@@ -0,0 +1,627 @@
+#include <endian.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "counter-snapshot.h"
+
+#define VARINT_MAX_LENGTH 10 /* ceil(64 / 7) */
+#define VARINT_PAYLOAD_BITS 7
+#define VARINT_PAYLOAD_MASK 0x7F
+#define VARINT_CONTINUE 0x80
+#define VARINT_LAST_PAYLOAD_MAX 0x01 /* the 10th byte holds only bit 63 */
+
+#define SNAPSHOT_WRITE_BUFFER_SIZE (1 << 20)
+#define FSEEK_OK 0
+
+typedef struct snapshot_record
+{
+    uint8_t key[COUNTER_SNAPSHOT_KEY_LENGTH];
+    uint64_t count;
+} snapshot_record_t;
+
+typedef struct snapshot_writer
+{
+    FILE *file;
+    uint64_t flow_count;
+    uint64_t packet_count;
+} snapshot_writer_t;
+
+typedef struct merge_cursor
+{
+    counter_snapshot_t *snapshot;
+    snapshot_record_t record;
+} merge_cursor_t;
+
+static size_t varint_encode(uint64_t value, uint8_t *out)
+{
+    size_t length = 0;
+
+    while (value > VARINT_PAYLOAD_MASK)
+    {
+        out[length++] = (uint8_t)(value & VARINT_PAYLOAD_MASK) | VARINT_CONTINUE;
+        value >>= VARINT_PAYLOAD_BITS;
+    }
+
+    out[length++] = (uint8_t)value;
+
+    return length;
+}
+
+/* Returns the number of bytes consumed, 0 if the varint is truncated, too long or over 64 bits */
+static size_t varint_decode(const uint8_t *data, size_t available, uint64_t *value)
+{
+    size_t i = 0;
+    uint64_t result = 0;
+
+    for (i = 0; i < available && i < VARINT_MAX_LENGTH; i++)
+    {
+        if (i == VARINT_MAX_LENGTH - 1 && (data[i] & VARINT_PAYLOAD_MASK) > VARINT_LAST_PAYLOAD_MAX)
+        {
+            return 0;
+        }
+
+        result |= (uint64_t)(data[i] & VARINT_PAYLOAD_MASK) << (i * VARINT_PAYLOAD_BITS);
+
+        if ((data[i] & VARINT_CONTINUE) == 0)
+        {
+            *value = result;
+
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+static int snapshot_record_compare(const void *a, const void *b)
+{
+    return memcmp(((const snapshot_record_t *)a)->key, ((const snapshot_record_t *)b)->key,
+                  COUNTER_SNAPSHOT_KEY_LENGTH);
+}
+
+static bool snapshot_writer_put_header(snapshot_writer_t *writer)
+{
+    counter_snapshot_header_t header;
+
+    memcpy(header.magic, COUNTER_SNAPSHOT_MAGIC, COUNTER_SNAPSHOT_MAGIC_LENGTH);
+    header.version = htole32(COUNTER_SNAPSHOT_VERSION);
+    header.key_length = htole32(COUNTER_SNAPSHOT_KEY_LENGTH);
+    header.flow_count = htole64(writer->flow_count);
+    header.packet_count = htole64(writer->packet_count);
+
+    return fwrite(&header, sizeof(header), 1, writer->file) == 1;
+}
+
+static bool snapshot_writer_open(snapshot_writer_t *writer, const char *file_path)
+{
+    writer->flow_count = 0;
+    writer->packet_count = 0;
+    writer->file = fopen(file_path, "wb");
+
+    if (writer->file == NULL)
+    {
+        fprintf(stderr, "Error opening file for writing: %s\n", file_path);
+
+        return false;
+    }
+
+    setvbuf(writer->file, NULL, _IOFBF, SNAPSHOT_WRITE_BUFFER_SIZE);
+
+    /* Counts are not known yet, the header is rewritten when the writer is closed */
+    return snapshot_writer_put_header(writer);
+}
+
+static bool snapshot_writer_put(snapshot_writer_t *writer, const snapshot_record_t *record)
+{
+    uint8_t varint[VARINT_MAX_LENGTH] = {0};
+    size_t varint_length = 0;
+
+    varint_length = varint_encode(record->count, varint);
+    writer->flow_count++;
+    writer->packet_count += record->count;
+
+    return fwrite(record->key, COUNTER_SNAPSHOT_KEY_LENGTH, 1, writer->file) == 1 &&
+           fwrite(varint, varint_length, 1, writer->file) == 1;
+}
+
+static bool snapshot_writer_close(snapshot_writer_t *writer, bool success)
+{
+    if (writer->file == NULL)
+    {
+        return false;
+    }
+
+    success = success && fseek(writer->file, 0, SEEK_SET) == FSEEK_OK &&
+              snapshot_writer_put_header(writer);
+    success = (fclose(writer->file) == 0) && success;
+    writer->file = NULL;
+
+    return success;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       counter_snapshot_write
+ *
+ *   Input:      counter      Counter to dump
+ *               file_path    Path of the snapshot file to create
+ *
+ *   Return:     Success      true
+ *               Failed       false
+ *
+ *   Description:            Writes all flows of the counter to a snapshot file, sorted by
+ *                           key so that snapshots can be merged in a single pass.
+ ******************************************************************************/
+bool counter_snapshot_write(packet_counter_t *counter, const char *file_path)
+{
+    snapshot_writer_t writer = {0};
+    snapshot_record_t *records = NULL;
+    uint64_t record_count = 0;
+    uint64_t i = 0;
+    bool success = false;
+
+    if (counter == NULL || counter->index == NULL || file_path == NULL)
+    {
+        return false;
+    }
+
+    records = (snapshot_record_t *)calloc(counter->index->size + 1, sizeof(snapshot_record_t));
+
+    if (records == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for snapshot records.\n");
+
+        return false;
+    }
+
+    for (i = 0; i < counter->flow_count; i++)
+    {
+        if (counter->flows[i].ref_counter == 0)
+        {
+            continue; /* evicted */
+        }
+
+        memcpy(records[record_count].key, &counter->flows[i].src, sizeof(ip_addr_t));
+        memcpy(records[record_count].key + sizeof(ip_addr_t), &counter->flows[i].dest,
+               sizeof(ip_addr_t));
+        records[record_count].count = counter->flows[i].ref_counter;
+        record_count++;
+    }
+
+    qsort(records, record_count, sizeof(snapshot_record_t), snapshot_record_compare);
+
+    success = snapshot_writer_open(&writer, file_path);
+
+    for (i = 0; i < record_count && success; i++)
+    {
+        success = snapshot_writer_put(&writer, &records[i]);
+    }
+
+    success = snapshot_writer_close(&writer, success);
+
+    if (!success)
+    {
+        fprintf(stderr, "Failed to write snapshot: %s\n", file_path);
+    }
+
+    free(records);
+    records = NULL;
+
+    return success;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       counter_snapshot_open
+ *
+ *   Input:      file_path    Path of the snapshot file
+ *
+ *   Return:     Success      A pointer to a snapshot positioned at its first record
+ *               Failed       NULL if the file can not be mapped or is not a snapshot
+ *
+ *   Description:            Maps a snapshot file read only. Records are decoded straight
+ *                           from the mapping by counter_snapshot_next.
+ ******************************************************************************/
+counter_snapshot_t *counter_snapshot_open(const char *file_path)
+{
+    counter_snapshot_t *snapshot = NULL;
+    counter_snapshot_header_t header;
+    struct stat file_stat;
+    void *map = MAP_FAILED;
+    int fd = -1;
+
+    if (file_path == NULL)
+    {
+        return NULL;
+    }
+
+    fd = open(file_path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &file_stat) != 0)
+    {
+        fprintf(stderr, "Error opening file for reading: %s\n", file_path);
+        goto cleanup;
+    }
+
+    if ((size_t)file_stat.st_size < sizeof(counter_snapshot_header_t))
+    {
+        fprintf(stderr, "File is too small to be a snapshot: %s\n", file_path);
+        goto cleanup;
+    }
+
+    map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map snapshot: %s\n", file_path);
+        goto cleanup;
+    }
+
+    madvise(map, file_stat.st_size, MADV_SEQUENTIAL);
+    memcpy(&header, map, sizeof(header));
+
+    if (memcmp(header.magic, COUNTER_SNAPSHOT_MAGIC, COUNTER_SNAPSHOT_MAGIC_LENGTH) != 0 ||
+        le32toh(header.version) != COUNTER_SNAPSHOT_VERSION ||
+        le32toh(header.key_length) != COUNTER_SNAPSHOT_KEY_LENGTH)
+    {
+        fprintf(stderr, "Unsupported snapshot format: %s\n", file_path);
+        goto cleanup;
+    }
+
+    snapshot = (counter_snapshot_t *)calloc(1, sizeof(counter_snapshot_t));
+
+    if (snapshot == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for snapshot.\n");
+        goto cleanup;
+    }
+
+    snapshot->file_path = strdup(file_path);
+
+    if (snapshot->file_path == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for file_path\n");
+        goto cleanup;
+    }
+
+    snapshot->map = (const uint8_t *)map;
+    snapshot->map_length = file_stat.st_size;
+    snapshot->position = sizeof(counter_snapshot_header_t);
+    snapshot->flow_count = le64toh(header.flow_count);
+    snapshot->packet_count = le64toh(header.packet_count);
+
+    close(fd);
+
+    return snapshot;
+
+cleanup:
+
+    if (snapshot != NULL)
+    {
+        free((void *)snapshot->file_path);
+        snapshot->file_path = NULL;
+    }
+
+    free(snapshot);
+    snapshot = NULL;
+
+    if (map != MAP_FAILED)
+    {
+        munmap(map, file_stat.st_size);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       counter_snapshot_next
+ *
+ *   Input:      snapshot     Snapshot to read from
+ *   Output:     src          Source address of the flow
+ *               dest         Destination address of the flow
+ *               count        Packet count of the flow
+ *
+ *   Return:     Success      true if a record was read
+ *               Failed       false at the end of the snapshot or on a corrupt record
+ *
+ *   Description:            Decodes the next record of the snapshot.
+ ******************************************************************************/
+bool counter_snapshot_next(counter_snapshot_t *snapshot, ip_addr_t *src, ip_addr_t *dest,
+                           uint64_t *count)
+{
+    size_t consumed = 0;
+    const uint8_t *record = NULL;
+
+    if (snapshot == NULL || src == NULL || dest == NULL || count == NULL ||
+        snapshot->flows_read >= snapshot->flow_count)
+    {
+        return false;
+    }
+
+    if (snapshot->map_length - snapshot->position < COUNTER_SNAPSHOT_KEY_LENGTH)
+    {
+        fprintf(stderr, "Snapshot is truncated: %s\n", snapshot->file_path);
+
+        return false;
+    }
+
+    record = snapshot->map + snapshot->position;
+    consumed = varint_decode(
+        record + COUNTER_SNAPSHOT_KEY_LENGTH,
+        snapshot->map_length - snapshot->position - COUNTER_SNAPSHOT_KEY_LENGTH, count);
+
+    if (consumed == 0)
+    {
+        fprintf(stderr, "Snapshot contains an invalid count: %s\n", snapshot->file_path);
+
+        return false;
+    }
+
+    memcpy(src, record, sizeof(ip_addr_t));
+    memcpy(dest, record + sizeof(ip_addr_t), sizeof(ip_addr_t));
+    snapshot->position += COUNTER_SNAPSHOT_KEY_LENGTH + consumed;
+    snapshot->flows_read++;
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       counter_snapshot_close
+ *
+ *   Input:      snapshot_p   A pointer to a pointer to the snapshot to close
+ *
+ *   Return:     None
+ *
+ *   Description:            Unmaps the snapshot and sets the pointer to NULL.
+ ******************************************************************************/
+void counter_snapshot_close(counter_snapshot_t **snapshot_p)
+{
+    if (snapshot_p == NULL || *snapshot_p == NULL)
+    {
+        return;
+    }
+
+    munmap((void *)(*snapshot_p)->map, (*snapshot_p)->map_length);
+    (*snapshot_p)->map = NULL;
+
+    free((void *)(*snapshot_p)->file_path);
+    (*snapshot_p)->file_path = NULL;
+
+    free(*snapshot_p);
+    *snapshot_p = NULL;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       counter_snapshot_load
+ *
+ *   Input:      file_path    Path of the snapshot file
+ *               counter      Counter receiving the flows
+ *
+ *   Return:     Success      true if every record was loaded
+ *               Failed       false
+ *
+ *   Description:            Adds all flows of a snapshot to the counter.
+ ******************************************************************************/
+bool counter_snapshot_load(const char *file_path, packet_counter_t *counter)
+{
+    counter_snapshot_t *snapshot = NULL;
+    ip_addr_t src;
+    ip_addr_t dest;
+    uint64_t count = 0;
+    bool success = false;
+
+    if (counter == NULL)
+    {
+        return false;
+    }
+
+    snapshot = counter_snapshot_open(file_path);
+
+    if (snapshot == NULL)
+    {
+        return false;
+    }
+
+    while (counter_snapshot_next(snapshot, &src, &dest, &count))
+    {
+        packet_counter_add(counter, &src, &dest, count);
+    }
+
+    success = snapshot->flows_read == snapshot->flow_count;
+    counter_snapshot_close(&snapshot);
+
+    return success;
+}
+
+/* True if both paths name the same existing file, also through links */
+static bool snapshot_same_file(const char *path, const char *other_path)
+{
+    struct stat path_stat;
+    struct stat other_stat;
+
+    if (stat(path, &path_stat) != 0 || stat(other_path, &other_stat) != 0)
+    {
+        return false;
+    }
+
+    return path_stat.st_dev == other_stat.st_dev && path_stat.st_ino == other_stat.st_ino;
+}
+
+static bool merge_cursor_advance(merge_cursor_t *cursor)
+{
+    ip_addr_t src;
+    ip_addr_t dest;
+
+    if (!counter_snapshot_next(cursor->snapshot, &src, &dest, &cursor->record.count))
+    {
+        return false;
+    }
+
+    memcpy(cursor->record.key, &src, sizeof(ip_addr_t));
+    memcpy(cursor->record.key + sizeof(ip_addr_t), &dest, sizeof(ip_addr_t));
+
+    return true;
+}
+
+static void merge_heap_sift_down(merge_cursor_t **heap, size_t heap_size, size_t pos)
+{
+    size_t child = 0;
+    merge_cursor_t *temp = NULL;
+
+    while ((child = pos * 2 + 1) < heap_size)
+    {
+        if (child + 1 < heap_size &&
+            snapshot_record_compare(&heap[child + 1]->record, &heap[child]->record) < 0)
+        {
+            child++;
+        }
+
+        if (snapshot_record_compare(&heap[pos]->record, &heap[child]->record) <= 0)
+        {
+            break;
+        }
+
+        temp = heap[pos];
+        heap[pos] = heap[child];
+        heap[child] = temp;
+        pos = child;
+    }
+}
+
+/*****************************************************************************
+ *
+ *   Name:       counter_snapshot_merge
+ *
+ *   Input:      input_paths  Snapshot files to merge
+ *               input_count  Number of input files
+ *               output_path  Snapshot file to create, counts of equal keys are summed
+ *
+ *   Return:     Success      true
+ *               Failed       false if an input could not be read or the output written
+ *
+ *   Description:            Streams a k-way merge of sorted snapshots through a min heap,
+ *                           so memory use is independent of the number of flows.
+ ******************************************************************************/
+bool counter_snapshot_merge(const char *const *input_paths, size_t input_count,
+                            const char *output_path)
+{
+    merge_cursor_t *cursors = NULL;
+    merge_cursor_t **heap = NULL;
+    size_t heap_size = 0;
+    size_t i = 0;
+    snapshot_writer_t writer = {0};
+    snapshot_record_t merged;
+    bool success = false;
+
+    if (input_paths == NULL || input_count == 0 || output_path == NULL)
+    {
+        return false;
+    }
+
+    /* The inputs stay mapped while the output is written, truncating one would fault */
+    for (i = 0; i < input_count; i++)
+    {
+        if (snapshot_same_file(input_paths[i], output_path))
+        {
+            fprintf(stderr, "Output snapshot %s is also an input.\n", output_path);
+
+            return false;
+        }
+    }
+
+    cursors = (merge_cursor_t *)calloc(input_count, sizeof(merge_cursor_t));
+    heap = (merge_cursor_t **)calloc(input_count, sizeof(merge_cursor_t *));
+
+    if (cursors == NULL || heap == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for snapshot merge.\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < input_count; i++)
+    {
+        cursors[i].snapshot = counter_snapshot_open(input_paths[i]);
+
+        if (cursors[i].snapshot == NULL)
+        {
+            goto cleanup;
+        }
+
+        if (merge_cursor_advance(&cursors[i]))
+        {
+            heap[heap_size++] = &cursors[i];
+        }
+    }
+
+    for (i = heap_size / 2; i-- > 0;)
+    {
+        merge_heap_sift_down(heap, heap_size, i);
+    }
+
+    success = snapshot_writer_open(&writer, output_path);
+
+    while (heap_size > 0 && success)
+    {
+        merged = heap[0]->record;
+
+        /* Sum every input holding the smallest key before writing it once */
+        while (heap_size > 0 && snapshot_record_compare(&heap[0]->record, &merged) == 0)
+        {
+            if (!merge_cursor_advance(heap[0]))
+            {
+                heap[0] = heap[--heap_size];
+            }
+
+            merge_heap_sift_down(heap, heap_size, 0);
+
+            if (heap_size > 0 && snapshot_record_compare(&heap[0]->record, &merged) == 0)
+            {
+                merged.count += heap[0]->record.count;
+            }
+        }
+
+        success = snapshot_writer_put(&writer, &merged);
+    }
+
+    for (i = 0; i < input_count && success; i++)
+    {
+        success = cursors[i].snapshot->flows_read == cursors[i].snapshot->flow_count;
+    }
+
+    success = snapshot_writer_close(&writer, success);
+
+    if (!success)
+    {
+        fprintf(stderr, "Failed to merge snapshots into %s\n", output_path);
+    }
+
+cleanup:
+
+    for (i = 0; cursors != NULL && i < input_count; i++)
+    {
+        counter_snapshot_close(&cursors[i].snapshot);
+    }
+
+    free(cursors);
+    cursors = NULL;
+
+    free(heap);
+    heap = NULL;
+
+    return success;
+}
@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <limits.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "cpu-affinity.h"
+
+#define NODE_ONLINE_PATH "/sys/devices/system/node/online"
+#define CPU_SYSFS_FORMAT "/sys/devices/system/cpu/cpu%u"
+#define NODE_ENTRY_PREFIX "node"
+#define NODE_ENTRY_PREFIX_LEN 4
+#define SYSFS_PATH_LEN 64
+#define SYSFS_LINE_LEN 256
+#define BITS_PER_LONG (sizeof(unsigned long) * CHAR_BIT)
+
+/*****************************************************************************
+ *
+ *   Name:       cpu_list_parse
+ *
+ *   Input:      str          CPU list like 0-3,8,10-11
+ *   Output:     list         The CPUs in the order given
+ *
+ *   Return:     Success      true
+ *               Failed       false for a malformed list or a CPU number that is too high
+ *
+ *   Description:            Parses the list format of taskset -c and of sysfs.
+ ******************************************************************************/
+bool cpu_list_parse(const char *str, cpu_list_t *list)
+{
+    char *endptr = NULL;
+    unsigned long first = 0;
+    unsigned long last = 0;
+
+    if (str == NULL || list == NULL)
+    {
+        return false;
+    }
+
+    list->count = 0;
+
+    while (*str != '\0' && *str != '\n')
+    {
+        first = strtoul(str, &endptr, 10);
+
+        if (endptr == str)
+        {
+            return false;
+        }
+
+        last = first;
+        str = endptr;
+
+        if (*str == '-')
+        {
+            last = strtoul(str + 1, &endptr, 10);
+
+            if (endptr == str + 1 || last < first)
+            {
+                return false;
+            }
+
+            str = endptr;
+        }
+
+        if (last >= CPU_AFFINITY_MAX_CPUS || list->count + (last - first) >= CPU_AFFINITY_MAX_CPUS)
+        {
+            return false;
+        }
+
+        while (first <= last)
+        {
+            list->cpus[list->count++] = (unsigned)first++;
+        }
+
+        if (*str == ',')
+        {
+            str++;
+        }
+        else if (*str != '\0' && *str != '\n')
+        {
+            return false;
+        }
+    }
+
+    return list->count != 0;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       cpu_affinity_node_of
+ *
+ *   Input:      cpu          CPU number
+ *
+ *   Return:     Success      NUMA node of the CPU
+ *               Failed       -1 if sysfs does not tell
+ *
+ *   Description:            Finds the node through the nodeN link in the sysfs directory
+ *                           of the CPU.
+ ******************************************************************************/
+int cpu_affinity_node_of(unsigned cpu)
+{
+    char path[SYSFS_PATH_LEN] = {0};
+    DIR *directory = NULL;
+    struct dirent *entry = NULL;
+    int node = -1;
+
+    snprintf(path, sizeof(path), CPU_SYSFS_FORMAT, cpu);
+    directory = opendir(path);
+
+    if (directory == NULL)
+    {
+        return -1;
+    }
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        if (strncmp(entry->d_name, NODE_ENTRY_PREFIX, NODE_ENTRY_PREFIX_LEN) == 0 &&
+            entry->d_name[NODE_ENTRY_PREFIX_LEN] >= '0' &&
+            entry->d_name[NODE_ENTRY_PREFIX_LEN] <= '9')
+        {
+            node = atoi(entry->d_name + NODE_ENTRY_PREFIX_LEN);
+            break;
+        }
+    }
+
+    closedir(directory);
+    directory = NULL;
+
+    return node;
+}
+
+/* Number of online NUMA nodes, 1 when the kernel has no NUMA support */
+unsigned cpu_affinity_node_count(void)
+{
+    FILE *file = NULL;
+    char line[SYSFS_LINE_LEN] = {0};
+    cpu_list_t *nodes = NULL;
+    unsigned count = 1;
+
+    file = fopen(NODE_ONLINE_PATH, "r");
+
+    if (file == NULL)
+    {
+        return 1;
+    }
+
+    nodes = (cpu_list_t *)malloc(sizeof(cpu_list_t));
+
+    /* The online node list has the same format as a CPU list */
+    if (nodes != NULL && fgets(line, sizeof(line), file) != NULL && cpu_list_parse(line, nodes))
+    {
+        count = nodes->count;
+    }
+
+    free(nodes);
+    nodes = NULL;
+    fclose(file);
+    file = NULL;
+
+    return count;
+}
+
+/* Allocations of the calling thread prefer the node, falling back to others when it is full */
+static bool cpu_affinity_prefer_node(int node)
+{
+    unsigned long mask[CPU_AFFINITY_MAX_NODES / BITS_PER_LONG] = {0};
+
+    if (node < 0 || node >= CPU_AFFINITY_MAX_NODES)
+    {
+        return false;
+    }
+
+    mask[node / BITS_PER_LONG] = 1UL << (node % BITS_PER_LONG);
+
+    /* The kernel counts one bit less than maxnode */
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, CPU_AFFINITY_MAX_NODES + 1) == 0;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       cpu_affinity_pin
+ *
+ *   Input:      list         CPUs to pin threads to, NULL to leave threads alone
+ *               index        Thread number, the thread is pinned to the CPU at this
+ *                            position, wrapping around
+ *
+ *   Return:     Success      true, also when list is NULL
+ *               Failed       false if the CPU is not available to the process
+ *
+ *   Description:            Pins the calling thread to one CPU. On machines with more
+ *                           than one NUMA node the memory the thread touches first is
+ *                           then taken from the node of that CPU, so counters and
+ *                           buffers a thread allocates and grows stay local to it.
+ *                           Single node machines only get the pinning.
+ ******************************************************************************/
+bool cpu_affinity_pin(const cpu_list_t *list, unsigned index)
+{
+    cpu_set_t set;
+    unsigned cpu = 0;
+
+    if (list == NULL || list->count == 0)
+    {
+        return true;
+    }
+
+    cpu = list->cpus[index % list->count];
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        fprintf(stderr, "Unable to pin thread to CPU %u.\n", cpu);
+
+        return false;
+    }
+
+    if (cpu_affinity_node_count() > 1 && !cpu_affinity_prefer_node(cpu_affinity_node_of(cpu)))
+    {
+        fprintf(stderr, "Unable to prefer the NUMA node of CPU %u.\n", cpu);
+    }
+
+    return true;
+}
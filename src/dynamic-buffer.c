@@ -2,8 +2,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc-track.h"
 #include "dynamic-buffer.h"
 
+static bool dynamic_buffer_is_inline(const dynamic_buffer_t *buf)
+{
+    return buf->inline_capacity != 0 && buf->data == buf->inline_data;
+}
+
 /*****************************************************************************
  *
  *   Name:       dynamic_buffer_create
@@ -12,7 +18,9 @@
  *   Return:     Success           A pointer to the newly created dynamic_buffer_t
  *               Failed            NULL
  *   Description:            Allocates and initializes a dynamic buffer with the
- *                           specified initial capacity.
+ *                           specified initial capacity. Up to DYNAMIC_BUFFER_INLINE_SIZE
+ *                           bytes are stored inline, so a typical packet needs a single
+ *                           allocation.
  ******************************************************************************/
 dynamic_buffer_t *dynamic_buffer_create(size_t initial_capacity)
 {
@@ -23,26 +31,27 @@ dynamic_buffer_t *dynamic_buffer_create(size_t initial_capacity)
         return NULL;
     }
 
-    buf = (dynamic_buffer_t *)calloc(1, sizeof(dynamic_buffer_t));
+    buf = (dynamic_buffer_t *)track_calloc(ALLOC_SITE_DYNAMIC_BUFFER, 1,
+                                           sizeof(dynamic_buffer_t) + DYNAMIC_BUFFER_INLINE_SIZE);
 
     if (buf == NULL)
     {
         return NULL;
     }
 
-    buf->data = (uint8_t *)calloc(initial_capacity, sizeof(uint8_t));
+    buf->inline_capacity = DYNAMIC_BUFFER_INLINE_SIZE;
+    buf->data = buf->inline_data;
+    buf->size = 0;
+    buf->capacity = buf->inline_capacity;
 
-    if (buf->data == NULL)
+    if (initial_capacity > buf->inline_capacity && !dynamic_buffer_resize(buf, initial_capacity))
     {
-        free(buf);
+        track_free(ALLOC_SITE_DYNAMIC_BUFFER, buf);
         buf = NULL;
 
         return NULL;
     }
 
-    buf->size = 0;
-    buf->capacity = initial_capacity;
-
     return buf;
 }
 
@@ -55,6 +64,8 @@ dynamic_buffer_t *dynamic_buffer_create(size_t initial_capacity)
  *   Return:     Success          true if the buffer was resized successfully
  *               Failed           false if the operation failed
  *   Description:            Resizes the dynamic buffer to the specified new capacity.
+ *                           Data beyond the new capacity is dropped. A capacity that
+ *                           fits the inline storage moves the data back there.
  ******************************************************************************/
 bool dynamic_buffer_resize(dynamic_buffer_t *buf, size_t new_capacity)
 {
@@ -65,7 +76,35 @@ bool dynamic_buffer_resize(dynamic_buffer_t *buf, size_t new_capacity)
         return false;
     }
 
-    new_data = (uint8_t *)realloc(buf->data, new_capacity);
+    buf->size = (buf->size > new_capacity) ? new_capacity : buf->size;
+
+    if (new_capacity <= buf->inline_capacity)
+    {
+        if (!dynamic_buffer_is_inline(buf))
+        {
+            memcpy(buf->inline_data, buf->data, buf->size);
+            track_free(ALLOC_SITE_DYNAMIC_BUFFER, buf->data);
+            buf->data = buf->inline_data;
+        }
+
+        buf->capacity = buf->inline_capacity;
+
+        return true;
+    }
+
+    if (dynamic_buffer_is_inline(buf))
+    {
+        new_data = (uint8_t *)track_realloc(ALLOC_SITE_DYNAMIC_BUFFER, NULL, new_capacity);
+
+        if (new_data != NULL)
+        {
+            memcpy(new_data, buf->inline_data, buf->size);
+        }
+    }
+    else
+    {
+        new_data = (uint8_t *)track_realloc(ALLOC_SITE_DYNAMIC_BUFFER, buf->data, new_capacity);
+    }
 
     if (new_data == NULL)
     {
@@ -80,42 +119,107 @@ bool dynamic_buffer_resize(dynamic_buffer_t *buf, size_t new_capacity)
 
 /*****************************************************************************
  *
- *   Name:       dynamic_buffer_add_data
+ *   Name:       dynamic_buffer_reserve
  *
- *   Input:      buf              A pointer to the dynamic buffer to which data will be added
- *               data             A pointer to the data to be added
- *               data_size        The size of the data to be added
- *   Return:     Success          true if the data was added successfully
+ *   Input:      buf              A pointer to the dynamic buffer
+ *               capacity         Capacity the buffer needs at least
+ *   Return:     Success          true if the buffer holds capacity bytes
  *               Failed           false if the operation failed
- *   Description:            Adds the specified data to the dynamic buffer. Automatically
- *                           resizes the buffer if the current capacity is insufficient.
+ *   Description:            Grows the buffer by doubling until capacity fits, so a
+ *                           buffer that is filled piece by piece is reallocated rarely.
+ *                           A large enough buffer is left as it is.
  ******************************************************************************/
-bool dynamic_buffer_add_data(dynamic_buffer_t *buf, const uint8_t *data, size_t data_size)
+bool dynamic_buffer_reserve(dynamic_buffer_t *buf, size_t capacity)
 {
-    size_t needed_capacity = 0;
-    size_t capacity = 0;
+    size_t new_capacity = 0;
 
-    if (buf == NULL || data == NULL || buf->capacity == 0)
+    if (buf == NULL || buf->capacity == 0)
     {
         return false;
     }
 
-    /* Check available capacity */
-    needed_capacity = buf->size + data_size;
-    capacity = buf->capacity;
+    new_capacity = buf->capacity;
 
-    while (capacity < needed_capacity)
+    while (new_capacity < capacity)
     {
-        if (capacity > SIZE_MAX / 2)
+        if (new_capacity > SIZE_MAX / 2)
         {
-            capacity = SIZE_MAX;
+            new_capacity = SIZE_MAX;
             break;
         }
 
-        capacity *= 2;
+        new_capacity *= 2;
+    }
+
+    return new_capacity == buf->capacity || dynamic_buffer_resize(buf, new_capacity);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       dynamic_buffer_shrink
+ *
+ *   Input:      buf              A pointer to the dynamic buffer
+ *   Return:     Success          true if the capacity now matches the data
+ *               Failed           false if the operation failed
+ *   Description:            Releases the capacity the data does not use, for a buffer
+ *                           kept around after it held an unusually large packet.
+ ******************************************************************************/
+bool dynamic_buffer_shrink(dynamic_buffer_t *buf)
+{
+    if (buf == NULL)
+    {
+        return false;
+    }
+
+    if (buf->capacity == buf->size || dynamic_buffer_is_inline(buf))
+    {
+        return true;
     }
 
-    if (capacity > buf->capacity && !dynamic_buffer_resize(buf, capacity))
+    return dynamic_buffer_resize(buf, (buf->size != 0) ? buf->size : 1);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       dynamic_buffer_reset
+ *
+ *   Input:      buf              A pointer to the dynamic buffer
+ *   Return:     None
+ *   Description:            Empties the buffer and keeps its capacity, so it can be
+ *                           filled again without allocating.
+ ******************************************************************************/
+void dynamic_buffer_reset(dynamic_buffer_t *buf)
+{
+    if (buf == NULL)
+    {
+        return;
+    }
+
+    buf->size = 0;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       dynamic_buffer_add_data
+ *
+ *   Input:      buf              A pointer to the dynamic buffer to which data will be added
+ *               data             A pointer to the data to be added
+ *               data_size        The size of the data to be added
+ *   Return:     Success          true if the data was added successfully
+ *               Failed           false if the operation failed
+ *   Description:            Adds the specified data to the dynamic buffer. Automatically
+ *                           resizes the buffer if the current capacity is insufficient.
+ ******************************************************************************/
+bool dynamic_buffer_add_data(dynamic_buffer_t *buf, const uint8_t *data, size_t data_size)
+{
+    if (buf == NULL || data == NULL || buf->capacity == 0)
+    {
+        return false;
+    }
+
+    if (data_size > SIZE_MAX - buf->size || !dynamic_buffer_reserve(buf, buf->size + data_size))
     {
         return false;
     }
@@ -148,12 +252,16 @@ void dynamic_buffer_free(dynamic_buffer_t **buf_p)
         return;
     }
 
-    free((*buf_p)->data);
+    if (!dynamic_buffer_is_inline(*buf_p))
+    {
+        track_free(ALLOC_SITE_DYNAMIC_BUFFER, (*buf_p)->data);
+    }
+
     (*buf_p)->data = NULL;
     (*buf_p)->size = 0;
     (*buf_p)->capacity = 0;
 
-    free(*buf_p);
+    track_free(ALLOC_SITE_DYNAMIC_BUFFER, *buf_p);
     *buf_p = NULL;
 
     return;
@@ -6,7 +6,7 @@
 #include "common.h"
 #include "ethernet-frame.h"
 
-ethernet_frame_t *ethernet_frame_from_dynamic_buffer(dynamic_buffer_t *buffer)
+static ethernet_frame_t *ethernet_frame_decode(dynamic_buffer_t *buffer, packet_arena_t *arena)
 {
     ethernet_header_t *header = NULL;
     ethernet_frame_t *frame = NULL;
@@ -23,7 +23,8 @@ ethernet_frame_t *ethernet_frame_from_dynamic_buffer(dynamic_buffer_t *buffer)
         goto cleanup;
     }
 
-    header = (ethernet_header_t *)calloc(1, sizeof(ethernet_frame_t));
+    header = (ethernet_header_t *)packet_arena_calloc(arena, ALLOC_SITE_ETHERNET, 1,
+                                                      sizeof(ethernet_frame_t));
 
     if (header == NULL)
     {
@@ -35,7 +36,8 @@ ethernet_frame_t *ethernet_frame_from_dynamic_buffer(dynamic_buffer_t *buffer)
     header->ethertype = ntohs(header->ethertype);
 
     data_len = buffer->size - sizeof(ethernet_header_t);
-    frame = (ethernet_frame_t *)calloc(1, sizeof(ethernet_frame_t) + data_len);
+    frame = (ethernet_frame_t *)packet_arena_calloc(arena, ALLOC_SITE_ETHERNET, 1,
+                                                    sizeof(ethernet_frame_t) + data_len);
 
     if (frame == NULL)
     {
@@ -50,15 +52,32 @@ ethernet_frame_t *ethernet_frame_from_dynamic_buffer(dynamic_buffer_t *buffer)
     return frame;
 
 cleanup:
-    free(header);
+    packet_arena_release(arena, ALLOC_SITE_ETHERNET, header);
     header = NULL;
 
-    free(frame);
+    packet_arena_release(arena, ALLOC_SITE_ETHERNET, frame);
     frame = NULL;
 
     return NULL;
 }
 
+ethernet_frame_t *ethernet_frame_from_dynamic_buffer(dynamic_buffer_t *buffer)
+{
+    return ethernet_frame_decode(buffer, NULL);
+}
+
+/* Same as ethernet_frame_from_dynamic_buffer, allocated from arena until it is reset, not freed */
+ethernet_frame_t *ethernet_frame_from_dynamic_buffer_arena(dynamic_buffer_t *buffer,
+                                                         packet_arena_t *arena)
+{
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+
+    return ethernet_frame_decode(buffer, arena);
+}
+
 void ethernet_frame_free(ethernet_frame_t **frame_p)
 {
     if (frame_p == NULL || *frame_p == NULL)
@@ -66,10 +85,10 @@ void ethernet_frame_free(ethernet_frame_t **frame_p)
         return;
     }
 
-    free((*frame_p)->header);
+    track_free(ALLOC_SITE_ETHERNET, (*frame_p)->header);
     (*frame_p)->header = NULL;
 
-    free(*frame_p);
+    track_free(ALLOC_SITE_ETHERNET, *frame_p);
     *frame_p = NULL;
 
     return;
@@ -0,0 +1,519 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc-track.h"
+#include "common.h"
+#include "flow-index.h"
+#include "huge-alloc.h"
+
+#define FLOW_INDEX_PREFETCH_BATCH 16 /* lookups in flight at once in flow_index_get_many */
+#define FLOW_INDEX_NEXT_INITIAL_CAPACITY 8
+#define PREFETCH_READ 0
+#define PREFETCH_LOCALITY_LOW 1
+
+/* Chains store index + 1, so that a zeroed bucket array is empty */
+#define RECORD_TO_LINK(record) ((record) + 1)
+#define LINK_TO_RECORD(link) ((link)-1)
+
+static const void *flow_index_key(const flow_index_t *index, const void *records, uint32_t record)
+{
+    return (const uint8_t *)records + (size_t)record * index->record_size;
+}
+
+static uint64_t flow_index_bucket(const flow_index_t *index, const void *key, uint64_t capacity)
+{
+    return index->hash_func(key, capacity) % capacity; /* modulo just to be safe */
+}
+
+/* Record holding key in the chain starting at link, counting the keys compared */
+static uint32_t flow_index_search(const flow_index_t *index, const void *records, uint32_t link,
+                                  const void *key, uint64_t *comparisons)
+{
+    while (link != 0)
+    {
+        (*comparisons)++;
+
+        if (memcmp(flow_index_key(index, records, LINK_TO_RECORD(link)), key,
+                   index->key_length) == 0)
+        {
+            return LINK_TO_RECORD(link);
+        }
+
+        link = index->next[LINK_TO_RECORD(link)];
+    }
+
+    return FLOW_INDEX_NONE;
+}
+
+/**
+ * Moves every chain to a new bucket array. Chains are walked from bucket 0 up and each record
+ * is pushed at the head of its new chain, the same order a HashTable_t rehash produces.
+ * */
+static bool flow_index_rehash(flow_index_t *index, const void *records, uint64_t new_capacity)
+{
+    uint32_t *new_buckets = NULL;
+    uint64_t i = 0;
+    uint64_t bucket = 0;
+    uint32_t link = 0;
+    uint32_t following = 0;
+    struct timespec start;
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    /* Large bucket arrays come from huge pages, random bucket reads miss the TLB less */
+    new_buckets = (uint32_t *)huge_calloc(ALLOC_SITE_HASH_TABLE, new_capacity, sizeof(uint32_t));
+
+    if (new_buckets == NULL)
+    {
+        return false;
+    }
+
+    for (i = 0; i < index->capacity; i++)
+    {
+        for (link = index->buckets[i]; link != 0; link = following)
+        {
+            following = index->next[LINK_TO_RECORD(link)];
+            bucket = flow_index_bucket(index, flow_index_key(index, records, LINK_TO_RECORD(link)),
+                                       new_capacity);
+            index->next[LINK_TO_RECORD(link)] = new_buckets[bucket];
+            new_buckets[bucket] = link;
+        }
+    }
+
+    huge_free(ALLOC_SITE_HASH_TABLE, index->buckets, index->capacity * sizeof(uint32_t));
+    index->buckets = new_buckets;
+    index->capacity = new_capacity;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    index->rehash_count++;
+    index->rehash_ns += (uint64_t)(end.tv_sec - start.tv_sec) * NANOSECONDS_PER_SECOND +
+                        (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+
+    return true;
+}
+
+/* Makes room in next for the link of record */
+static bool flow_index_reserve(flow_index_t *index, uint32_t record)
+{
+    uint32_t *new_next = NULL;
+    uint64_t new_capacity = 0;
+
+    if (record < index->next_capacity)
+    {
+        return true;
+    }
+
+    new_capacity = (index->next_capacity == 0) ? FLOW_INDEX_NEXT_INITIAL_CAPACITY
+                                               : index->next_capacity * 2;
+    new_capacity = (new_capacity <= record) ? (uint64_t)record + 1 : new_capacity;
+    new_next = (uint32_t *)huge_realloc(ALLOC_SITE_HASH_TABLE, index->next,
+                                        index->next_capacity * sizeof(uint32_t),
+                                        new_capacity * sizeof(uint32_t));
+
+    if (new_next == NULL)
+    {
+        return false;
+    }
+
+    index->next = new_next;
+    index->next_capacity = new_capacity;
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_index_create
+ *
+ *   Input:      capacity     Number of buckets, grows as records are added
+ *               hash_func    A function used for hashing keys
+ *               key_length   Bytes of the key at the start of every record
+ *               record_size  Size of one record in the caller's array
+ *
+ *   Return:     Success      A pointer to the new flow_index_t
+ *               Failed       NULL
+ *
+ *   Description:            Creates an empty index. The record array is not kept, it is
+ *                           passed to every call, so the caller may move or grow it freely.
+ ******************************************************************************/
+flow_index_t *flow_index_create(uint64_t capacity, hash_func_t hash_func, size_t key_length,
+                                size_t record_size)
+{
+    flow_index_t *index = NULL;
+
+    if (capacity == 0 || hash_func == NULL || key_length == 0 || record_size < key_length)
+    {
+        fprintf(stderr, "Invalid parameter for creating flow index\n");
+
+        return NULL;
+    }
+
+    index = (flow_index_t *)track_calloc(ALLOC_SITE_HASH_TABLE, 1, sizeof(flow_index_t));
+
+    if (index == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for flow index.\n");
+
+        return NULL;
+    }
+
+    index->buckets = (uint32_t *)huge_calloc(ALLOC_SITE_HASH_TABLE, capacity, sizeof(uint32_t));
+
+    if (index->buckets == NULL)
+    {
+        track_free(ALLOC_SITE_HASH_TABLE, index);
+        index = NULL;
+        fprintf(stderr, "Unable to allocate memory for flow index buckets.\n");
+
+        return NULL;
+    }
+
+    index->capacity = capacity;
+    index->hash_func = hash_func;
+    index->key_length = key_length;
+    index->record_size = record_size;
+
+    return index;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_index_get
+ *
+ *   Input:      index        Index to search
+ *               records      Record array the index refers to
+ *               key          Key to look up
+ *
+ *   Return:     Success      Index of the record holding key
+ *               Failed       FLOW_INDEX_NONE if key is not stored
+ ******************************************************************************/
+uint32_t flow_index_get(flow_index_t *index, const void *records, const void *key)
+{
+    uint32_t record = FLOW_INDEX_NONE;
+
+    if (index == NULL || key == NULL)
+    {
+        return FLOW_INDEX_NONE;
+    }
+
+    record = flow_index_search(index, records,
+                               index->buckets[flow_index_bucket(index, key, index->capacity)], key,
+                               &index->comparisons);
+    index->lookups++;
+
+    return record;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_index_get_many
+ *
+ *   Input:      index        Index to search
+ *               records      Record array the index refers to
+ *               keys         Keys to look up, NULL entries are skipped
+ *               count        Number of keys
+ *   Output:     results      Record of every key, FLOW_INDEX_NONE where the key is not
+ *                            stored, must hold count elements
+ *
+ *   Return:     Number of keys found
+ *
+ *   Description:            Same as calling flow_index_get for every key, but keys are
+ *                           processed in groups: the buckets of a group are computed and
+ *                           prefetched, then the first record of every chain, and only then
+ *                           are the chains searched. This keeps several cache misses in
+ *                           flight on tables larger than the cache.
+ ******************************************************************************/
+size_t flow_index_get_many(flow_index_t *index, const void *records, const void *const *keys,
+                           uint32_t *results, size_t count)
+{
+    uint64_t buckets[FLOW_INDEX_PREFETCH_BATCH] = {0};
+    uint64_t lookups = 0;
+    uint64_t comparisons = 0;
+    size_t base = 0;
+    size_t batch = 0;
+    size_t found = 0;
+    size_t i = 0;
+    uint32_t link = 0;
+
+    if (index == NULL || keys == NULL || results == NULL)
+    {
+        return 0;
+    }
+
+    for (base = 0; base < count; base += batch)
+    {
+        batch = (count - base < FLOW_INDEX_PREFETCH_BATCH) ? count - base
+                                                           : FLOW_INDEX_PREFETCH_BATCH;
+
+        for (i = 0; i < batch; i++)
+        {
+            if (keys[base + i] != NULL)
+            {
+                buckets[i] = flow_index_bucket(index, keys[base + i], index->capacity);
+                __builtin_prefetch(&index->buckets[buckets[i]], PREFETCH_READ,
+                                   PREFETCH_LOCALITY_LOW);
+            }
+        }
+
+        for (i = 0; i < batch; i++)
+        {
+            link = (keys[base + i] != NULL) ? index->buckets[buckets[i]] : 0;
+
+            if (link != 0)
+            {
+                __builtin_prefetch(flow_index_key(index, records, LINK_TO_RECORD(link)),
+                                   PREFETCH_READ, PREFETCH_LOCALITY_LOW);
+            }
+        }
+
+        for (i = 0; i < batch; i++)
+        {
+            results[base + i] = FLOW_INDEX_NONE;
+
+            if (keys[base + i] == NULL)
+            {
+                continue;
+            }
+
+            results[base + i] = flow_index_search(index, records, index->buckets[buckets[i]],
+                                                  keys[base + i], &comparisons);
+            lookups++;
+            found += (results[base + i] != FLOW_INDEX_NONE);
+        }
+    }
+
+    /* Published once per call, the loop above only touches locals */
+    index->lookups += lookups;
+    index->comparisons += comparisons;
+
+    return found;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_index_add
+ *
+ *   Input:      index        Index receiving the record
+ *               records      Record array, already holding the key of record
+ *               record       Index of the record to add, its key must not be stored yet
+ *
+ *   Return:     Success      true
+ *               Failed       false if memory could not be allocated
+ *
+ *   Description:            Pushes the record at the head of its chain. Callers look the
+ *                           key up first, so the chain is not searched again. The buckets
+ *                           grow like a HashTable_t once more than half of them are used.
+ ******************************************************************************/
+bool flow_index_add(flow_index_t *index, const void *records, uint32_t record)
+{
+    uint64_t bucket = 0;
+
+    if (index == NULL || records == NULL || record == FLOW_INDEX_NONE)
+    {
+        return false;
+    }
+
+    if (!flow_index_reserve(index, record))
+    {
+        return false;
+    }
+
+    if (index->size > index->capacity / 2)
+    {
+        /* A failed rehash only leaves the chains longer */
+        flow_index_rehash(index, records, hash_table_grown_capacity(index->capacity));
+    }
+
+    bucket = flow_index_bucket(index, flow_index_key(index, records, record), index->capacity);
+    index->next[record] = index->buckets[bucket];
+    index->buckets[bucket] = RECORD_TO_LINK(record);
+    index->size++;
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_index_remove
+ *
+ *   Input:      index        Index holding the record
+ *               records      Record array, still holding the key of record
+ *               record       Index of the record to remove
+ *
+ *   Return:     Success      true
+ *               Failed       false if the record is not in the index
+ ******************************************************************************/
+bool flow_index_remove(flow_index_t *index, const void *records, uint32_t record)
+{
+    uint32_t *link_p = NULL;
+
+    if (index == NULL || records == NULL || record == FLOW_INDEX_NONE)
+    {
+        return false;
+    }
+
+    link_p = &index->buckets[flow_index_bucket(index, flow_index_key(index, records, record),
+                                               index->capacity)];
+
+    while (*link_p != 0 && *link_p != RECORD_TO_LINK(record))
+    {
+        link_p = &index->next[LINK_TO_RECORD(*link_p)];
+    }
+
+    if (*link_p == 0)
+    {
+        return false; /* record was not found */
+    }
+
+    *link_p = index->next[record];
+    index->next[record] = 0;
+    index->size--;
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_index_renumber
+ *
+ *   Input:      index        Index to update
+ *               new_index    New index of every record, FLOW_INDEX_NONE for records that are
+ *                            not in the index
+ *               count        Number of records before renumbering
+ *
+ *   Return:     None
+ *
+ *   Description:            Follows a compaction of the record array that kept the order of
+ *                           the records, so no record moved up. Chains keep their order and
+ *                           nothing is rehashed.
+ ******************************************************************************/
+void flow_index_renumber(flow_index_t *index, const uint32_t *new_index, uint32_t count)
+{
+    uint64_t i = 0;
+    uint32_t record = 0;
+
+    if (index == NULL || new_index == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < index->capacity; i++)
+    {
+        if (index->buckets[i] != 0)
+        {
+            index->buckets[i] = RECORD_TO_LINK(new_index[LINK_TO_RECORD(index->buckets[i])]);
+        }
+    }
+
+    /* Links first, then the links move down to their new slot, never over an unread one */
+    for (record = 0; record < count; record++)
+    {
+        if (new_index[record] != FLOW_INDEX_NONE && index->next[record] != 0)
+        {
+            index->next[record] = RECORD_TO_LINK(new_index[LINK_TO_RECORD(index->next[record])]);
+        }
+    }
+
+    for (record = 0; record < count; record++)
+    {
+        if (new_index[record] != FLOW_INDEX_NONE)
+        {
+            index->next[new_index[record]] = index->next[record];
+        }
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_index_get_stats
+ *
+ *   Input:      index        Index to inspect
+ *   Output:     stats        Load, chain length histogram, rehash and lookup statistics
+ *
+ *   Return:     None
+ *
+ *   Description:            Same statistics as hash_table_get_stats, walking every chain.
+ ******************************************************************************/
+void flow_index_get_stats(flow_index_t *index, HashTableStats_t *stats)
+{
+    uint64_t i = 0;
+    uint64_t chain = 0;
+    uint32_t link = 0;
+
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    memset(stats, 0, sizeof(HashTableStats_t));
+
+    if (index == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < index->capacity; i++)
+    {
+        chain = 0;
+
+        for (link = index->buckets[i]; link != 0; link = index->next[LINK_TO_RECORD(link)])
+        {
+            chain++;
+        }
+
+        stats->max_chain = (chain > stats->max_chain) ? chain : stats->max_chain;
+        chain = (chain < HASH_TABLE_CHAIN_HISTOGRAM) ? chain : HASH_TABLE_CHAIN_HISTOGRAM - 1;
+        stats->chain_histogram[chain]++;
+    }
+
+    stats->size = index->size;
+    stats->capacity = index->capacity;
+    stats->load_factor = (double)index->size / (double)index->capacity;
+    stats->rehash_count = index->rehash_count;
+    stats->rehash_seconds = (double)index->rehash_ns / NANOSECONDS_PER_SECOND;
+    stats->lookups = index->lookups;
+    stats->comparisons_per_lookup =
+        (index->lookups != 0) ? (double)index->comparisons / (double)index->lookups : 0.0;
+
+    return;
+}
+
+void print_flow_index_stats(FILE *stream, flow_index_t *index)
+{
+    HashTableStats_t stats;
+
+    if (stream == NULL || index == NULL)
+    {
+        return;
+    }
+
+    flow_index_get_stats(index, &stats);
+    print_hash_stats(stream, &stats);
+
+    return;
+}
+
+void flow_index_free(flow_index_t **index_p)
+{
+    if (index_p == NULL || *index_p == NULL)
+    {
+        return;
+    }
+
+    huge_free(ALLOC_SITE_HASH_TABLE, (*index_p)->buckets,
+              (*index_p)->capacity * sizeof(uint32_t));
+    (*index_p)->buckets = NULL;
+
+    huge_free(ALLOC_SITE_HASH_TABLE, (*index_p)->next,
+              (*index_p)->next_capacity * sizeof(uint32_t));
+    (*index_p)->next = NULL;
+
+    track_free(ALLOC_SITE_HASH_TABLE, *index_p);
+    *index_p = NULL;
+
+    return;
+}
@@ -0,0 +1,346 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flow-table.h"
+#include "huge-alloc.h"
+
+#define FLOW_TABLE_LOAD_NUMERATOR 3 /* grown before more than 3/4 of the slots are used */
+#define FLOW_TABLE_LOAD_DENOMINATOR 4
+#define PREFETCH_WRITE 1
+#define PREFETCH_LOCALITY_LOW 1
+
+_Static_assert(sizeof(flow_record_t) == 2 * sizeof(uint64_t), "flow_record_t must be 16 bytes");
+
+/* Finalizer of MurmurHash3, spreads the structured address bits over the whole word */
+static uint64_t flow_table_hash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return key;
+}
+
+/* Slot holding key, or the empty slot where it belongs. The table always has an empty slot */
+static flow_record_t *flow_table_find(const flow_table_t *table, uint64_t key, uint64_t hash)
+{
+    uint64_t mask = table->capacity - 1;
+    uint64_t slot = hash & mask;
+
+    while (table->records[slot].count != 0 && table->records[slot].key != key)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return &table->records[slot];
+}
+
+static bool flow_table_grow(flow_table_t *table)
+{
+    flow_table_t grown = {0};
+    flow_record_t *record = NULL;
+    uint64_t i = 0;
+
+    if (table->capacity > UINT64_MAX / 2 / sizeof(flow_record_t))
+    {
+        return false;
+    }
+
+    grown.capacity = table->capacity * 2;
+    grown.size = table->size;
+    grown.records =
+        (flow_record_t *)huge_calloc(ALLOC_SITE_FLOW_TABLE, grown.capacity, sizeof(flow_record_t));
+
+    if (grown.records == NULL)
+    {
+        return false;
+    }
+
+    for (i = 0; i < table->capacity; i++)
+    {
+        if (table->records[i].count != 0)
+        {
+            record = flow_table_find(&grown, table->records[i].key,
+                                     flow_table_hash(table->records[i].key));
+            *record = table->records[i];
+        }
+    }
+
+    huge_free(ALLOC_SITE_FLOW_TABLE, table->records, table->capacity * sizeof(flow_record_t));
+    *table = grown;
+
+    return true;
+}
+
+static bool flow_table_add_hashed(flow_table_t *table, uint64_t key, uint64_t hash,
+                                  uint64_t count)
+{
+    flow_record_t *record = NULL;
+
+    record = flow_table_find(table, key, hash);
+
+    if (record->count == 0)
+    {
+        if ((table->size + 1) * FLOW_TABLE_LOAD_DENOMINATOR >
+            table->capacity * FLOW_TABLE_LOAD_NUMERATOR)
+        {
+            if (!flow_table_grow(table))
+            {
+                fprintf(stderr, "Unable to grow flow table beyond %" PRIu64 " flows.\n",
+                        table->size);
+
+                return false;
+            }
+
+            record = flow_table_find(table, key, hash);
+        }
+
+        record->key = key;
+        table->size++;
+    }
+
+    record->count += count;
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_table_create
+ *
+ *   Input:      capacity     Flows expected, the table grows past it when needed
+ *
+ *   Return:     Success      A pointer to the new, empty flow_table_t
+ *               Failed       NULL
+ *
+ *   Description:            Creates a table with enough power of two slots to hold
+ *                           capacity flows below the maximum load.
+ ******************************************************************************/
+flow_table_t *flow_table_create(uint64_t capacity)
+{
+    flow_table_t *table = NULL;
+    uint64_t slots = FLOW_TABLE_MIN_CAPACITY;
+
+    while (slots * FLOW_TABLE_LOAD_NUMERATOR / FLOW_TABLE_LOAD_DENOMINATOR < capacity &&
+           slots <= UINT64_MAX / 2 / sizeof(flow_record_t))
+    {
+        slots *= 2;
+    }
+
+    table = (flow_table_t *)calloc(1, sizeof(flow_table_t));
+
+    if (table == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for flow table.\n");
+
+        return NULL;
+    }
+
+    table->records =
+        (flow_record_t *)huge_calloc(ALLOC_SITE_FLOW_TABLE, slots, sizeof(flow_record_t));
+
+    if (table->records == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for flow table records.\n");
+        free(table);
+        table = NULL;
+
+        return NULL;
+    }
+
+    table->capacity = slots;
+
+    return table;
+}
+
+/* Packs a flow into a table key, the first address byte is the most significant */
+uint64_t flow_key(const ip_addr_t *src, const ip_addr_t *dest)
+{
+    uint64_t key = 0;
+    size_t i = 0;
+
+    for (i = 0; i < IP_ADDRESS_LENGTH; i++)
+    {
+        key = (key << 8) | src->byte[i];
+    }
+
+    for (i = 0; i < IP_ADDRESS_LENGTH; i++)
+    {
+        key = (key << 8) | dest->byte[i];
+    }
+
+    return key;
+}
+
+/* Unpacks a key made by flow_key */
+void flow_key_addresses(uint64_t key, ip_addr_t *src, ip_addr_t *dest)
+{
+    size_t i = 0;
+
+    for (i = IP_ADDRESS_LENGTH; i > 0; i--)
+    {
+        dest->byte[i - 1] = (uint8_t)key;
+        key >>= 8;
+    }
+
+    for (i = IP_ADDRESS_LENGTH; i > 0; i--)
+    {
+        src->byte[i - 1] = (uint8_t)key;
+        key >>= 8;
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_table_add
+ *
+ *   Input:      table        Table to update
+ *               key          Flow made by flow_key
+ *               count        Packets to add, 0 does nothing
+ *
+ *   Return:     Success      true
+ *               Failed       false if the table was full and could not grow
+ *
+ *   Description:            Adds count to the flow, inserting it if it is new.
+ ******************************************************************************/
+bool flow_table_add(flow_table_t *table, uint64_t key, uint64_t count)
+{
+    if (table == NULL)
+    {
+        return false;
+    }
+
+    if (count == 0)
+    {
+        return true;
+    }
+
+    return flow_table_add_hashed(table, key, flow_table_hash(key), count);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       flow_table_add_many
+ *
+ *   Input:      table        Table to update
+ *               keys         Flows made by flow_key, one per packet
+ *               count        Number of keys
+ *
+ *   Return:     Number of packets counted, less than count only if the table could not grow
+ *
+ *   Description:            Counts one packet for every key. Keys are hashed and their
+ *                           slots prefetched in groups before any of them is updated, so
+ *                           the cache misses of a group overlap.
+ ******************************************************************************/
+size_t flow_table_add_many(flow_table_t *table, const uint64_t *keys, size_t count)
+{
+    uint64_t hashes[FLOW_TABLE_PREFETCH_BATCH] = {0};
+    size_t counted = 0;
+    size_t base = 0;
+    size_t batch = 0;
+    size_t i = 0;
+
+    if (table == NULL || keys == NULL)
+    {
+        return 0;
+    }
+
+    for (base = 0; base < count; base += batch)
+    {
+        batch = (count - base < FLOW_TABLE_PREFETCH_BATCH) ? count - base
+                                                           : FLOW_TABLE_PREFETCH_BATCH;
+
+        for (i = 0; i < batch; i++)
+        {
+            hashes[i] = flow_table_hash(keys[base + i]);
+            __builtin_prefetch(&table->records[hashes[i] & (table->capacity - 1)],
+                               PREFETCH_WRITE, PREFETCH_LOCALITY_LOW);
+        }
+
+        for (i = 0; i < batch; i++)
+        {
+            counted += flow_table_add_hashed(table, keys[base + i], hashes[i], 1);
+        }
+    }
+
+    return counted;
+}
+
+/* Packets counted for the flow, 0 if it is not in the table */
+uint64_t flow_table_get(const flow_table_t *table, uint64_t key)
+{
+    if (table == NULL)
+    {
+        return 0;
+    }
+
+    return flow_table_find(table, key, flow_table_hash(key))->count;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       print_flow_table_stats
+ *
+ *   Input:      stream       Stream to print to
+ *               table        Table to describe
+ *
+ *   Return:     None
+ *
+ *   Description:            Prints the size and load of the table, and how far records sit
+ *                           from the slot their hash points to, which is the number of extra
+ *                           slots a lookup of them probes.
+ ******************************************************************************/
+void print_flow_table_stats(FILE *stream, const flow_table_t *table)
+{
+    uint64_t i = 0;
+    uint64_t distance = 0;
+    uint64_t max_distance = 0;
+    uint64_t total_distance = 0;
+
+    if (stream == NULL || table == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < table->capacity; i++)
+    {
+        if (table->records[i].count == 0)
+        {
+            continue;
+        }
+
+        distance = (i - flow_table_hash(table->records[i].key)) & (table->capacity - 1);
+        max_distance = (distance > max_distance) ? distance : max_distance;
+        total_distance += distance;
+    }
+
+    fprintf(stream, "Flow table: %" PRIu64 " flows in %" PRIu64 " slots, load factor %.3f\n",
+            table->size, table->capacity, (double)table->size / (double)table->capacity);
+    fprintf(stream, "  Longest probe %" PRIu64 ", %.3f extra slots per flow\n", max_distance,
+            (table->size != 0) ? (double)total_distance / (double)table->size : 0.0);
+
+    return;
+}
+
+void flow_table_free(flow_table_t **table_p)
+{
+    if (table_p == NULL || *table_p == NULL)
+    {
+        return;
+    }
+
+    huge_free(ALLOC_SITE_FLOW_TABLE, (*table_p)->records,
+              (*table_p)->capacity * sizeof(flow_record_t));
+    (*table_p)->records = NULL;
+
+    free(*table_p);
+    *table_p = NULL;
+
+    return;
+}
@@ -1,9 +1,21 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+#include "alloc-track.h"
+#include "common.h"
 #include "hash-table.h"
+#include "huge-alloc.h"
+
+#define HASH_TABLE_PREFETCH_BATCH 16 /* lookups in flight at once in hash_table_get_many */
+#define PREFETCH_READ 0
+#define PREFETCH_LOCALITY_LOW 1
 
 static HashNode_t *hash_table_create_node(const void *key, const void *data);
+static ListNode_t *hash_table_search(HashTable_t *hash_table, ListNode_t **head_p,
+                                     const void *key, uint64_t *comparisons);
 static bool hash_table_rehash(HashTable_t *hash_table, uint64_t new_capacity);
 static bool is_prime(uint64_t n);
 static uint64_t next_prime(uint64_t n);
@@ -37,7 +49,7 @@ HashTable_t *hash_table_create(uint64_t capacity, hash_func_t hash_func, match_f
         return NULL;
     }
 
-    hash_table = (HashTable_t *)calloc(1, sizeof(HashTable_t));
+    hash_table = (HashTable_t *)track_calloc(ALLOC_SITE_HASH_TABLE, 1, sizeof(HashTable_t));
 
     if (hash_table == NULL)
     {
@@ -46,11 +58,11 @@ HashTable_t *hash_table_create(uint64_t capacity, hash_func_t hash_func, match_f
         return NULL;
     }
 
-    table = (HashNode_t **)calloc(capacity, sizeof(HashNode_t *));
+    table = (HashNode_t **)huge_calloc(ALLOC_SITE_HASH_TABLE, capacity, sizeof(HashNode_t *));
 
     if (table == NULL)
     {
-        free(hash_table);
+        track_free(ALLOC_SITE_HASH_TABLE, hash_table);
         hash_table = NULL;
         fprintf(stderr, "Unable to allocate memory for Hash Table table.\n");
 
@@ -87,7 +99,7 @@ static HashNode_t *hash_table_create_node(const void *key, const void *data)
         return NULL;
     }
 
-    node = (HashNode_t *)calloc(1, sizeof(HashNode_t));
+    node = (HashNode_t *)track_calloc(ALLOC_SITE_HASH_NODE, 1, sizeof(HashNode_t));
 
     if (node == NULL)
     {
@@ -102,6 +114,27 @@ static HashNode_t *hash_table_create_node(const void *key, const void *data)
     return node;
 }
 
+/* linked_list_search that also adds the keys compared to comparisons, for hash_table_get_stats */
+static ListNode_t *hash_table_search(HashTable_t *hash_table, ListNode_t **head_p,
+                                     const void *key, uint64_t *comparisons)
+{
+    ListNode_t *current = *head_p;
+
+    while (current != NULL)
+    {
+        (*comparisons)++;
+
+        if (hash_table->match_func(current, key))
+        {
+            break;
+        }
+
+        current = current->next;
+    }
+
+    return current;
+}
+
 /*****************************************************************************
  *
  *   Name:       hash_table_get_item
@@ -131,7 +164,8 @@ const void *hash_table_get_item(HashTable_t *hash_table, const void *key)
     hash_index = hash_table->hash_func(key, hash_table->capacity);
     hash_index = hash_index % hash_table->capacity; /* Just to be safe */
     head_p = (ListNode_t **)&hash_table->table[hash_index];
-    result = linked_list_search(head_p, key, hash_table->match_func);
+    result = hash_table_search(hash_table, head_p, key, &hash_table->comparisons);
+    hash_table->lookups++;
 
     if (result != NULL)
     {
@@ -141,6 +175,97 @@ const void *hash_table_get_item(HashTable_t *hash_table, const void *key)
     return NULL;
 }
 
+/*****************************************************************************
+ *
+ *   Name:       hash_table_get_many
+ *
+ *   Input:      hash_table   Hash table from which to retrieve the items
+ *               keys         Keys of the items to retrieve
+ *               count        Number of keys
+ *   Output:     results      Data associated with every key, NULL where the key does not
+ *                            exist, must hold count elements
+ *
+ *   Return:     Number of keys found
+ *
+ *   Description:            Same as calling hash_table_get_item for every key, but keys
+ *                           are processed in groups: all bucket indices of a group are
+ *                           computed and their slots prefetched, then the chain heads are
+ *                           prefetched, and only then are the chains searched. This keeps
+ *                           several cache misses in flight on tables larger than the cache.
+ ******************************************************************************/
+size_t hash_table_get_many(HashTable_t *hash_table, const void *const *keys, const void **results,
+                           size_t count)
+{
+    uint64_t indices[HASH_TABLE_PREFETCH_BATCH] = {0};
+    uint64_t lookups = 0;
+    uint64_t comparisons = 0;
+    size_t base = 0;
+    size_t batch = 0;
+    size_t found = 0;
+    size_t i = 0;
+    ListNode_t *result = NULL;
+
+    if (hash_table == NULL || keys == NULL || results == NULL || hash_table->table == NULL)
+    {
+        return 0;
+    }
+
+    for (base = 0; base < count; base += batch)
+    {
+        batch = (count - base < HASH_TABLE_PREFETCH_BATCH) ? count - base
+                                                           : HASH_TABLE_PREFETCH_BATCH;
+
+        for (i = 0; i < batch; i++)
+        {
+            if (keys[base + i] == NULL)
+            {
+                continue; /* skipped below, the hash function may read the key */
+            }
+
+            indices[i] = hash_table->hash_func(keys[base + i], hash_table->capacity);
+            indices[i] = indices[i] % hash_table->capacity; /* Just to be safe */
+            __builtin_prefetch(&hash_table->table[indices[i]], PREFETCH_READ,
+                               PREFETCH_LOCALITY_LOW);
+        }
+
+        for (i = 0; i < batch; i++)
+        {
+            if (keys[base + i] != NULL && hash_table->table[indices[i]] != NULL)
+            {
+                __builtin_prefetch(hash_table->table[indices[i]], PREFETCH_READ,
+                                   PREFETCH_LOCALITY_LOW);
+            }
+        }
+
+        for (i = 0; i < batch; i++)
+        {
+            results[base + i] = NULL;
+
+            if (keys[base + i] == NULL)
+            {
+                continue;
+            }
+
+            result = hash_table_search(hash_table,
+                                       (ListNode_t **)&hash_table->table[indices[i]],
+                                       keys[base + i], &comparisons);
+            lookups++;
+
+            if (result != NULL)
+            {
+                results[base + i] = ((HashNode_t *)result)->data;
+                found++;
+            }
+        }
+    }
+
+    /* Published once per call, the loop above only touches locals */
+    hash_table->lookups += lookups;
+    hash_table->comparisons += comparisons;
+
+    return found;
+}
+
 static bool is_prime(uint64_t n)
 {
     uint64_t i = 0;
@@ -195,6 +320,30 @@ static uint64_t next_prime(uint64_t n)
     return n;
 }
 
+/*****************************************************************************
+ *
+ *   Name:       hash_table_grown_capacity
+ *
+ *   Input:      capacity     Current number of buckets
+ *
+ *   Return:     Number of buckets after growing, the first prime after twice capacity
+ *
+ *   Description:            Growth policy of the chained tables, kept in one place so that
+ *                           tables built on it lay out their chains the same way.
+ ******************************************************************************/
+uint64_t hash_table_grown_capacity(uint64_t capacity)
+{
+    uint64_t new_capacity = next_prime(capacity * 2);
+
+    if (capacity > new_capacity)
+    {
+        /* Overflowed? */
+        new_capacity = UINT64_MAX;
+    }
+
+    return new_capacity;
+}
+
 /*****************************************************************************
  *
  *   Name:       hash_table_add_item
@@ -213,7 +362,7 @@ static uint64_t next_prime(uint64_t n)
 bool hash_table_add_item(HashTable_t *hash_table, const void *key, const void *data)
 {
     uint64_t hash_index = 0;
-    uint64_t new_capacity = 0;
+    uint64_t comparisons = 0;
     ListNode_t *result = NULL;
     HashNode_t *new_node = NULL;
     ListNode_t **head_p = NULL;
@@ -225,21 +374,14 @@ bool hash_table_add_item(HashTable_t *hash_table, const void *key, const void *d
 
     if (hash_table->size > hash_table->capacity / 2)
     {
-        new_capacity = next_prime(hash_table->capacity * 2);
-
-        if (hash_table->capacity > new_capacity)
-        {
-            /* Overflowed? */
-            new_capacity = UINT64_MAX;
-        }
-
-        hash_table_rehash(hash_table, new_capacity);
+        hash_table_rehash(hash_table, hash_table_grown_capacity(hash_table->capacity));
     }
 
     hash_index = hash_table->hash_func(key, hash_table->capacity);
     hash_index = hash_index % hash_table->capacity; /* Just to be safe */
     head_p = (ListNode_t **)&hash_table->table[hash_index];
-    result = linked_list_search(head_p, key, hash_table->match_func);
+    /* Not a lookup in the statistics, callers usually looked the key up before adding it */
+    result = hash_table_search(hash_table, head_p, key, &comparisons);
 
     if (result != NULL)
     {
@@ -268,13 +410,18 @@ static bool hash_table_rehash(HashTable_t *hash_table, uint64_t new_capacity)
     HashNode_t **new_table = NULL;
     ListNode_t **head_p = NULL;
     HashNode_t *node = NULL;
+    struct timespec start;
+    struct timespec end;
 
     if (hash_table == NULL || new_capacity == 0 || hash_table->table == NULL)
     {
         return false;
     }
 
-    new_table = (HashNode_t **)calloc(new_capacity, sizeof(HashNode_t *));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    /* Large bucket arrays come from huge pages, random bucket reads miss the TLB less */
+    new_table =
+        (HashNode_t **)huge_calloc(ALLOC_SITE_HASH_TABLE, new_capacity, sizeof(HashNode_t *));
 
     if (new_table == NULL)
     {
@@ -289,6 +436,7 @@ static bool hash_table_rehash(HashTable_t *hash_table, uint64_t new_capacity)
             head_p = (ListNode_t **)&hash_table->table[i];  /* Address of head of old list */
             linked_list_delete_node(head_p, *head_p, NULL); /* Move head to next node */
 
+            /* Get new index */
             hash_index = hash_table->hash_func(node->key, new_capacity); /* Get new index */
             hash_index = hash_index % new_capacity;                      /* Just to be safe */
             head_p = (ListNode_t **)&new_table[hash_index];              /* Address of new list */
@@ -296,14 +444,142 @@ static bool hash_table_rehash(HashTable_t *hash_table, uint64_t new_capacity)
         }
     }
 
-    free(hash_table->table);
+    huge_free(ALLOC_SITE_HASH_TABLE, hash_table->table,
+              hash_table->capacity * sizeof(HashNode_t *));
     hash_table->table = NULL;
     hash_table->table = new_table;
     hash_table->capacity = new_capacity;
 
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    hash_table->rehash_count++;
+    hash_table->rehash_ns += (uint64_t)(end.tv_sec - start.tv_sec) * NANOSECONDS_PER_SECOND +
+                             (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+
     return true;
 }
 
+/*****************************************************************************
+ *
+ *   Name:       hash_table_get_stats
+ *
+ *   Input:      hash_table   Hash table to inspect
+ *   Output:     stats        Load, chain length histogram, rehash and lookup statistics
+ *
+ *   Return:     None
+ *
+ *   Description:            Walks every bucket to measure the chains, so it costs as much
+ *                           as a rehash and is meant for reports, not the hot path.
+ ******************************************************************************/
+void hash_table_get_stats(HashTable_t *hash_table, HashTableStats_t *stats)
+{
+    uint64_t i = 0;
+    uint64_t chain = 0;
+    ListNode_t *node = NULL;
+
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    memset(stats, 0, sizeof(HashTableStats_t));
+
+    if (hash_table == NULL || hash_table->table == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < hash_table->capacity; i++)
+    {
+        chain = 0;
+
+        for (node = (ListNode_t *)hash_table->table[i]; node != NULL; node = node->next)
+        {
+            chain++;
+        }
+
+        stats->max_chain = (chain > stats->max_chain) ? chain : stats->max_chain;
+        chain = (chain < HASH_TABLE_CHAIN_HISTOGRAM) ? chain : HASH_TABLE_CHAIN_HISTOGRAM - 1;
+        stats->chain_histogram[chain]++;
+    }
+
+    stats->size = hash_table->size;
+    stats->capacity = hash_table->capacity;
+    stats->load_factor = (double)hash_table->size / (double)hash_table->capacity;
+    stats->rehash_count = hash_table->rehash_count;
+    stats->rehash_seconds = (double)hash_table->rehash_ns / NANOSECONDS_PER_SECOND;
+    stats->lookups = hash_table->lookups;
+    stats->comparisons_per_lookup =
+        (hash_table->lookups != 0) ? (double)hash_table->comparisons / (double)hash_table->lookups
+                                   : 0.0;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       print_hash_table_stats
+ *
+ *   Input:      stream       Where the statistics are printed
+ *               hash_table   Hash table to inspect
+ *
+ *   Return:     None
+ *
+ *   Description:            Prints the statistics of hash_table_get_stats as text.
+ ******************************************************************************/
+void print_hash_table_stats(FILE *stream, HashTable_t *hash_table)
+{
+    HashTableStats_t stats;
+
+    if (stream == NULL || hash_table == NULL)
+    {
+        return;
+    }
+
+    hash_table_get_stats(hash_table, &stats);
+    print_hash_stats(stream, &stats);
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       print_hash_stats
+ *
+ *   Input:      stream       Where the statistics are printed
+ *               stats        Statistics of a chained table
+ *
+ *   Return:     None
+ *
+ *   Description:            Prints statistics gathered by hash_table_get_stats, or by a
+ *                           table filling the same structure, as text.
+ ******************************************************************************/
+void print_hash_stats(FILE *stream, const HashTableStats_t *stats)
+{
+    uint32_t i = 0;
+
+    if (stream == NULL || stats == NULL)
+    {
+        return;
+    }
+
+    fprintf(stream, "Hash table: %" PRIu64 " items in %" PRIu64 " buckets, load factor %.3f\n",
+            stats->size, stats->capacity, stats->load_factor);
+    fprintf(stream, "  Longest chain %" PRIu64 ", %.3f comparisons per lookup over %" PRIu64
+                    " lookups\n",
+            stats->max_chain, stats->comparisons_per_lookup, stats->lookups);
+    fprintf(stream, "  %" PRIu64 " rehashes took %.6f seconds\n", stats->rehash_count,
+            stats->rehash_seconds);
+    fprintf(stream, "  Chain length  Buckets\n");
+
+    for (i = 0; i < HASH_TABLE_CHAIN_HISTOGRAM; i++)
+    {
+        fprintf(stream, "  %5u%-7s  %" PRIu64 "\n", i,
+                (i == HASH_TABLE_CHAIN_HISTOGRAM - 1) ? "+" : "", stats->chain_histogram[i]);
+    }
+
+    return;
+}
+
 /*****************************************************************************
  *
  *   Name:       hash_table_remove_item
@@ -375,12 +651,13 @@ void hash_table_free(HashTable_t **hash_table_p)
         hash_table->size -= linked_list_delete_list(head_p, hash_table->free_node);
     }
 
-    free(hash_table->table);
+    huge_free(ALLOC_SITE_HASH_TABLE, hash_table->table,
+              hash_table->capacity * sizeof(HashNode_t *));
     hash_table->table = NULL;
 
     hash_table = NULL;
 
-    free(*hash_table_p);
+    track_free(ALLOC_SITE_HASH_TABLE, *hash_table_p);
     *hash_table_p = NULL;
 
     return;
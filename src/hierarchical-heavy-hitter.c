@@ -0,0 +1,599 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hierarchical-heavy-hitter.h"
+
+#define HHH_RANDOM_SEED 0x9E3779B97F4A7C15ULL /* Fixed seed so that runs are reproducible */
+#define HHH_GOLDEN_RATIO 0x9E3779B97F4A7C15ULL
+#define HHH_BITS_PER_LEVEL 8
+#define HHH_ADDRESS_BITS 32
+#define HHH_PREFIX_STR_LEN 19 /* "255.255.255.255/32" and terminating null */
+
+#define SPACE_FOR_PREFIX 18
+#define SPACE_FOR_COUNT 11
+#define SPACE_FOR_SHARE 7
+
+#ifdef USE_UNICODE
+    #define PIPE "│"
+#else
+    #define PIPE "|"
+#endif
+
+typedef struct hhh_result
+{
+    uint32_t prefix;
+    uint32_t level;
+    uint64_t lower_bound;
+    uint64_t conditioned;
+} hhh_result_t;
+
+static bool space_saving_init(space_saving_t *ss, uint32_t capacity);
+static void space_saving_destroy(space_saving_t *ss);
+static void space_saving_update(space_saving_t *ss, uint32_t prefix, uint64_t weight,
+                                uint64_t error);
+
+static uint32_t hhh_level_mask(uint32_t level)
+{
+    uint32_t bits = HHH_ADDRESS_BITS - level * HHH_BITS_PER_LEVEL;
+
+    if (bits == 0)
+    {
+        return 0;
+    }
+
+    return UINT32_MAX << (HHH_ADDRESS_BITS - bits);
+}
+
+static uint32_t hhh_address_to_u32(const ip_addr_t *ip)
+{
+    return ((uint32_t)ip->byte[0] << 24) | ((uint32_t)ip->byte[1] << 16) |
+           ((uint32_t)ip->byte[2] << 8) | (uint32_t)ip->byte[3];
+}
+
+static uint64_t hhh_next_random(hhh_t *hhh)
+{
+    /* xorshift64* */
+    hhh->random_state ^= hhh->random_state >> 12;
+    hhh->random_state ^= hhh->random_state << 25;
+    hhh->random_state ^= hhh->random_state >> 27;
+
+    return hhh->random_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t space_saving_home_slot(const space_saving_t *ss, uint32_t prefix)
+{
+    return (uint32_t)(((uint64_t)prefix * HHH_GOLDEN_RATIO) >> 32) & ss->index_mask;
+}
+
+static void space_saving_swap(space_saving_t *ss, uint32_t a, uint32_t b)
+{
+    space_saving_entry_t temp = ss->heap[a];
+
+    ss->heap[a] = ss->heap[b];
+    ss->heap[b] = temp;
+    ss->index[ss->heap[a].slot] = a + 1;
+    ss->index[ss->heap[b].slot] = b + 1;
+}
+
+static void space_saving_sift_up(space_saving_t *ss, uint32_t pos)
+{
+    uint32_t parent = 0;
+
+    while (pos > 0)
+    {
+        parent = (pos - 1) / 2;
+
+        if (ss->heap[parent].count <= ss->heap[pos].count)
+        {
+            break;
+        }
+
+        space_saving_swap(ss, parent, pos);
+        pos = parent;
+    }
+}
+
+static void space_saving_sift_down(space_saving_t *ss, uint32_t pos)
+{
+    uint32_t child = 0;
+
+    while ((child = pos * 2 + 1) < ss->size)
+    {
+        if (child + 1 < ss->size && ss->heap[child + 1].count < ss->heap[child].count)
+        {
+            child++;
+        }
+
+        if (ss->heap[pos].count <= ss->heap[child].count)
+        {
+            break;
+        }
+
+        space_saving_swap(ss, pos, child);
+        pos = child;
+    }
+}
+
+/* Returns the index slot holding prefix, or the empty slot where it would be inserted */
+static uint32_t space_saving_find_slot(const space_saving_t *ss, uint32_t prefix)
+{
+    uint32_t slot = space_saving_home_slot(ss, prefix);
+
+    while (ss->index[slot] != 0 && ss->heap[ss->index[slot] - 1].prefix != prefix)
+    {
+        slot = (slot + 1) & ss->index_mask;
+    }
+
+    return slot;
+}
+
+/* Backward shift deletion, keeps probe sequences intact without tombstones */
+static void space_saving_index_remove(space_saving_t *ss, uint32_t slot)
+{
+    uint32_t next = slot;
+    uint32_t home = 0;
+
+    ss->index[slot] = 0;
+
+    while (true)
+    {
+        next = (next + 1) & ss->index_mask;
+
+        if (ss->index[next] == 0)
+        {
+            break;
+        }
+
+        home = space_saving_home_slot(ss, ss->heap[ss->index[next] - 1].prefix);
+
+        /* Move the entry back only if its home slot is not between the hole and its position */
+        if (((next - home) & ss->index_mask) >= ((next - slot) & ss->index_mask))
+        {
+            ss->index[slot] = ss->index[next];
+            ss->heap[ss->index[slot] - 1].slot = slot;
+            ss->index[next] = 0;
+            slot = next;
+        }
+    }
+}
+
+static bool space_saving_init(space_saving_t *ss, uint32_t capacity)
+{
+    uint32_t index_size = 1;
+
+    while (index_size < capacity * 2)
+    {
+        index_size <<= 1;
+    }
+
+    ss->heap = (space_saving_entry_t *)calloc(capacity, sizeof(space_saving_entry_t));
+    ss->index = (uint32_t *)calloc(index_size, sizeof(uint32_t));
+
+    if (ss->heap == NULL || ss->index == NULL)
+    {
+        space_saving_destroy(ss);
+
+        return false;
+    }
+
+    ss->capacity = capacity;
+    ss->size = 0;
+    ss->index_mask = index_size - 1;
+
+    return true;
+}
+
+static void space_saving_destroy(space_saving_t *ss)
+{
+    free(ss->heap);
+    ss->heap = NULL;
+
+    free(ss->index);
+    ss->index = NULL;
+
+    ss->capacity = 0;
+    ss->size = 0;
+}
+
+/* Adds weight to the prefix. error is how much of weight may be overestimated, 0 for packets */
+static void space_saving_update(space_saving_t *ss, uint32_t prefix, uint64_t weight,
+                                uint64_t error)
+{
+    uint32_t slot = 0;
+    uint32_t pos = 0;
+
+    slot = space_saving_find_slot(ss, prefix);
+
+    if (ss->index[slot] != 0)
+    {
+        pos = ss->index[slot] - 1;
+        ss->heap[pos].count += weight;
+        ss->heap[pos].error += error;
+        space_saving_sift_down(ss, pos);
+
+        return;
+    }
+
+    if (ss->size < ss->capacity)
+    {
+        pos = ss->size++;
+        ss->heap[pos].prefix = prefix;
+        ss->heap[pos].slot = slot;
+        ss->heap[pos].count = weight;
+        ss->heap[pos].error = error;
+        ss->index[slot] = pos + 1;
+        space_saving_sift_up(ss, pos);
+
+        return;
+    }
+
+    /* Table is full, the least counted prefix is replaced and inherits its count as error */
+    space_saving_index_remove(ss, ss->heap[0].slot);
+    slot = space_saving_find_slot(ss, prefix);
+
+    ss->heap[0].prefix = prefix;
+    ss->heap[0].slot = slot;
+    ss->heap[0].error = ss->heap[0].count + error;
+    ss->heap[0].count += weight;
+    ss->index[slot] = 1;
+    space_saving_sift_down(ss, 0);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       hhh_create
+ *
+ *   Input:      counters     Number of Space-Saving counters kept for every prefix level
+ *
+ *   Return:     Success      A pointer to the newly created hhh_t
+ *               Failed       NULL
+ *
+ *   Description:            Creates a randomized hierarchical heavy hitter detector (RHHH)
+ *                           over source and destination prefixes. Memory is bounded by
+ *                           the number of counters, independent of the number of flows.
+ ******************************************************************************/
+hhh_t *hhh_create(uint32_t counters)
+{
+    hhh_t *hhh = NULL;
+    uint32_t dimension = 0;
+    uint32_t level = 0;
+
+    if (counters == 0)
+    {
+        return NULL;
+    }
+
+    hhh = (hhh_t *)calloc(1, sizeof(hhh_t));
+
+    if (hhh == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for hierarchical heavy hitters.\n");
+
+        return NULL;
+    }
+
+    hhh->random_state = HHH_RANDOM_SEED;
+
+    for (dimension = 0; dimension < HHH_DIMENSIONS; dimension++)
+    {
+        for (level = 0; level < HHH_LEVELS; level++)
+        {
+            if (!space_saving_init(&hhh->levels[dimension][level], counters))
+            {
+                fprintf(stderr, "Unable to allocate memory for Space-Saving counters.\n");
+                hhh_free(&hhh);
+
+                return NULL;
+            }
+        }
+    }
+
+    return hhh;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       hhh_update
+ *
+ *   Input:      hhh          Detector to update
+ *               src          Source address of the packet
+ *               dest         Destination address of the packet
+ *
+ *   Return:     None
+ *
+ *   Description:            Counts one packet. As in RHHH, only one randomly chosen
+ *                           prefix level is updated per dimension, so the cost per
+ *                           packet is constant regardless of the hierarchy depth.
+ ******************************************************************************/
+void hhh_update(hhh_t *hhh, const ip_addr_t *src, const ip_addr_t *dest)
+{
+    uint64_t random = 0;
+    uint32_t level = 0;
+
+    if (hhh == NULL || src == NULL || dest == NULL)
+    {
+        return;
+    }
+
+    random = hhh_next_random(hhh);
+    hhh->total++;
+
+    level = (uint32_t)(random & UINT32_MAX) % HHH_LEVELS;
+    space_saving_update(&hhh->levels[HHH_SOURCE][level],
+                        hhh_address_to_u32(src) & hhh_level_mask(level), 1, 0);
+
+    level = (uint32_t)(random >> 32) % HHH_LEVELS;
+    space_saving_update(&hhh->levels[HHH_DESTINATION][level],
+                        hhh_address_to_u32(dest) & hhh_level_mask(level), 1, 0);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       hhh_merge
+ *
+ *   Input:      hhh          Detector receiving the counts
+ *               other        Detector whose counts are added, left unchanged
+ *
+ *   Return:     None
+ *
+ *   Description:            Folds the counters of other into hhh level by level, as a
+ *                           weighted Space-Saving update that also carries the error of
+ *                           every counter. A prefix kept by both sums both errors, and one
+ *                           that replaces a counter adds the replaced count to its own.
+ ******************************************************************************/
+void hhh_merge(hhh_t *hhh, hhh_t *other)
+{
+    uint32_t dimension = 0;
+    uint32_t level = 0;
+    uint32_t i = 0;
+    space_saving_t *ss = NULL;
+
+    if (hhh == NULL || other == NULL)
+    {
+        return;
+    }
+
+    for (dimension = 0; dimension < HHH_DIMENSIONS; dimension++)
+    {
+        for (level = 0; level < HHH_LEVELS; level++)
+        {
+            ss = &other->levels[dimension][level];
+
+            for (i = 0; i < ss->size; i++)
+            {
+                space_saving_update(&hhh->levels[dimension][level], ss->heap[i].prefix,
+                                    ss->heap[i].count, ss->heap[i].error);
+            }
+        }
+    }
+
+    hhh->total += other->total;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       hhh_free
+ *
+ *   Input:      hhh_p        A pointer to a pointer to the detector to be freed
+ *
+ *   Return:     None
+ *
+ *   Description:            Frees all counters of the detector and sets the pointer to NULL.
+ ******************************************************************************/
+void hhh_free(hhh_t **hhh_p)
+{
+    uint32_t dimension = 0;
+    uint32_t level = 0;
+
+    if (hhh_p == NULL || *hhh_p == NULL)
+    {
+        return;
+    }
+
+    for (dimension = 0; dimension < HHH_DIMENSIONS; dimension++)
+    {
+        for (level = 0; level < HHH_LEVELS; level++)
+        {
+            space_saving_destroy(&(*hhh_p)->levels[dimension][level]);
+        }
+    }
+
+    free(*hhh_p);
+    *hhh_p = NULL;
+
+    return;
+}
+
+/* True if descendant (at descendant_level) lies under ancestor (at ancestor_level) */
+static bool hhh_is_under(uint32_t descendant, uint32_t descendant_level, uint32_t ancestor,
+                         uint32_t ancestor_level)
+{
+    return descendant_level < ancestor_level &&
+           (descendant & hhh_level_mask(ancestor_level)) == ancestor;
+}
+
+/**
+ * Conditioned frequency of a prefix: its estimated count minus the counts of the heavy
+ * hitters already found below it, skipping those that are covered by a closer heavy hitter.
+ * */
+static uint64_t hhh_conditioned_count(hhh_result_t *results, uint32_t result_count,
+                                      uint32_t prefix, uint32_t level, uint64_t estimate)
+{
+    uint32_t i = 0;
+    uint32_t j = 0;
+    uint64_t children = 0;
+    bool covered = false;
+
+    for (i = 0; i < result_count; i++)
+    {
+        if (!hhh_is_under(results[i].prefix, results[i].level, prefix, level))
+        {
+            continue;
+        }
+
+        covered = false;
+
+        for (j = 0; j < result_count && !covered; j++)
+        {
+            covered = hhh_is_under(results[j].prefix, results[j].level, prefix, level) &&
+                      hhh_is_under(results[i].prefix, results[i].level, results[j].prefix,
+                                   results[j].level);
+        }
+
+        if (!covered)
+        {
+            children += results[i].lower_bound;
+        }
+    }
+
+    return (children >= estimate) ? 0 : estimate - children;
+}
+
+static int hhh_result_compare(const void *a, const void *b)
+{
+    const hhh_result_t *left = (const hhh_result_t *)a;
+    const hhh_result_t *right = (const hhh_result_t *)b;
+
+    if (left->level != right->level)
+    {
+        return (left->level < right->level) ? -1 : 1;
+    }
+
+    if (left->conditioned != right->conditioned)
+    {
+        return (left->conditioned > right->conditioned) ? -1 : 1;
+    }
+
+    return (left->prefix < right->prefix) ? -1 : (left->prefix > right->prefix);
+}
+
+static void print_hhh_dimension(FILE *stream, hhh_t *hhh, hhh_dimension_t dimension,
+                                double threshold)
+{
+    uint32_t level = 0;
+    uint32_t i = 0;
+    uint32_t result_count = 0;
+    uint32_t result_capacity = 0;
+    uint64_t estimate = 0;
+    uint64_t conditioned = 0;
+    uint32_t addr = 0;
+    char prefix_str[HHH_PREFIX_STR_LEN] = {0};
+    hhh_result_t *results = NULL;
+    space_saving_t *ss = NULL;
+
+    for (level = 0; level < HHH_LEVELS; level++)
+    {
+        result_capacity += hhh->levels[dimension][level].size;
+    }
+
+    results = (hhh_result_t *)calloc(result_capacity + 1, sizeof(hhh_result_t));
+
+    if (results == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for heavy hitter report.\n");
+
+        return;
+    }
+
+    for (level = 0; level < HHH_LEVELS; level++)
+    {
+        ss = &hhh->levels[dimension][level];
+
+        for (i = 0; i < ss->size; i++)
+        {
+            /* Every level sees 1 / HHH_LEVELS of the packets */
+            estimate = ss->heap[i].count * HHH_LEVELS;
+            conditioned = hhh_conditioned_count(results, result_count, ss->heap[i].prefix, level,
+                                                estimate);
+
+            if ((double)conditioned < threshold * (double)hhh->total)
+            {
+                continue;
+            }
+
+            results[result_count].prefix = ss->heap[i].prefix;
+            results[result_count].level = level;
+            results[result_count].lower_bound =
+                (ss->heap[i].count - ss->heap[i].error) * HHH_LEVELS;
+            results[result_count].conditioned = conditioned;
+            result_count++;
+        }
+    }
+
+    qsort(results, result_count, sizeof(hhh_result_t), hhh_result_compare);
+
+#ifdef USE_UNICODE
+    fprintf(stream, "┌─────────────────────────────────────────────────────┐\n");
+    fprintf(stream, "│ %-51s │\n",
+            (dimension == HHH_SOURCE) ? "     Hierarchical Heavy Hitters (Source)"
+                                      : "   Hierarchical Heavy Hitters (Destination)");
+    fprintf(stream, "├────────────────────┬─────────────┬─────────┬────────┤\n");
+    fprintf(stream, "│       Prefix       │ Conditioned │  Share  │ Level  │\n");
+    fprintf(stream, "├────────────────────┼─────────────┼─────────┼────────┤\n");
+#else
+    fprintf(stream, "+=====================================================+\n");
+    fprintf(stream, "| %-51s |\n",
+            (dimension == HHH_SOURCE) ? "     Hierarchical Heavy Hitters (Source)"
+                                      : "   Hierarchical Heavy Hitters (Destination)");
+    fprintf(stream, "+--------------------+-------------+---------+--------+\n");
+    fprintf(stream, "|       Prefix       | Conditioned |  Share  | Level  |\n");
+    fprintf(stream, "+--------------------+-------------+---------+--------+\n");
+#endif
+
+    for (i = 0; i < result_count; i++)
+    {
+        addr = results[i].prefix;
+        snprintf(prefix_str, sizeof(prefix_str), "%u.%u.%u.%u/%u", (addr >> 24) & 0xFF,
+                 (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF,
+                 HHH_ADDRESS_BITS - results[i].level * HHH_BITS_PER_LEVEL);
+        fprintf(stream,
+                PIPE " %-*s " PIPE " %*" PRIu64 " " PIPE " %*.2f%% " PIPE " %6u " PIPE "\n",
+                SPACE_FOR_PREFIX, prefix_str, SPACE_FOR_COUNT, results[i].conditioned,
+                SPACE_FOR_SHARE - 1,
+                (hhh->total == 0) ? 0.0 : 100.0 * results[i].conditioned / hhh->total,
+                results[i].level);
+    }
+
+#ifdef USE_UNICODE
+    fprintf(stream, "└────────────────────┴─────────────┴─────────┴────────┘\n");
+#else
+    fprintf(stream, "+--------------------+-------------+---------+--------+\n");
+#endif
+
+    free(results);
+    results = NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       print_hhh
+ *
+ *   Input:      stream       Stream to print to
+ *               hhh          Detector to report
+ *               threshold    Minimum share of the traffic (0 to 1) for a prefix to be
+ *                            reported after subtracting its heavy children
+ *
+ *   Return:     None
+ *
+ *   Description:            Prints the hierarchical heavy hitters of both dimensions,
+ *                           from the most specific prefixes up to the root.
+ ******************************************************************************/
+void print_hhh(FILE *stream, hhh_t *hhh, double threshold)
+{
+    if (hhh == NULL)
+    {
+        fprintf(stream, "No data.\n");
+
+        return;
+    }
+
+    print_hhh_dimension(stream, hhh, HHH_SOURCE, threshold);
+    print_hhh_dimension(stream, hhh, HHH_DESTINATION, threshold);
+    fprintf(stream, "Heavy hitters estimated from %" PRIu64 " packets.\n", hhh->total);
+
+    return;
+}
@@ -0,0 +1,228 @@
+#define _GNU_SOURCE
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "huge-alloc.h"
+
+#define HUGE_ALLOC_MAPPED(bytes) ((bytes) >= HUGE_ALLOC_THRESHOLD)
+#define HUGE_ALLOC_ROUND(bytes) (((bytes) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1))
+
+static const char *const path_names[HUGE_ALLOC_PATHS] = {"MAP_HUGETLB", "MADV_HUGEPAGE",
+                                                         "calloc"};
+
+static atomic_uint_fast64_t allocations[HUGE_ALLOC_PATHS];
+static atomic_uint_fast64_t allocated_bytes[HUGE_ALLOC_PATHS];
+
+/* Huge page pool first, then a 2 MB aligned mapping for transparent huge pages */
+static void *huge_map(size_t bytes)
+{
+    uint8_t *region = NULL;
+    uint8_t *aligned = NULL;
+    size_t length = HUGE_ALLOC_ROUND(bytes);
+
+    region = (uint8_t *)mmap(NULL, length, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (region != MAP_FAILED)
+    {
+        atomic_fetch_add(&allocations[HUGE_ALLOC_HUGETLB], 1);
+        atomic_fetch_add(&allocated_bytes[HUGE_ALLOC_HUGETLB], length);
+
+        return region;
+    }
+
+    /* Over-map by one huge page and trim, so the region starts on a huge page boundary */
+    region = (uint8_t *)mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (region == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    aligned = (uint8_t *)(((uintptr_t)region + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+
+    if (aligned != region)
+    {
+        munmap(region, (size_t)(aligned - region));
+    }
+
+    munmap(aligned + length, HUGE_PAGE_SIZE - (size_t)(aligned - region));
+    madvise(aligned, length, MADV_HUGEPAGE); /* only a hint, THP may be disabled */
+
+    atomic_fetch_add(&allocations[HUGE_ALLOC_THP], 1);
+    atomic_fetch_add(&allocated_bytes[HUGE_ALLOC_THP], length);
+
+    return aligned;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       huge_calloc
+ *
+ *   Input:      site         Allocation site, used for arrays below the threshold
+ *               count        Number of elements
+ *               size         Size of every element
+ *
+ *   Return:     Success      Zeroed memory for count elements
+ *               Failed       NULL
+ *
+ *   Description:            Allocates an array, from huge pages if it is large enough.
+ *                           Release it with huge_free and the same size.
+ ******************************************************************************/
+void *huge_calloc(alloc_site_t site, size_t count, size_t size)
+{
+    void *ptr = NULL;
+
+    (void)site; /* only used when allocations are tracked */
+
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+
+    if (!HUGE_ALLOC_MAPPED(count * size))
+    {
+        ptr = track_calloc(site, count, size);
+
+        if (ptr != NULL)
+        {
+            atomic_fetch_add(&allocations[HUGE_ALLOC_SMALL], 1);
+            atomic_fetch_add(&allocated_bytes[HUGE_ALLOC_SMALL], count * size);
+        }
+
+        return ptr;
+    }
+
+    return huge_map(count * size); /* anonymous mappings are zeroed */
+}
+
+/*****************************************************************************
+ *
+ *   Name:       huge_realloc
+ *
+ *   Input:      site         Allocation site, used for arrays below the threshold
+ *               ptr          Array from huge_calloc or huge_realloc, can be NULL
+ *               old_size     Bytes ptr was allocated with
+ *               new_size     Bytes wanted
+ *
+ *   Return:     Success      The resized array, bytes past old_size are not initialized
+ *               Failed       NULL, ptr is left as it was
+ *
+ *   Description:            Resizes an array like realloc. Arrays crossing the threshold
+ *                           move between calloc and huge pages.
+ ******************************************************************************/
+void *huge_realloc(alloc_site_t site, void *ptr, size_t old_size, size_t new_size)
+{
+    void *new_ptr = NULL;
+
+    if (ptr == NULL)
+    {
+        return huge_calloc(site, 1, new_size);
+    }
+
+    if (!HUGE_ALLOC_MAPPED(old_size) && !HUGE_ALLOC_MAPPED(new_size))
+    {
+        new_ptr = track_realloc(site, ptr, new_size);
+
+        if (new_ptr != NULL && new_size > old_size)
+        {
+            atomic_fetch_add(&allocated_bytes[HUGE_ALLOC_SMALL], new_size - old_size);
+        }
+
+        return new_ptr;
+    }
+
+    if (HUGE_ALLOC_MAPPED(old_size) && HUGE_ALLOC_MAPPED(new_size) &&
+        HUGE_ALLOC_ROUND(old_size) == HUGE_ALLOC_ROUND(new_size))
+    {
+        return ptr; /* still fits in the huge pages it has */
+    }
+
+    new_ptr = huge_calloc(site, 1, new_size);
+
+    if (new_ptr == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(new_ptr, ptr, (old_size < new_size) ? old_size : new_size);
+    huge_free(site, ptr, old_size);
+
+    return new_ptr;
+}
+
+void huge_free(alloc_site_t site, void *ptr, size_t size)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    (void)site;
+
+    if (HUGE_ALLOC_MAPPED(size))
+    {
+        munmap(ptr, HUGE_ALLOC_ROUND(size));
+
+        return;
+    }
+
+    track_free(site, ptr);
+
+    return;
+}
+
+void huge_alloc_get_stats(huge_alloc_stats_t *stats)
+{
+    uint32_t i = 0;
+
+    if (stats == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < HUGE_ALLOC_PATHS; i++)
+    {
+        stats->allocations[i] = atomic_load(&allocations[i]);
+        stats->bytes[i] = atomic_load(&allocated_bytes[i]);
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       print_huge_alloc_stats
+ *
+ *   Input:      stream       Where to print
+ *
+ *   Return:     None
+ *
+ *   Description:            Prints how many table arrays and bytes every path allocated,
+ *                           to tell whether huge pages were used.
+ ******************************************************************************/
+void print_huge_alloc_stats(FILE *stream)
+{
+    huge_alloc_stats_t stats;
+    uint32_t i = 0;
+
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    huge_alloc_get_stats(&stats);
+    fprintf(stream, "Table arrays   Allocations        Bytes\n");
+
+    for (i = 0; i < HUGE_ALLOC_PATHS; i++)
+    {
+        fprintf(stream, "  %-13s %11" PRIu64 " %12" PRIu64 "\n", path_names[i],
+                stats.allocations[i], stats.bytes[i]);
+    }
+
+    return;
+}
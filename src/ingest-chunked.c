@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ingest-chunked.h"
+#include "pcap-file.h"
+#include "wireshark-to-buffer.h"
+#include "work-pool.h"
+
+#define STAT_OK 0
+
+struct chunked_run;
+
+/* A packet range of one file, and later the partial counts it holds while being merged */
+typedef struct ingest_chunk
+{
+    struct chunked_run *run;
+    size_t path_index;
+    long start;                       /* raw bounds, aligned to packets by the task */
+    long end;
+    packet_counter_t *counter;
+    hhh_t *hhh;
+    struct ingest_chunk *merge_from;  /* partial counts to merge into this chunk */
+} ingest_chunk_t;
+
+typedef struct chunked_run
+{
+    char *const *paths;
+    const ingest_config_t *config;  /* verbose output disabled, ranges would interleave */
+    bool heavy_hitters;
+    uint64_t chunk_entries;         /* flow limit of a partial counter */
+    ingest_stats_t *stats;          /* per file statistics, indexed like paths */
+    pthread_mutex_t lock;           /* protects stats, success and unmerged */
+    ingest_chunk_t *unmerged;       /* partial counts waiting for a merge partner */
+    bool success;
+} chunked_run_t;
+
+typedef struct chunked_file
+{
+    long size;       /* -1 if the file could not be read */
+    long range_size; /* bytes per range of this file */
+} chunked_file_t;
+
+static void ingest_chunk_merge_task(work_pool_t *pool, unsigned worker, void *arg);
+
+static void ingest_chunk_release(ingest_chunk_t *chunk)
+{
+    packet_counter_free(&chunk->counter);
+    hhh_free(&chunk->hhh);
+}
+
+/* Pairs finished partial counts up, so that merges run on whichever worker is free */
+static void ingest_chunk_done(work_pool_t *pool, unsigned worker, ingest_chunk_t *chunk)
+{
+    chunked_run_t *run = chunk->run;
+    ingest_chunk_t *partner = NULL;
+
+    pthread_mutex_lock(&run->lock);
+
+    if (run->unmerged == NULL)
+    {
+        run->unmerged = chunk;
+    }
+    else
+    {
+        partner = run->unmerged;
+        run->unmerged = NULL;
+    }
+
+    pthread_mutex_unlock(&run->lock);
+
+    if (partner == NULL)
+    {
+        return;
+    }
+
+    chunk->merge_from = partner;
+
+    if (!work_pool_submit(pool, (int)worker, ingest_chunk_merge_task, chunk))
+    {
+        ingest_chunk_merge_task(pool, worker, chunk);
+    }
+}
+
+static void ingest_chunk_merge_task(work_pool_t *pool, unsigned worker, void *arg)
+{
+    ingest_chunk_t *chunk = (ingest_chunk_t *)arg;
+
+    packet_counter_merge(chunk->counter, chunk->merge_from->counter);
+    hhh_merge(chunk->hhh, chunk->merge_from->hhh);
+    ingest_chunk_release(chunk->merge_from);
+    chunk->merge_from = NULL;
+
+    ingest_chunk_done(pool, worker, chunk);
+}
+
+static void ingest_chunk_task(work_pool_t *pool, unsigned worker, void *arg)
+{
+    ingest_chunk_t *chunk = (ingest_chunk_t *)arg;
+    chunked_run_t *run = chunk->run;
+    wireshark_file_t *ws_file = NULL;
+    ingest_stats_t chunk_stats = {0};
+    long start = -1;
+    long end = -1;
+    bool success = false;
+
+    ws_file = wireshark_file_create(run->paths[chunk->path_index]);
+
+    if (ws_file != NULL)
+    {
+        /* Neighbouring ranges align the bound they share the same way */
+        start = wireshark_file_packet_start(ws_file, chunk->start);
+        end = wireshark_file_packet_start(ws_file, chunk->end);
+        wireshark_file_free(&ws_file);
+    }
+
+    chunk->counter = packet_counter_create();
+    chunk->hhh = run->heavy_hitters ? hhh_create(HHH_DEFAULT_COUNTERS) : NULL;
+
+    if (start >= 0 && end >= 0 && chunk->counter != NULL &&
+        (!run->heavy_hitters || chunk->hhh != NULL))
+    {
+        packet_counter_set_limit(chunk->counter, run->chunk_entries, run->config->overflow_sink,
+                                 run->config->overflow_context);
+        success = (start >= end) || ingest_file_range(run->paths[chunk->path_index], start, end,
+                                                      run->config, chunk->counter, chunk->hhh,
+                                                      &chunk_stats);
+    }
+
+    pthread_mutex_lock(&run->lock);
+    run->stats[chunk->path_index].packet_total += chunk_stats.packet_total;
+    run->stats[chunk->path_index].packet_valid += chunk_stats.packet_valid;
+    run->success = run->success && success;
+    pthread_mutex_unlock(&run->lock);
+
+    if (chunk->counter == NULL || (run->heavy_hitters && chunk->hhh == NULL))
+    {
+        fprintf(stderr, "Unable to create counter for chunk of %s.\n",
+                run->paths[chunk->path_index]);
+        ingest_chunk_release(chunk);
+
+        return;
+    }
+
+    ingest_chunk_done(pool, worker, chunk);
+}
+
+/* Number of ranges a file is split into, 0 for a file that could not be read */
+static size_t ingest_chunk_count(const char *path, uint64_t chunk_size, chunked_file_t *file)
+{
+    struct stat file_stat;
+
+    if (stat(path, &file_stat) != STAT_OK)
+    {
+        fprintf(stderr, "Error opening file for reading: %s\n", path);
+        file->size = -1;
+
+        return 0;
+    }
+
+    file->size = (long)file_stat.st_size;
+    file->range_size = (long)chunk_size;
+
+    if (pcap_file_probe(path))
+    {
+        /* pcap records can not be found from an arbitrary offset, the file is one range */
+        file->range_size = (file->size > 0) ? file->size : 1;
+    }
+
+    return (size_t)((file->size + file->range_size - 1) / file->range_size);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_chunked_files
+ *
+ *   Input:      paths        Wireshark capture files to read
+ *               count        Number of files
+ *               config       Ingest options, chunk_size gives the range size
+ *               counter      Counter receiving the merged counts of all files
+ *               hhh          Detector receiving the merged heavy hitters, can be NULL
+ *   Output:     stats        Per file statistics, an array of count elements
+ *
+ *   Return:     Success      true
+ *               Failed       false if a file could not be read
+ *
+ *   Description:            Splits every file into byte ranges of chunk_size and counts
+ *                           each range as a task of a work stealing pool. Ranges holding
+ *                           large or many invalid packets take longer, and idle workers
+ *                           steal the remaining ones. Finished partial counts are merged
+ *                           pairwise by merge tasks on the same pool, and the last one
+ *                           into counter.
+ ******************************************************************************/
+bool ingest_chunked_files(char *const *paths, size_t count, const ingest_config_t *config,
+                          packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats)
+{
+    chunked_run_t run = {0};
+    ingest_config_t range_config = {0};
+    ingest_metrics_delta_t delta = {0};
+    work_pool_t *pool = NULL;
+    ingest_chunk_t *chunks = NULL;
+    chunked_file_t *files = NULL;
+    size_t chunk_count = 0;
+    size_t chunk = 0;
+    size_t worker_count = 0;
+    size_t i = 0;
+    long offset = 0;
+    bool success = true;
+
+    if (paths == NULL || count == 0 || config == NULL || counter == NULL || stats == NULL ||
+        config->chunk_size == 0)
+    {
+        return false;
+    }
+
+    files = (chunked_file_t *)calloc(count, sizeof(chunked_file_t));
+
+    if (files == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for chunks.\n");
+
+        return false;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        chunk_count += ingest_chunk_count(paths[i], config->chunk_size, &files[i]);
+        success = success && files[i].size >= 0;
+    }
+
+    worker_count = (config->jobs != 0) ? config->jobs : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = (worker_count == 0) ? 1 : worker_count;
+
+    chunks = (ingest_chunk_t *)calloc(chunk_count + 1, sizeof(ingest_chunk_t));
+    pool = work_pool_create((unsigned)worker_count, config->cpus);
+
+    if (chunks == NULL || pool == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for chunks.\n");
+        success = false;
+        goto cleanup;
+    }
+
+    range_config = *config;
+    range_config.verbose = false;
+
+    run.paths = paths;
+    run.config = &range_config;
+    run.heavy_hitters = (hhh != NULL);
+    /* The flow limit is shared by the workers, each partial counter keeps its part of it */
+    run.chunk_entries = (config->max_entries + worker_count - 1) / worker_count;
+    run.stats = stats;
+    run.success = true;
+    pthread_mutex_init(&run.lock, NULL);
+
+    ingest_metrics_publish(config->metrics, &delta, counter->flow_count - counter->holes,
+                           counter->index->capacity);
+
+    for (i = 0; i < count; i++)
+    {
+        for (offset = 0; offset < files[i].size; offset += files[i].range_size)
+        {
+            chunks[chunk].run = &run;
+            chunks[chunk].path_index = i;
+            chunks[chunk].start = offset;
+            chunks[chunk].end = offset + files[i].range_size;
+            chunks[chunk].end = (chunks[chunk].end > files[i].size) ? files[i].size
+                                                                    : chunks[chunk].end;
+
+            /* Spread round robin, so every worker starts with local work */
+            if (!work_pool_submit(pool, -1, ingest_chunk_task, &chunks[chunk]))
+            {
+                run.success = false;
+            }
+
+            chunk++;
+        }
+    }
+
+    if (!work_pool_run(pool))
+    {
+        run.success = false;
+    }
+
+    if (run.unmerged != NULL)
+    {
+        packet_counter_merge(counter, run.unmerged->counter);
+        hhh_merge(hhh, run.unmerged->hhh);
+        ingest_chunk_release(run.unmerged);
+    }
+
+    ingest_metrics_set_table(config->metrics, counter->flow_count - counter->holes,
+                             counter->index->capacity);
+
+    pthread_mutex_destroy(&run.lock);
+    success = success && run.success;
+
+cleanup:
+    work_pool_free(&pool);
+    free(chunks);
+    chunks = NULL;
+    free(files);
+    files = NULL;
+
+    return success;
+}
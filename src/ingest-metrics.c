@@ -0,0 +1,392 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "ingest-metrics.h"
+
+#define TEMP_SUFFIX ".tmp"
+#define RENAME_OK 0
+
+static const char *const invalid_reason_names[INGEST_INVALID_REASONS] = {
+    "ethernet",
+    "non_ipv4",
+    "ipv4_malformed",
+    "non_udp",
+};
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_metrics_create
+ *
+ *   Input:      None
+ *
+ *   Return:     Success      A pointer to zeroed metrics
+ *               Failed       NULL
+ *
+ *   Description:            Creates the counts shared by all ingest workers of a run.
+ ******************************************************************************/
+ingest_metrics_t *ingest_metrics_create(void)
+{
+    ingest_metrics_t *metrics = NULL;
+    uint32_t i = 0;
+
+    metrics = (ingest_metrics_t *)malloc(sizeof(ingest_metrics_t));
+
+    if (metrics == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for ingest metrics.\n");
+
+        return NULL;
+    }
+
+    atomic_init(&metrics->packets_read, 0);
+    atomic_init(&metrics->packets_valid, 0);
+    atomic_init(&metrics->bytes_read, 0);
+    atomic_init(&metrics->flows, 0);
+    atomic_init(&metrics->table_capacity, 0);
+
+    for (i = 0; i < INGEST_INVALID_REASONS; i++)
+    {
+        atomic_init(&metrics->invalid[i], 0);
+    }
+
+    return metrics;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_metrics_publish
+ *
+ *   Input:      metrics          Shared metrics, can be NULL
+ *               delta            Counts of one worker since its last publish
+ *               flows            Live flows in the worker counter
+ *               table_capacity   Hash table buckets of the worker counter
+ *
+ *   Return:     None
+ *
+ *   Description:            Adds the worker counts to the shared metrics and clears them.
+ *                           Workers publish every few packets so that the hot loop does not
+ *                           touch shared cache lines for every packet.
+ ******************************************************************************/
+void ingest_metrics_publish(ingest_metrics_t *metrics, ingest_metrics_delta_t *delta,
+                            uint64_t flows, uint64_t table_capacity)
+{
+    uint32_t i = 0;
+
+    if (metrics == NULL || delta == NULL)
+    {
+        return;
+    }
+
+    atomic_fetch_add_explicit(&metrics->packets_read, delta->packets_read, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metrics->packets_valid, delta->packets_valid, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metrics->bytes_read, delta->bytes_read, memory_order_relaxed);
+
+    for (i = 0; i < INGEST_INVALID_REASONS; i++)
+    {
+        atomic_fetch_add_explicit(&metrics->invalid[i], delta->invalid[i], memory_order_relaxed);
+        delta->invalid[i] = 0;
+    }
+
+    atomic_fetch_add_explicit(&metrics->flows, (int_fast64_t)(flows - delta->flows),
+                              memory_order_relaxed);
+    atomic_fetch_add_explicit(&metrics->table_capacity,
+                              (int_fast64_t)(table_capacity - delta->table_capacity),
+                              memory_order_relaxed);
+
+    delta->packets_read = 0;
+    delta->packets_valid = 0;
+    delta->bytes_read = 0;
+    delta->flows = flows;
+    delta->table_capacity = table_capacity;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_metrics_set_table
+ *
+ *   Input:      metrics          Shared metrics, can be NULL
+ *               flows            Live flows in the final counter
+ *               table_capacity   Hash table buckets of the final counter
+ *
+ *   Return:     None
+ *
+ *   Description:            Replaces the summed worker table gauges once the worker
+ *                           counters have been merged into the final counter.
+ ******************************************************************************/
+void ingest_metrics_set_table(ingest_metrics_t *metrics, uint64_t flows, uint64_t table_capacity)
+{
+    if (metrics == NULL)
+    {
+        return;
+    }
+
+    atomic_store(&metrics->flows, (int_fast64_t)flows);
+    atomic_store(&metrics->table_capacity, (int_fast64_t)table_capacity);
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_metrics_free
+ *
+ *   Input:      metrics_p    A pointer to the metrics to free
+ *
+ *   Return:     None
+ *
+ *   Description:            Frees the metrics and sets the pointer to NULL.
+ ******************************************************************************/
+void ingest_metrics_free(ingest_metrics_t **metrics_p)
+{
+    if (metrics_p == NULL || *metrics_p == NULL)
+    {
+        return;
+    }
+
+    free(*metrics_p);
+    *metrics_p = NULL;
+
+    return;
+}
+
+static void metrics_print(FILE *file, const char *name, const char *type, const char *help,
+                          uint64_t value)
+{
+    fprintf(file, "# HELP %s %s\n# TYPE %s %s\n%s %" PRIu64 "\n", name, help, name, type, name,
+            value);
+}
+
+/* Writes the metrics to the temporary file and renames it, so scrapers never see a partial file */
+static bool metrics_writer_write(metrics_writer_t *writer)
+{
+    ingest_metrics_t *metrics = writer->metrics;
+    FILE *file = NULL;
+    struct timespec now;
+    uint64_t bytes_read = 0;
+    int64_t flows = 0;
+    int64_t table_capacity = 0;
+    double elapsed = 0;
+    double bytes_per_second = 0;
+    uint32_t i = 0;
+    bool success = false;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bytes_read = atomic_load_explicit(&metrics->bytes_read, memory_order_relaxed);
+    flows = atomic_load_explicit(&metrics->flows, memory_order_relaxed);
+    table_capacity = atomic_load_explicit(&metrics->table_capacity, memory_order_relaxed);
+    elapsed = timespec_seconds_between(&writer->last_write, &now);
+
+    if (elapsed > 0)
+    {
+        bytes_per_second = (double)(bytes_read - writer->last_bytes_read) / elapsed;
+    }
+
+    file = fopen(writer->temp_path, "w");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file for writing: %s\n", writer->temp_path);
+
+        return false;
+    }
+
+    metrics_print(file, "packet_counter_packets_read_total", "counter",
+                  "Packets read from capture files.",
+                  atomic_load_explicit(&metrics->packets_read, memory_order_relaxed));
+    metrics_print(file, "packet_counter_packets_valid_total", "counter",
+                  "Valid IPv4 UDP packets counted.",
+                  atomic_load_explicit(&metrics->packets_valid, memory_order_relaxed));
+    fprintf(file, "# HELP packet_counter_packets_invalid_total Packets ignored, by reason.\n"
+                  "# TYPE packet_counter_packets_invalid_total counter\n");
+
+    for (i = 0; i < INGEST_INVALID_REASONS; i++)
+    {
+        fprintf(file, "packet_counter_packets_invalid_total{reason=\"%s\"} %" PRIu64 "\n",
+                invalid_reason_names[i],
+                atomic_load_explicit(&metrics->invalid[i], memory_order_relaxed));
+    }
+
+    metrics_print(file, "packet_counter_input_bytes_total", "counter",
+                  "Bytes of capture files consumed.", bytes_read);
+    fprintf(file, "# HELP packet_counter_input_bytes_per_second Input consumed since the "
+                  "previous write.\n# TYPE packet_counter_input_bytes_per_second gauge\n"
+                  "packet_counter_input_bytes_per_second %.0f\n",
+            bytes_per_second);
+    metrics_print(file, "packet_counter_flows", "gauge", "Flows in the flow tables.",
+                  (flows > 0) ? (uint64_t)flows : 0);
+    metrics_print(file, "packet_counter_table_capacity", "gauge",
+                  "Hash table buckets of the flow tables.",
+                  (table_capacity > 0) ? (uint64_t)table_capacity : 0);
+    fprintf(file, "# HELP packet_counter_table_load Flows per hash table bucket.\n"
+                  "# TYPE packet_counter_table_load gauge\npacket_counter_table_load %.6f\n",
+            (table_capacity > 0) ? (double)flows / (double)table_capacity : 0.0);
+
+    success = (ferror(file) == 0);
+    success = (fclose(file) == 0) && success;
+
+    if (success && rename(writer->temp_path, writer->file_path) != RENAME_OK)
+    {
+        fprintf(stderr, "Unable to rename %s: %s\n", writer->temp_path, strerror(errno));
+        success = false;
+    }
+
+    writer->last_bytes_read = bytes_read;
+    writer->last_write = now;
+
+    return success;
+}
+
+static void *metrics_writer_run(void *arg)
+{
+    metrics_writer_t *writer = (metrics_writer_t *)arg;
+    struct timespec deadline;
+    int wait_result = 0;
+
+    pthread_mutex_lock(&writer->lock);
+
+    while (!writer->stopping)
+    {
+        /* The condition variable clock is CLOCK_REALTIME, only the rate uses CLOCK_MONOTONIC */
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += writer->interval;
+        wait_result = 0;
+
+        while (!writer->stopping && wait_result != ETIMEDOUT)
+        {
+            wait_result = pthread_cond_timedwait(&writer->wakeup, &writer->lock, &deadline);
+        }
+
+        if (!writer->stopping)
+        {
+            pthread_mutex_unlock(&writer->lock);
+            metrics_writer_write(writer);
+            pthread_mutex_lock(&writer->lock);
+        }
+    }
+
+    pthread_mutex_unlock(&writer->lock);
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       metrics_writer_start
+ *
+ *   Input:      file_path    Metrics file in Prometheus text exposition format
+ *               interval     Seconds between two writes, 0 for the default
+ *               metrics      Shared counts to write
+ *
+ *   Return:     Success      A pointer to the running writer
+ *               Failed       NULL
+ *
+ *   Description:            Writes the metrics file once, then starts a thread that
+ *                           rewrites it atomically at every interval, for a node exporter
+ *                           textfile collector.
+ ******************************************************************************/
+metrics_writer_t *metrics_writer_start(const char *file_path, unsigned interval,
+                                       ingest_metrics_t *metrics)
+{
+    metrics_writer_t *writer = NULL;
+
+    if (file_path == NULL || metrics == NULL)
+    {
+        return NULL;
+    }
+
+    writer = (metrics_writer_t *)calloc(1, sizeof(metrics_writer_t));
+
+    if (writer == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for metrics writer.\n");
+
+        return NULL;
+    }
+
+    writer->interval = (interval != 0) ? interval : INGEST_METRICS_DEFAULT_INTERVAL;
+    writer->metrics = metrics;
+    writer->file_path = strdup(file_path);
+
+    if (writer->file_path == NULL || asprintf(&writer->temp_path, "%s" TEMP_SUFFIX, file_path) < 0)
+    {
+        fprintf(stderr, "Unable to allocate memory for metrics file name.\n");
+        writer->temp_path = NULL;
+        goto cleanup;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &writer->last_write);
+
+    /* A scrape before the first interval, or a shorter run, finds the counts of this run */
+    if (!metrics_writer_write(writer))
+    {
+        goto cleanup;
+    }
+
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->wakeup, NULL);
+
+    if (pthread_create(&writer->thread, NULL, metrics_writer_run, writer) != 0)
+    {
+        fprintf(stderr, "Unable to start metrics writer.\n");
+        pthread_cond_destroy(&writer->wakeup);
+        pthread_mutex_destroy(&writer->lock);
+        goto cleanup;
+    }
+
+    return writer;
+
+cleanup:
+    free(writer->temp_path);
+    free(writer->file_path);
+    free(writer);
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       metrics_writer_stop
+ *
+ *   Input:      writer_p     A pointer to the writer to stop
+ *
+ *   Return:     None
+ *
+ *   Description:            Stops the writer thread, writes the final metrics and frees the
+ *                           writer. The pointer is set to NULL.
+ ******************************************************************************/
+void metrics_writer_stop(metrics_writer_t **writer_p)
+{
+    metrics_writer_t *writer = NULL;
+
+    if (writer_p == NULL || *writer_p == NULL)
+    {
+        return;
+    }
+
+    writer = *writer_p;
+
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = true;
+    pthread_cond_signal(&writer->wakeup);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    metrics_writer_write(writer);
+
+    pthread_cond_destroy(&writer->wakeup);
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->temp_path);
+    free(writer->file_path);
+    free(writer);
+    *writer_p = NULL;
+
+    return;
+}
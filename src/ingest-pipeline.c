@@ -0,0 +1,665 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture-file.h"
+#include "ingest-pipeline.h"
+#include "instrument.h"
+#include "packet-arena.h"
+#include "spsc-ring.h"
+
+#define SHARD_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define SHARD_SHIFT 32
+#define PIPELINE_READER_CPU 0 /* position of the reader CPU in config->cpus */
+
+typedef struct pipeline_packet_batch
+{
+    size_t count;
+    dynamic_buffer_t *packets[PIPELINE_BATCH_SIZE];
+} pipeline_packet_batch_t;
+
+typedef struct pipeline_flow
+{
+    ip_addr_t src;
+    ip_addr_t dest;
+} pipeline_flow_t;
+
+typedef struct pipeline_flow_batch
+{
+    size_t count;
+    pipeline_flow_t flows[PIPELINE_BATCH_SIZE];
+} pipeline_flow_batch_t;
+
+struct pipeline;
+
+typedef struct pipeline_decoder
+{
+    pthread_t thread;
+    struct pipeline *pipeline;
+    unsigned index;
+    bool started;
+    uint64_t packet_valid;
+    packet_arena_t *arena;           /* decoded frames of the current batch */
+    pipeline_flow_batch_t **pending; /* partly filled batch for every counter */
+} pipeline_decoder_t;
+
+typedef struct pipeline_counter
+{
+    pthread_t thread;
+    struct pipeline *pipeline;
+    unsigned index;
+    bool started;
+    packet_counter_t *counter; /* flows whose key hashes to this shard, with a flow limit */
+    flow_table_t *table;       /* the same packed, when there is no flow limit */
+    hhh_t *hhh;
+} pipeline_counter_t;
+
+typedef struct pipeline
+{
+    const ingest_config_t *config;
+    unsigned decoder_count;
+    unsigned counter_count;
+    spsc_ring_t **packet_rings; /* reader to decoder d */
+    spsc_ring_t **flow_rings;   /* decoder d to counter c at d * counter_count + c */
+    pipeline_decoder_t *decoders;
+    pipeline_counter_t *counters;
+    atomic_bool failed; /* a decoder or counter lost flows, the reader stops early */
+} pipeline_t;
+
+static spsc_ring_t *pipeline_flow_ring(pipeline_t *pipeline, unsigned decoder, unsigned counter)
+{
+    return pipeline->flow_rings[decoder * pipeline->counter_count + counter];
+}
+
+/* Every flow is counted by one shard only, so the shard counters never share a flow */
+static unsigned pipeline_shard(const pipeline_flow_t *flow, unsigned counter_count)
+{
+    uint64_t key = 0;
+
+    memcpy(&key, flow, sizeof(key));
+
+    return (unsigned)(((key * SHARD_MULTIPLIER) >> SHARD_SHIFT) % counter_count);
+}
+
+static void pipeline_publish(const ingest_config_t *config, ingest_metrics_delta_t *delta)
+{
+    /* Gauges are left alone, only the counter threads publish them */
+    ingest_metrics_publish(config->metrics, delta, delta->flows, delta->table_capacity);
+}
+
+static bool pipeline_push_flow(pipeline_decoder_t *decoder, unsigned shard,
+                               const pipeline_flow_t *flow)
+{
+    pipeline_t *pipeline = decoder->pipeline;
+    pipeline_flow_batch_t *batch = decoder->pending[shard];
+
+    if (batch == NULL)
+    {
+        batch = (pipeline_flow_batch_t *)malloc(sizeof(pipeline_flow_batch_t));
+
+        if (batch == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory for flow batch.\n");
+
+            return false;
+        }
+
+        batch->count = 0;
+        decoder->pending[shard] = batch;
+    }
+
+    batch->flows[batch->count++] = *flow;
+
+    if (batch->count == PIPELINE_BATCH_SIZE)
+    {
+        spsc_ring_push(pipeline_flow_ring(pipeline, decoder->index, shard), batch);
+        decoder->pending[shard] = NULL;
+    }
+
+    return true;
+}
+
+static void *pipeline_decoder_run(void *arg)
+{
+    pipeline_decoder_t *decoder = (pipeline_decoder_t *)arg;
+    pipeline_t *pipeline = decoder->pipeline;
+    spsc_ring_t *input = pipeline->packet_rings[decoder->index];
+    pipeline_packet_batch_t *batch = NULL;
+    ethernet_frame_t *frame = NULL;
+    ipv4_datagram_t *datagram = NULL;
+    ingest_metrics_delta_t delta = {0};
+    pipeline_flow_t flow;
+    unsigned spins = 0;
+    unsigned c = 0;
+    size_t i = 0;
+    bool failed = false;
+
+    /* The reader is pinned first, then the decoders and the counters */
+    cpu_affinity_pin(pipeline->config->cpus, PIPELINE_READER_CPU + 1 + decoder->index);
+
+    while (true)
+    {
+        batch = (pipeline_packet_batch_t *)spsc_ring_try_pop(input);
+
+        if (batch == NULL)
+        {
+            if (spsc_ring_drained(input))
+            {
+                break;
+            }
+
+            spsc_ring_backoff(&spins);
+            continue;
+        }
+
+        spins = 0;
+
+        for (i = 0; i < batch->count; i++)
+        {
+            if (failed)
+            {
+                dynamic_buffer_free(&batch->packets[i]);
+                continue; /* keep draining, so the reader never waits on this decoder */
+            }
+
+            instrument_start(ethernet_start);
+            frame = ethernet_frame_from_dynamic_buffer_arena(batch->packets[i], decoder->arena);
+            instrument_stop(INSTRUMENT_ETHERNET, ethernet_start);
+            dynamic_buffer_free(&batch->packets[i]);
+            instrument_start(ipv4_start);
+            datagram = ipv4_datagram_from_ethernet_frame_arena(frame, decoder->arena);
+            instrument_stop(INSTRUMENT_IPV4, ipv4_start);
+
+            if (datagram != NULL && datagram->header->protocol == IPV4_PROTOCOL_UDP)
+            {
+                flow.src = datagram->header->source_address;
+                flow.dest = datagram->header->destination_address;
+                decoder->packet_valid++;
+                delta.packets_valid++;
+
+                if (!pipeline_push_flow(decoder, pipeline_shard(&flow, pipeline->counter_count),
+                                        &flow))
+                {
+                    failed = true;
+                    atomic_store_explicit(&pipeline->failed, true, memory_order_relaxed);
+                }
+            }
+            else
+            {
+                delta.invalid[ingest_invalid_reason(frame, datagram)]++;
+            }
+        }
+
+        packet_arena_reset(decoder->arena); /* the flows were copied out of the datagrams */
+        free(batch);
+        pipeline_publish(pipeline->config, &delta);
+    }
+
+    for (c = 0; c < pipeline->counter_count; c++)
+    {
+        if (decoder->pending[c] != NULL)
+        {
+            spsc_ring_push(pipeline_flow_ring(pipeline, decoder->index, c), decoder->pending[c]);
+            decoder->pending[c] = NULL;
+        }
+
+        spsc_ring_close(pipeline_flow_ring(pipeline, decoder->index, c));
+    }
+
+    instrument_thread_done();
+
+    return NULL;
+}
+
+static void pipeline_counter_publish(const pipeline_counter_t *shard,
+                                     ingest_metrics_delta_t *delta)
+{
+    if (shard->table != NULL)
+    {
+        ingest_metrics_publish(shard->pipeline->config->metrics, delta, shard->table->size,
+                               shard->table->capacity);
+    }
+    else
+    {
+        ingest_metrics_publish(shard->pipeline->config->metrics, delta,
+                               shard->counter->flow_count - shard->counter->holes,
+                               shard->counter->index->capacity);
+    }
+}
+
+static void *pipeline_counter_run(void *arg)
+{
+    pipeline_counter_t *shard = (pipeline_counter_t *)arg;
+    pipeline_t *pipeline = shard->pipeline;
+    pipeline_flow_batch_t *batch = NULL;
+    ingest_metrics_delta_t delta = {0};
+    spsc_ring_t *input = NULL;
+    uint64_t keys[PIPELINE_BATCH_SIZE] = {0};
+    unsigned drained = 0;
+    unsigned spins = 0;
+    unsigned d = 0;
+    size_t i = 0;
+    bool popped = false;
+    bool failed = false;
+
+    cpu_affinity_pin(pipeline->config->cpus,
+                     PIPELINE_READER_CPU + 1 + pipeline->decoder_count + shard->index);
+
+    /* Publish the initial gauges of the shard counter, like ingest_worker_run does */
+    pipeline_counter_publish(shard, &delta);
+
+    while (drained < pipeline->decoder_count)
+    {
+        drained = 0;
+        popped = false;
+
+        for (d = 0; d < pipeline->decoder_count; d++)
+        {
+            input = pipeline_flow_ring(pipeline, d, shard->index);
+            batch = (pipeline_flow_batch_t *)spsc_ring_try_pop(input);
+
+            if (batch == NULL)
+            {
+                drained += spsc_ring_drained(input);
+                continue;
+            }
+
+            popped = true;
+
+            if (failed)
+            {
+                free(batch);
+                continue; /* keep draining, so the decoders never wait on this shard */
+            }
+
+            if (shard->table != NULL)
+            {
+                instrument_start(key_start);
+
+                for (i = 0; i < batch->count; i++)
+                {
+                    keys[i] = flow_key(&batch->flows[i].src, &batch->flows[i].dest);
+                }
+
+                instrument_stop_many(INSTRUMENT_KEY, key_start, batch->count);
+                instrument_start(lookup_start); /* lookups and inserts of the packed table */
+                failed = flow_table_add_many(shard->table, keys, batch->count) < batch->count;
+                instrument_stop_many(INSTRUMENT_LOOKUP, lookup_start, batch->count);
+            }
+            else
+            {
+                for (i = 0; i < batch->count; i++)
+                {
+                    packet_counter_add(shard->counter, &batch->flows[i].src,
+                                       &batch->flows[i].dest, 1);
+                }
+            }
+
+            for (i = 0; shard->hhh != NULL && i < batch->count; i++)
+            {
+                hhh_update(shard->hhh, &batch->flows[i].src, &batch->flows[i].dest);
+            }
+
+            if (failed)
+            {
+                fprintf(stderr, "Unable to allocate memory for the flow table.\n");
+                atomic_store_explicit(&pipeline->failed, true, memory_order_relaxed);
+            }
+
+            free(batch);
+            pipeline_counter_publish(shard, &delta);
+        }
+
+        if (popped)
+        {
+            spins = 0;
+        }
+        else if (drained < pipeline->decoder_count)
+        {
+            spsc_ring_backoff(&spins);
+        }
+    }
+
+    instrument_thread_done();
+
+    return NULL;
+}
+
+/* Reads raw packets and hands them out to the decoders in batches, round robin */
+static void pipeline_read(pipeline_t *pipeline, capture_file_t *capture, ingest_stats_t *stats)
+{
+    pipeline_packet_batch_t *batch = NULL;
+    ingest_metrics_delta_t delta = {0};
+    long published_pos = 0;
+    unsigned next_decoder = 0;
+
+    while (capture_file_readable(capture) &&
+           !atomic_load_explicit(&pipeline->failed, memory_order_relaxed))
+    {
+        if (batch == NULL)
+        {
+            batch = (pipeline_packet_batch_t *)malloc(sizeof(pipeline_packet_batch_t));
+
+            if (batch == NULL)
+            {
+                fprintf(stderr, "Unable to allocate memory for packet batch.\n");
+                break;
+            }
+
+            batch->count = 0;
+        }
+
+        batch->packets[batch->count++] = capture_file_get_next_packet(capture);
+        stats->packet_total++;
+        delta.packets_read++;
+
+        if (batch->count == PIPELINE_BATCH_SIZE || !capture_file_readable(capture))
+        {
+            spsc_ring_push(pipeline->packet_rings[next_decoder], batch);
+            next_decoder = (next_decoder + 1) % pipeline->decoder_count;
+            batch = NULL;
+        }
+
+        if (delta.packets_read == INGEST_METRICS_PUBLISH_PACKETS)
+        {
+            delta.bytes_read = (uint64_t)(capture_file_position(capture) - published_pos);
+            published_pos = capture_file_position(capture);
+            pipeline_publish(pipeline->config, &delta);
+        }
+    }
+
+    if (batch != NULL)
+    {
+        spsc_ring_push(pipeline->packet_rings[next_decoder], batch);
+    }
+
+    delta.bytes_read = (uint64_t)(capture_file_position(capture) - published_pos);
+    pipeline_publish(pipeline->config, &delta);
+}
+
+static void pipeline_free(pipeline_t *pipeline)
+{
+    pipeline_packet_batch_t *packet_batch = NULL;
+    pipeline_flow_batch_t *flow_batch = NULL;
+    size_t ring_count = (size_t)pipeline->decoder_count * pipeline->counter_count;
+    size_t i = 0;
+    size_t j = 0;
+
+    for (i = 0; pipeline->packet_rings != NULL && i < pipeline->decoder_count; i++)
+    {
+        while (pipeline->packet_rings[i] != NULL &&
+               (packet_batch = spsc_ring_try_pop(pipeline->packet_rings[i])) != NULL)
+        {
+            for (j = 0; j < packet_batch->count; j++)
+            {
+                dynamic_buffer_free(&packet_batch->packets[j]);
+            }
+
+            free(packet_batch);
+        }
+
+        spsc_ring_free(&pipeline->packet_rings[i]);
+    }
+
+    for (i = 0; pipeline->flow_rings != NULL && i < ring_count; i++)
+    {
+        while (pipeline->flow_rings[i] != NULL &&
+               (flow_batch = spsc_ring_try_pop(pipeline->flow_rings[i])) != NULL)
+        {
+            free(flow_batch);
+        }
+
+        spsc_ring_free(&pipeline->flow_rings[i]);
+    }
+
+    for (i = 0; pipeline->decoders != NULL && i < pipeline->decoder_count; i++)
+    {
+        for (j = 0; pipeline->decoders[i].pending != NULL && j < pipeline->counter_count; j++)
+        {
+            free(pipeline->decoders[i].pending[j]);
+        }
+
+        free(pipeline->decoders[i].pending);
+        packet_arena_free(&pipeline->decoders[i].arena);
+    }
+
+    for (i = 0; pipeline->counters != NULL && i < pipeline->counter_count; i++)
+    {
+        packet_counter_free(&pipeline->counters[i].counter);
+        flow_table_free(&pipeline->counters[i].table);
+        hhh_free(&pipeline->counters[i].hhh);
+    }
+
+    free(pipeline->packet_rings);
+    free(pipeline->flow_rings);
+    free(pipeline->decoders);
+    free(pipeline->counters);
+}
+
+static bool pipeline_init(pipeline_t *pipeline, const ingest_config_t *config, bool heavy_hitters)
+{
+    size_t ring_count = 0;
+    size_t i = 0;
+
+    pipeline->config = config;
+    pipeline->decoder_count = config->decoders;
+    pipeline->counter_count = (config->counters != 0) ? config->counters : 1;
+    ring_count = (size_t)pipeline->decoder_count * pipeline->counter_count;
+
+    pipeline->packet_rings = (spsc_ring_t **)calloc(pipeline->decoder_count, sizeof(void *));
+    pipeline->flow_rings = (spsc_ring_t **)calloc(ring_count, sizeof(void *));
+    pipeline->decoders = (pipeline_decoder_t *)calloc(pipeline->decoder_count,
+                                                      sizeof(pipeline_decoder_t));
+    pipeline->counters = (pipeline_counter_t *)calloc(pipeline->counter_count,
+                                                      sizeof(pipeline_counter_t));
+
+    if (pipeline->packet_rings == NULL || pipeline->flow_rings == NULL ||
+        pipeline->decoders == NULL || pipeline->counters == NULL)
+    {
+        return false;
+    }
+
+    for (i = 0; i < ring_count; i++)
+    {
+        if ((pipeline->flow_rings[i] = spsc_ring_create(PIPELINE_RING_CAPACITY)) == NULL)
+        {
+            return false;
+        }
+    }
+
+    for (i = 0; i < pipeline->decoder_count; i++)
+    {
+        pipeline->decoders[i].pipeline = pipeline;
+        pipeline->decoders[i].index = (unsigned)i;
+        pipeline->decoders[i].pending =
+            (pipeline_flow_batch_t **)calloc(pipeline->counter_count, sizeof(void *));
+        pipeline->decoders[i].arena = packet_arena_create(0);
+        pipeline->packet_rings[i] = spsc_ring_create(PIPELINE_RING_CAPACITY);
+
+        if (pipeline->decoders[i].pending == NULL || pipeline->decoders[i].arena == NULL ||
+            pipeline->packet_rings[i] == NULL)
+        {
+            return false;
+        }
+    }
+
+    for (i = 0; i < pipeline->counter_count; i++)
+    {
+        pipeline->counters[i].pipeline = pipeline;
+        pipeline->counters[i].index = (unsigned)i;
+        pipeline->counters[i].hhh = heavy_hitters ? hhh_create(HHH_DEFAULT_COUNTERS) : NULL;
+
+        if (heavy_hitters && pipeline->counters[i].hhh == NULL)
+        {
+            return false;
+        }
+
+        if (config->max_entries == 0)
+        {
+            /* Without a limit nothing is evicted, the packed table is enough */
+            pipeline->counters[i].table = flow_table_create(0);
+
+            if (pipeline->counters[i].table == NULL)
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        pipeline->counters[i].counter = packet_counter_create();
+
+        if (pipeline->counters[i].counter == NULL)
+        {
+            return false;
+        }
+
+        /* The flow limit is shared by the shards, each keeps its part of it */
+        packet_counter_set_limit(pipeline->counters[i].counter,
+                                 (config->max_entries + pipeline->counter_count - 1) /
+                                     pipeline->counter_count,
+                                 config->overflow_sink, config->overflow_context);
+    }
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_pipeline_file
+ *
+ *   Input:      file_path    Wireshark capture file to read
+ *               config       Ingest options, decoders and counters set the thread counts
+ *               counter      Counter receiving valid IPv4 UDP packets
+ *               hhh          Heavy hitter detector to update, can be NULL
+ *   Output:     stats        Packets read and counted from the file
+ *
+ *   Return:     Success      true
+ *               Failed       false if the file could not be opened, threads not started or
+ *                            flows lost
+ *
+ *   Description:            Same result as ingest_file, but reading, decoding and counting
+ *                           run on different threads. The calling thread reads packets and
+ *                           pushes batches of them to the decoder threads, which push the
+ *                           flows of valid datagrams to counter threads chosen by a hash of
+ *                           the flow. Every pair of threads is connected by a bounded single
+ *                           producer, single consumer ring, so a slow stage holds back the
+ *                           stages before it. Shard counters are merged into counter at the
+ *                           end, so flows are listed grouped by shard.
+ ******************************************************************************/
+bool ingest_pipeline_file(const char *file_path, const ingest_config_t *config,
+                          packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats)
+{
+    pipeline_t pipeline = {0};
+    capture_file_t *capture = NULL;
+    unsigned d = 0;
+    unsigned c = 0;
+    bool success = true;
+
+    if (file_path == NULL || config == NULL || counter == NULL || stats == NULL ||
+        config->decoders == 0)
+    {
+        return false;
+    }
+
+    capture = capture_file_create(file_path, config->direct_io);
+
+    if (capture == NULL)
+    {
+        return false;
+    }
+
+    if (!pipeline_init(&pipeline, config, hhh != NULL))
+    {
+        fprintf(stderr, "Unable to allocate memory for the pipeline.\n");
+        success = false;
+        goto cleanup;
+    }
+
+    for (c = 0; c < pipeline.counter_count && success; c++)
+    {
+        success = pthread_create(&pipeline.counters[c].thread, NULL, pipeline_counter_run,
+                                 &pipeline.counters[c]) == 0;
+        pipeline.counters[c].started = success;
+    }
+
+    for (d = 0; d < pipeline.decoder_count && success; d++)
+    {
+        success = pthread_create(&pipeline.decoders[d].thread, NULL, pipeline_decoder_run,
+                                 &pipeline.decoders[d]) == 0;
+        pipeline.decoders[d].started = success;
+    }
+
+    if (success)
+    {
+        cpu_affinity_pin(config->cpus, PIPELINE_READER_CPU);
+        pipeline_read(&pipeline, capture, stats);
+    }
+    else
+    {
+        fprintf(stderr, "Unable to start pipeline threads.\n");
+    }
+
+    /* Shutdown flows downstream: closing the packet rings lets the decoders finish */
+    for (d = 0; d < pipeline.decoder_count; d++)
+    {
+        spsc_ring_close(pipeline.packet_rings[d]);
+    }
+
+    for (d = 0; d < pipeline.decoder_count; d++)
+    {
+        if (pipeline.decoders[d].started)
+        {
+            pthread_join(pipeline.decoders[d].thread, NULL);
+            stats->packet_valid += pipeline.decoders[d].packet_valid;
+        }
+        else
+        {
+            for (c = 0; c < pipeline.counter_count; c++)
+            {
+                spsc_ring_close(pipeline_flow_ring(&pipeline, d, c));
+            }
+        }
+    }
+
+    for (c = 0; c < pipeline.counter_count; c++)
+    {
+        if (pipeline.counters[c].started)
+        {
+            pthread_join(pipeline.counters[c].thread, NULL);
+        }
+
+        /* The shards did the counting, the merged counter only sees each flow once */
+        if (config->table_stats && pipeline.counters[c].counter != NULL)
+        {
+            fprintf(stderr, "Pipeline counter %u: ", c);
+            print_flow_index_stats(stderr, pipeline.counters[c].counter->index);
+        }
+        else if (config->table_stats && pipeline.counters[c].table != NULL)
+        {
+            fprintf(stderr, "Pipeline counter %u: ", c);
+            print_flow_table_stats(stderr, pipeline.counters[c].table);
+        }
+
+        packet_counter_merge(counter, pipeline.counters[c].counter);
+        packet_counter_merge_flows(counter, pipeline.counters[c].table);
+        hhh_merge(hhh, pipeline.counters[c].hhh);
+    }
+
+    ingest_metrics_set_table(config->metrics, counter->flow_count - counter->holes,
+                             counter->index->capacity);
+
+    if (atomic_load(&pipeline.failed))
+    {
+        fprintf(stderr, "Flows of %s were lost, its counts are incomplete.\n", file_path);
+        success = false;
+    }
+
+cleanup:
+    pipeline_free(&pipeline);
+    capture_file_free(&capture);
+
+    return success;
+}
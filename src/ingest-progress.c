@@ -0,0 +1,203 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "ingest-progress.h"
+
+#define NANOSECONDS_PER_MILLISECOND 1000000L
+#define MILLISECONDS_PER_SECOND 1000
+#define BYTES_PER_MEGABYTE (1024.0 * 1024.0)
+#define SECONDS_PER_MINUTE 60
+#define SECONDS_PER_HOUR 3600
+#define PERCENT 100.0
+
+/**
+ * Prints rates since the previous line, the share of the input consumed, ETA and flows.
+ * The ETA uses the average rate of the run, the rate of one interval jumps too much.
+ * */
+static void ingest_progress_print(ingest_progress_t *progress, bool last)
+{
+    ingest_metrics_t *metrics = progress->metrics;
+    struct timespec now;
+    uint64_t packets_read = 0;
+    uint64_t bytes_read = 0;
+    int64_t flows = 0;
+    double elapsed = 0;
+    double packet_rate = 0;
+    double byte_rate = 0;
+    double average_byte_rate = 0;
+    uint64_t eta = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    packets_read = atomic_load_explicit(&metrics->packets_read, memory_order_relaxed);
+    bytes_read = atomic_load_explicit(&metrics->bytes_read, memory_order_relaxed);
+    flows = atomic_load_explicit(&metrics->flows, memory_order_relaxed);
+    elapsed = timespec_seconds_between(&progress->last_update, &now);
+
+    if (elapsed > 0)
+    {
+        packet_rate = (double)(packets_read - progress->last_packets_read) / elapsed;
+        byte_rate = (double)(bytes_read - progress->last_bytes_read) / elapsed;
+    }
+
+    elapsed = timespec_seconds_between(&progress->start, &now);
+
+    if (elapsed > 0)
+    {
+        average_byte_rate = (double)bytes_read / elapsed;
+    }
+
+    fprintf(stderr, "%s%" PRIu64 " packets, %.0f pkts/s, %.1f MB/s", progress->terminal ? "\r" : "",
+            packets_read, packet_rate, byte_rate / BYTES_PER_MEGABYTE);
+
+    if (progress->total_bytes != 0 && bytes_read <= progress->total_bytes)
+    {
+        fprintf(stderr, ", %.1f%%", PERCENT * (double)bytes_read / (double)progress->total_bytes);
+
+        if (average_byte_rate > 0)
+        {
+            eta = (uint64_t)((double)(progress->total_bytes - bytes_read) / average_byte_rate);
+            fprintf(stderr, ", ETA %02" PRIu64 ":%02" PRIu64 ":%02" PRIu64, eta / SECONDS_PER_HOUR,
+                    eta % SECONDS_PER_HOUR / SECONDS_PER_MINUTE, eta % SECONDS_PER_MINUTE);
+        }
+    }
+
+    /* Trailing spaces clear what is left of a longer previous line */
+    fprintf(stderr, ", %" PRId64 " flows   %s", (flows > 0) ? flows : 0,
+            (last || !progress->terminal) ? "\n" : "");
+    fflush(stderr);
+
+    progress->last_packets_read = packets_read;
+    progress->last_bytes_read = bytes_read;
+    progress->last_update = now;
+}
+
+static void *ingest_progress_run(void *arg)
+{
+    ingest_progress_t *progress = (ingest_progress_t *)arg;
+    struct timespec deadline;
+    int wait_result = 0;
+
+    pthread_mutex_lock(&progress->lock);
+
+    while (!progress->stopping)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (INGEST_PROGRESS_INTERVAL_MS % MILLISECONDS_PER_SECOND) *
+                            NANOSECONDS_PER_MILLISECOND;
+        deadline.tv_sec += INGEST_PROGRESS_INTERVAL_MS / MILLISECONDS_PER_SECOND +
+                           deadline.tv_nsec / NANOSECONDS_PER_SECOND;
+        deadline.tv_nsec %= NANOSECONDS_PER_SECOND;
+        wait_result = 0;
+
+        while (!progress->stopping && wait_result != ETIMEDOUT)
+        {
+            wait_result = pthread_cond_timedwait(&progress->wakeup, &progress->lock, &deadline);
+        }
+
+        if (!progress->stopping)
+        {
+            pthread_mutex_unlock(&progress->lock);
+            ingest_progress_print(progress, false);
+            pthread_mutex_lock(&progress->lock);
+        }
+    }
+
+    pthread_mutex_unlock(&progress->lock);
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_progress_start
+ *
+ *   Input:      metrics      Shared counts published by the ingest workers
+ *               total_bytes  Size of all input files, 0 if unknown
+ *
+ *   Return:     Success      A pointer to the running progress reporter
+ *               Failed       NULL
+ *
+ *   Description:            Starts a thread that prints a progress line on stderr about
+ *                           once per second. The workers only publish counts every few
+ *                           packets, so the hot loop never reads the clock.
+ ******************************************************************************/
+ingest_progress_t *ingest_progress_start(ingest_metrics_t *metrics, uint64_t total_bytes)
+{
+    ingest_progress_t *progress = NULL;
+
+    if (metrics == NULL)
+    {
+        return NULL;
+    }
+
+    progress = (ingest_progress_t *)calloc(1, sizeof(ingest_progress_t));
+
+    if (progress == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for progress reporting.\n");
+
+        return NULL;
+    }
+
+    progress->terminal = isatty(STDERR_FILENO);
+    progress->total_bytes = total_bytes;
+    progress->metrics = metrics;
+    clock_gettime(CLOCK_MONOTONIC, &progress->start);
+    progress->last_update = progress->start;
+    pthread_mutex_init(&progress->lock, NULL);
+    pthread_cond_init(&progress->wakeup, NULL);
+
+    if (pthread_create(&progress->thread, NULL, ingest_progress_run, progress) != 0)
+    {
+        fprintf(stderr, "Unable to start progress reporting.\n");
+        pthread_cond_destroy(&progress->wakeup);
+        pthread_mutex_destroy(&progress->lock);
+        free(progress);
+
+        return NULL;
+    }
+
+    return progress;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       ingest_progress_stop
+ *
+ *   Input:      progress_p   A pointer to the progress reporter to stop
+ *
+ *   Return:     None
+ *
+ *   Description:            Stops the reporter thread, prints the final line and frees the
+ *                           reporter. The pointer is set to NULL.
+ ******************************************************************************/
+void ingest_progress_stop(ingest_progress_t **progress_p)
+{
+    ingest_progress_t *progress = NULL;
+
+    if (progress_p == NULL || *progress_p == NULL)
+    {
+        return;
+    }
+
+    progress = *progress_p;
+
+    pthread_mutex_lock(&progress->lock);
+    progress->stopping = true;
+    pthread_cond_signal(&progress->wakeup);
+    pthread_mutex_unlock(&progress->lock);
+    pthread_join(progress->thread, NULL);
+
+    ingest_progress_print(progress, true);
+
+    pthread_cond_destroy(&progress->wakeup);
+    pthread_mutex_destroy(&progress->lock);
+    free(progress);
+    *progress_p = NULL;
+
+    return;
+}
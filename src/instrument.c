@@ -0,0 +1,97 @@
+#include "instrument.h"
+
+#ifdef INSTRUMENT
+
+    #include <inttypes.h>
+    #include <pthread.h>
+    #include <stdio.h>
+
+    #define PERCENT 100.0
+
+typedef struct instrument_counter
+{
+    uint64_t ticks;
+    uint64_t calls;
+} instrument_counter_t;
+
+static const char *const stage_names[INSTRUMENT_STAGES] = {
+    "read", "hex decode", "ethernet decode", "ipv4 decode", "key build", "hash lookup", "insert",
+};
+
+static _Thread_local instrument_counter_t thread_counters[INSTRUMENT_STAGES];
+static instrument_counter_t total_counters[INSTRUMENT_STAGES];
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void instrument_record(instrument_stage_t stage, uint64_t ticks, uint64_t calls)
+{
+    thread_counters[stage].ticks += ticks;
+    thread_counters[stage].calls += calls;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       instrument_flush_thread
+ *
+ *   Input:      None
+ *
+ *   Return:     None
+ *
+ *   Description:            Adds the counters of the calling thread to the totals and
+ *                           clears them. Worker threads call it before they exit.
+ ******************************************************************************/
+void instrument_flush_thread(void)
+{
+    uint32_t i = 0;
+
+    pthread_mutex_lock(&total_lock);
+
+    for (i = 0; i < INSTRUMENT_STAGES; i++)
+    {
+        total_counters[i].ticks += thread_counters[i].ticks;
+        total_counters[i].calls += thread_counters[i].calls;
+        thread_counters[i].ticks = 0;
+        thread_counters[i].calls = 0;
+    }
+
+    pthread_mutex_unlock(&total_lock);
+}
+
+/*****************************************************************************
+ *
+ *   Name:       instrument_print_report
+ *
+ *   Input:      None
+ *
+ *   Return:     None
+ *
+ *   Description:            Prints calls, time, time per call and share of every stage on
+ *                           stderr, including the counters of the calling thread.
+ ******************************************************************************/
+void instrument_print_report(void)
+{
+    uint64_t all_ticks = 0;
+    uint32_t i = 0;
+
+    instrument_flush_thread();
+
+    for (i = 0; i < INSTRUMENT_STAGES; i++)
+    {
+        all_ticks += total_counters[i].ticks;
+    }
+
+    fprintf(stderr, "%-16s %14s %18s %14s %8s\n", "stage", "calls", INSTRUMENT_UNIT,
+            INSTRUMENT_UNIT "/call", "share");
+
+    for (i = 0; i < INSTRUMENT_STAGES; i++)
+    {
+        fprintf(stderr, "%-16s %14" PRIu64 " %18" PRIu64 " %14.1f %7.1f%%\n", stage_names[i],
+                total_counters[i].calls, total_counters[i].ticks,
+                (total_counters[i].calls != 0)
+                    ? (double)total_counters[i].ticks / (double)total_counters[i].calls
+                    : 0.0,
+                (all_ticks != 0) ? PERCENT * (double)total_counters[i].ticks / (double)all_ticks
+                                 : 0.0);
+    }
+}
+
+#endif /* INSTRUMENT */
@@ -6,7 +6,7 @@
 #include "common.h"
 #include "ipv4-packet.h"
 
-ipv4_datagram_t *ipv4_datagram_from_ethernet_frame(ethernet_frame_t *frame)
+static ipv4_datagram_t *ipv4_datagram_decode(ethernet_frame_t *frame, packet_arena_t *arena)
 {
     ipv4_header_t *header = NULL;
     uint8_t *options = NULL;
@@ -32,7 +32,8 @@ ipv4_datagram_t *ipv4_datagram_from_ethernet_frame(ethernet_frame_t *frame)
         goto cleanup;
     }
 
-    header = (ipv4_header_t *)calloc(1, sizeof(ipv4_header_t));
+    header =
+        (ipv4_header_t *)packet_arena_calloc(arena, ALLOC_SITE_IPV4, 1, sizeof(ipv4_header_t));
 
     if (header == NULL)
     {
@@ -59,7 +60,8 @@ ipv4_datagram_t *ipv4_datagram_from_ethernet_frame(ethernet_frame_t *frame)
 
     if (options_len != 0)
     {
-        options = (uint8_t *)calloc(options_len, sizeof(uint8_t));
+        options = (uint8_t *)packet_arena_calloc(arena, ALLOC_SITE_IPV4, options_len,
+                                                 sizeof(uint8_t));
 
         if (options == NULL)
         {
@@ -95,7 +97,8 @@ ipv4_datagram_t *ipv4_datagram_from_ethernet_frame(ethernet_frame_t *frame)
         }
     }
 
-    datagram = (ipv4_datagram_t *)calloc(1, sizeof(ipv4_datagram_t) + data_len);
+    datagram = (ipv4_datagram_t *)packet_arena_calloc(arena, ALLOC_SITE_IPV4, 1,
+                                                      sizeof(ipv4_datagram_t) + data_len);
 
     if (datagram == NULL)
     {
@@ -112,18 +115,35 @@ ipv4_datagram_t *ipv4_datagram_from_ethernet_frame(ethernet_frame_t *frame)
     return datagram;
 
 cleanup:
-    free(header);
+    packet_arena_release(arena, ALLOC_SITE_IPV4, header);
     header = NULL;
 
-    free(options);
+    packet_arena_release(arena, ALLOC_SITE_IPV4, options);
     options = NULL;
 
-    free(datagram);
+    packet_arena_release(arena, ALLOC_SITE_IPV4, datagram);
     datagram = NULL;
 
     return NULL;
 }
 
+ipv4_datagram_t *ipv4_datagram_from_ethernet_frame(ethernet_frame_t *frame)
+{
+    return ipv4_datagram_decode(frame, NULL);
+}
+
+/* Same as ipv4_datagram_from_ethernet_frame, allocated from arena until it is reset, not freed */
+ipv4_datagram_t *ipv4_datagram_from_ethernet_frame_arena(ethernet_frame_t *frame,
+                                                         packet_arena_t *arena)
+{
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+
+    return ipv4_datagram_decode(frame, arena);
+}
+
 void ipv4_datagram_free(ipv4_datagram_t **datagram_p)
 {
     if (datagram_p == NULL || *datagram_p == NULL)
@@ -131,13 +151,13 @@ void ipv4_datagram_free(ipv4_datagram_t **datagram_p)
         return;
     }
 
-    free((*datagram_p)->header);
+    track_free(ALLOC_SITE_IPV4, (*datagram_p)->header);
     (*datagram_p)->header = NULL;
 
-    free((*datagram_p)->options);
+    track_free(ALLOC_SITE_IPV4, (*datagram_p)->options);
     (*datagram_p)->options = NULL;
 
-    free((*datagram_p));
+    track_free(ALLOC_SITE_IPV4, (*datagram_p));
     (*datagram_p) = NULL;
 
     return;
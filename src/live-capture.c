@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "live-capture.h"
+
+#define POLL_TIMEOUT_MS 100 /* how often the stop flag is checked on an idle interface */
+
+/* Wraps the frame in the ring, the decoders copy what they keep */
+static void live_capture_packet(live_capture_t *capture, const struct tpacket3_hdr *packet,
+                                packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats,
+                                ipv4_datagram_t **batch, size_t *batch_size,
+                                ingest_metrics_delta_t *delta)
+{
+    const struct sockaddr_ll *link = NULL;
+    dynamic_buffer_t buffer = {0};
+    ethernet_frame_t *frame = NULL;
+    ipv4_datagram_t *datagram = NULL;
+
+    link = (const struct sockaddr_ll *)((const uint8_t *)packet +
+                                        TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+    if (capture->loopback && link->sll_pkttype == PACKET_OUTGOING)
+    {
+        return; /* loopback delivers every packet once more as incoming */
+    }
+
+    buffer.data = (uint8_t *)packet + packet->tp_mac;
+    buffer.size = packet->tp_snaplen;
+    buffer.capacity = packet->tp_snaplen;
+
+    stats->packet_total++;
+    delta->packets_read++;
+    delta->bytes_read += packet->tp_snaplen;
+
+    frame = ethernet_frame_from_dynamic_buffer(&buffer);
+    datagram = ipv4_datagram_from_ethernet_frame(frame);
+
+    if (datagram == NULL || datagram->header->protocol != IPV4_PROTOCOL_UDP)
+    {
+        delta->invalid[ingest_invalid_reason(frame, datagram)]++;
+        ethernet_frame_free(&frame);
+        ipv4_datagram_free(&datagram);
+
+        return;
+    }
+
+    ethernet_frame_free(&frame);
+    stats->packet_valid++;
+    delta->packets_valid++;
+    hhh_update(hhh, &datagram->header->source_address, &datagram->header->destination_address);
+    batch[(*batch_size)++] = datagram;
+
+    if (*batch_size == PACKET_COUNTER_BATCH_SIZE)
+    {
+        packet_counter_increase_many(counter, batch, *batch_size);
+
+        while (*batch_size > 0)
+        {
+            ipv4_datagram_free(&batch[--(*batch_size)]);
+        }
+    }
+}
+
+/*****************************************************************************
+ *
+ *   Name:       live_capture_open
+ *
+ *   Input:      ifname       Interface to capture on, like eth0 or lo
+ *
+ *   Return:     Success      A pointer to the new live_capture_t
+ *               Failed       NULL, also without CAP_NET_RAW
+ *
+ *   Description:            Opens an AF_PACKET socket on the interface with a TPACKET_V3
+ *                           block ring mapped into the process. The kernel fills whole
+ *                           blocks of frames, so reading needs no system call per packet.
+ ******************************************************************************/
+live_capture_t *live_capture_open(const char *ifname)
+{
+    live_capture_t *capture = NULL;
+    struct tpacket_req3 request;
+    struct sockaddr_ll address;
+    struct ifreq ifr;
+    int version = TPACKET_V3;
+
+    if (ifname == NULL || strlen(ifname) >= IFNAMSIZ)
+    {
+        return NULL;
+    }
+
+    capture = (live_capture_t *)calloc(1, sizeof(live_capture_t));
+
+    if (capture == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for live_capture_t\n");
+
+        return NULL;
+    }
+
+    capture->ifname = ifname;
+    capture->ring = MAP_FAILED;
+    capture->fd = socket(AF_PACKET, SOCK_RAW, 0); /* protocol 0 receives nothing until bind */
+
+    if (capture->fd < 0)
+    {
+        perror("Unable to open packet socket");
+        goto cleanup;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+
+    if (ioctl(capture->fd, SIOCGIFINDEX, &ifr) != 0)
+    {
+        fprintf(stderr, "Unknown interface: %s\n", ifname);
+        goto cleanup;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_ALL);
+    address.sll_ifindex = ifr.ifr_ifindex;
+
+    if (ioctl(capture->fd, SIOCGIFFLAGS, &ifr) == 0)
+    {
+        capture->loopback = (ifr.ifr_flags & IFF_LOOPBACK) != 0;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.tp_block_size = LIVE_CAPTURE_BLOCK_SIZE;
+    request.tp_block_nr = LIVE_CAPTURE_BLOCK_COUNT;
+    request.tp_frame_size = LIVE_CAPTURE_FRAME_SIZE;
+    request.tp_frame_nr = (LIVE_CAPTURE_BLOCK_SIZE / LIVE_CAPTURE_FRAME_SIZE) *
+                          LIVE_CAPTURE_BLOCK_COUNT;
+    request.tp_retire_blk_tov = LIVE_CAPTURE_BLOCK_TIMEOUT_MS;
+
+    if (setsockopt(capture->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0 ||
+        setsockopt(capture->fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) != 0)
+    {
+        perror("Unable to set up TPACKET_V3 ring");
+        goto cleanup;
+    }
+
+    capture->ring_size = (size_t)LIVE_CAPTURE_BLOCK_SIZE * LIVE_CAPTURE_BLOCK_COUNT;
+    capture->ring = (uint8_t *)mmap(NULL, capture->ring_size, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_LOCKED, capture->fd, 0);
+
+    if (capture->ring == MAP_FAILED)
+    {
+        /* MAP_LOCKED needs RLIMIT_MEMLOCK room, the ring works without it */
+        capture->ring = (uint8_t *)mmap(NULL, capture->ring_size, PROT_READ | PROT_WRITE,
+                                        MAP_SHARED, capture->fd, 0);
+    }
+
+    if (capture->ring == MAP_FAILED)
+    {
+        perror("Unable to map packet ring");
+        goto cleanup;
+    }
+
+    /* Packets of every protocol on the interface only arrive from here, once the ring is there */
+    if (bind(capture->fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        perror("Unable to bind packet socket");
+        goto cleanup;
+    }
+
+    return capture;
+
+cleanup:
+    live_capture_free(&capture);
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       live_capture_run
+ *
+ *   Input:      capture      Open capture
+ *               config       Ingest options, metrics are used here
+ *               counter      Counter receiving valid IPv4 UDP packets
+ *               hhh          Heavy hitter detector to update, can be NULL
+ *               stop         Capturing ends once this is set, by a signal handler
+ *   Output:     stats        Packets captured and counted
+ *
+ *   Return:     Success      true
+ *               Failed       false if polling the socket failed
+ *
+ *   Description:            Walks the blocks the kernel hands over and counts their
+ *                           frames, then returns every block to the kernel. The thread
+ *                           only sleeps in poll when no block is ready.
+ ******************************************************************************/
+bool live_capture_run(live_capture_t *capture, const ingest_config_t *config,
+                      packet_counter_t *counter, hhh_t *hhh, ingest_stats_t *stats,
+                      volatile sig_atomic_t *stop)
+{
+    struct tpacket_block_desc *block = NULL;
+    const struct tpacket3_hdr *packet = NULL;
+    struct tpacket_stats_v3 kernel_stats;
+    socklen_t stats_length = sizeof(kernel_stats);
+    struct pollfd poll_fd = {0};
+    ipv4_datagram_t *batch[PACKET_COUNTER_BATCH_SIZE] = {0};
+    size_t batch_size = 0;
+    ingest_metrics_delta_t delta = {0};
+    uint32_t i = 0;
+    bool success = true;
+
+    if (capture == NULL || config == NULL || counter == NULL || stats == NULL || stop == NULL)
+    {
+        return false;
+    }
+
+    poll_fd.fd = capture->fd;
+    poll_fd.events = POLLIN | POLLERR;
+    ingest_metrics_publish(config->metrics, &delta, counter->flow_count - counter->holes,
+                           counter->index->capacity);
+
+    while (!*stop)
+    {
+        block = (struct tpacket_block_desc *)(capture->ring +
+                                              (size_t)capture->next_block *
+                                                  LIVE_CAPTURE_BLOCK_SIZE);
+
+        if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+             TP_STATUS_USER) == 0)
+        {
+            if (poll(&poll_fd, 1, POLL_TIMEOUT_MS) < 0 && errno != EINTR)
+            {
+                perror("Unable to poll packet socket");
+                success = false;
+                break;
+            }
+
+            continue;
+        }
+
+        packet = (const struct tpacket3_hdr *)((uint8_t *)block +
+                                               block->hdr.bh1.offset_to_first_pkt);
+
+        for (i = 0; i < block->hdr.bh1.num_pkts; i++)
+        {
+            live_capture_packet(capture, packet, counter, hhh, stats, batch, &batch_size, &delta);
+            packet = (const struct tpacket3_hdr *)((const uint8_t *)packet +
+                                                   packet->tp_next_offset);
+        }
+
+        packet_counter_increase_many(counter, batch, batch_size);
+
+        while (batch_size > 0)
+        {
+            ipv4_datagram_free(&batch[--batch_size]);
+        }
+
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        capture->next_block = (capture->next_block + 1) % LIVE_CAPTURE_BLOCK_COUNT;
+        ingest_metrics_publish(config->metrics, &delta, counter->flow_count - counter->holes,
+                               counter->index->capacity);
+    }
+
+    /* Reading the statistics also resets them */
+    if (getsockopt(capture->fd, SOL_PACKET, PACKET_STATISTICS, &kernel_stats,
+                   &stats_length) == 0)
+    {
+        capture->drops += kernel_stats.tp_drops;
+    }
+
+    return success;
+}
+
+void live_capture_free(live_capture_t **capture_p)
+{
+    if (capture_p == NULL || *capture_p == NULL)
+    {
+        return;
+    }
+
+    if ((*capture_p)->ring != MAP_FAILED && (*capture_p)->ring != NULL)
+    {
+        munmap((*capture_p)->ring, (*capture_p)->ring_size);
+        (*capture_p)->ring = NULL;
+    }
+
+    if ((*capture_p)->fd >= 0)
+    {
+        close((*capture_p)->fd);
+        (*capture_p)->fd = -1;
+    }
+
+    free(*capture_p);
+    *capture_p = NULL;
+
+    return;
+}
@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "output-buffer.h"
+
+#define U64_MAX_DIGITS 20
+#define DECIMAL_BASE 10
+
+/*****************************************************************************
+ *
+ *   Name:       output_buffer_create
+ *
+ *   Input:      stream       Stream the buffered text is written to
+ *               capacity     Size of the buffer in bytes
+ *
+ *   Return:     Success      A pointer to the newly created output_buffer_t
+ *               Failed       NULL
+ *
+ *   Description:            Creates a text buffer that is only written to stream when
+ *                           full or flushed, so that many small writes cost one fwrite.
+ ******************************************************************************/
+output_buffer_t *output_buffer_create(FILE *stream, size_t capacity)
+{
+    output_buffer_t *out = NULL;
+
+    if (stream == NULL || capacity < U64_MAX_DIGITS)
+    {
+        return NULL;
+    }
+
+    out = (output_buffer_t *)calloc(1, sizeof(output_buffer_t));
+
+    if (out == NULL)
+    {
+        return NULL;
+    }
+
+    out->data = (char *)malloc(capacity);
+
+    if (out->data == NULL)
+    {
+        free(out);
+        out = NULL;
+
+        return NULL;
+    }
+
+    out->stream = stream;
+    out->size = 0;
+    out->capacity = capacity;
+
+    return out;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       output_buffer_flush
+ *
+ *   Input:      out          Buffer to flush
+ *
+ *   Return:     Success      true if all buffered text was written
+ *               Failed       false
+ *
+ *   Description:            Writes the buffered text to the stream. Must be called before
+ *                           printing to the same stream by other means to keep the order.
+ ******************************************************************************/
+bool output_buffer_flush(output_buffer_t *out)
+{
+    bool success = true;
+
+    if (out == NULL)
+    {
+        return false;
+    }
+
+    if (out->size != 0)
+    {
+        success = fwrite(out->data, 1, out->size, out->stream) == out->size;
+        out->size = 0;
+    }
+
+    return success;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       output_buffer_write
+ *
+ *   Input:      out          Buffer to append to
+ *               data         Bytes to append
+ *               length       Number of bytes
+ *
+ *   Return:     Success      true
+ *               Failed       false if flushing failed
+ *
+ *   Description:            Appends bytes, flushing first if they do not fit. Data larger
+ *                           than the whole buffer is written straight to the stream.
+ ******************************************************************************/
+bool output_buffer_write(output_buffer_t *out, const char *data, size_t length)
+{
+    if (out == NULL || data == NULL)
+    {
+        return false;
+    }
+
+    if (out->capacity - out->size < length && !output_buffer_flush(out))
+    {
+        return false;
+    }
+
+    if (length > out->capacity)
+    {
+        return fwrite(data, 1, length, out->stream) == length;
+    }
+
+    memcpy(out->data + out->size, data, length);
+    out->size += length;
+
+    return true;
+}
+
+bool output_buffer_puts(output_buffer_t *out, const char *str)
+{
+    if (str == NULL)
+    {
+        return false;
+    }
+
+    return output_buffer_write(out, str, strlen(str));
+}
+
+bool output_buffer_putc(output_buffer_t *out, char c)
+{
+    if (out == NULL)
+    {
+        return false;
+    }
+
+    if (out->size == out->capacity && !output_buffer_flush(out))
+    {
+        return false;
+    }
+
+    out->data[out->size++] = c;
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       output_buffer_format_u64
+ *
+ *   Input:      value        Number to format
+ *   Output:     out          Decimal digits, at least 20 bytes, not null terminated
+ *
+ *   Return:     Number of digits written
+ *
+ *   Description:            Formats an unsigned integer without going through printf.
+ ******************************************************************************/
+size_t output_buffer_format_u64(uint64_t value, char *out)
+{
+    char digits[U64_MAX_DIGITS];
+    size_t count = 0;
+    size_t i = 0;
+
+    do
+    {
+        digits[count++] = (char)('0' + value % DECIMAL_BASE);
+        value /= DECIMAL_BASE;
+    } while (value != 0);
+
+    for (i = 0; i < count; i++)
+    {
+        out[i] = digits[count - 1 - i];
+    }
+
+    return count;
+}
+
+bool output_buffer_put_u64(output_buffer_t *out, uint64_t value)
+{
+    if (out == NULL)
+    {
+        return false;
+    }
+
+    if (out->capacity - out->size < U64_MAX_DIGITS && !output_buffer_flush(out))
+    {
+        return false;
+    }
+
+    out->size += output_buffer_format_u64(value, out->data + out->size);
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       output_buffer_free
+ *
+ *   Input:      out_p        A pointer to a pointer to the buffer to free
+ *
+ *   Return:     None
+ *
+ *   Description:            Flushes the remaining text and frees the buffer. The buffer
+ *                           pointer is set to NULL after freeing.
+ ******************************************************************************/
+void output_buffer_free(output_buffer_t **out_p)
+{
+    if (out_p == NULL || *out_p == NULL)
+    {
+        return;
+    }
+
+    output_buffer_flush(*out_p);
+
+    free((*out_p)->data);
+    (*out_p)->data = NULL;
+
+    free(*out_p);
+    *out_p = NULL;
+
+    return;
+}
@@ -0,0 +1,229 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packet-arena.h"
+
+#define PACKET_ARENA_ALIGN (sizeof(max_align_t))
+
+static packet_arena_block_t *packet_arena_block_create(size_t size)
+{
+    packet_arena_block_t *block = NULL;
+
+    block = (packet_arena_block_t *)track_calloc(ALLOC_SITE_PACKET_ARENA, 1,
+                                                 sizeof(packet_arena_block_t) + size);
+
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    block->size = size;
+
+    return block;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_arena_create
+ *
+ *   Input:      block_size   Usable bytes of every block, 0 for PACKET_ARENA_BLOCK_SIZE
+ *
+ *   Return:     Success      A pointer to the new packet_arena_t with one block
+ *               Failed       NULL
+ *
+ *   Description:            Creates an arena that hands out memory of decoded packets by
+ *                           bumping a pointer. Nothing is freed one by one, the whole
+ *                           arena is emptied with packet_arena_reset after a packet or a
+ *                           batch of them.
+ ******************************************************************************/
+packet_arena_t *packet_arena_create(size_t block_size)
+{
+    packet_arena_t *arena = NULL;
+
+    block_size = (block_size == 0) ? PACKET_ARENA_BLOCK_SIZE : block_size;
+    arena = (packet_arena_t *)calloc(1, sizeof(packet_arena_t));
+
+    if (arena == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for packet arena.\n");
+
+        return NULL;
+    }
+
+    arena->block_size = block_size;
+    arena->first = packet_arena_block_create(block_size);
+
+    if (arena->first == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for packet arena block.\n");
+        free(arena);
+        arena = NULL;
+
+        return NULL;
+    }
+
+    arena->current = arena->first;
+
+    return arena;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_arena_alloc
+ *
+ *   Input:      arena        Arena to allocate from
+ *               size         Bytes needed
+ *
+ *   Return:     Success      Uninitialized memory aligned for any type, valid until the
+ *                           next packet_arena_reset
+ *               Failed       NULL if a new block could not be allocated
+ *
+ *   Description:            Bumps the allocation pointer of the current block. When it is
+ *                           full, the next block kept from before a reset is used, or a new
+ *                           one at least as large as size is chained in.
+ ******************************************************************************/
+void *packet_arena_alloc(packet_arena_t *arena, size_t size)
+{
+    packet_arena_block_t *block = NULL;
+    void *ptr = NULL;
+
+    if (arena == NULL || size > SIZE_MAX - PACKET_ARENA_ALIGN)
+    {
+        return NULL;
+    }
+
+    size = (size + PACKET_ARENA_ALIGN - 1) & ~(PACKET_ARENA_ALIGN - 1);
+
+    while (arena->current->size - arena->used < size)
+    {
+        if (arena->current->next == NULL)
+        {
+            block = packet_arena_block_create((size > arena->block_size) ? size
+                                                                         : arena->block_size);
+
+            if (block == NULL)
+            {
+                return NULL;
+            }
+
+            arena->current->next = block;
+        }
+
+        arena->current = arena->current->next;
+        arena->used = 0;
+    }
+
+    ptr = (uint8_t *)arena->current->data + arena->used;
+    arena->used += size;
+
+    return ptr;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_arena_calloc
+ *
+ *   Input:      arena        Arena to allocate from, NULL to use the heap
+ *               site         Subsystem charged for heap allocations
+ *               count        Number of elements
+ *               size         Size of one element
+ *
+ *   Return:     Success      Zeroed memory
+ *               Failed       NULL
+ *
+ *   Description:            Lets a decoder serve both its heap and its arena callers with
+ *                           one code path. Pair it with packet_arena_release.
+ ******************************************************************************/
+void *packet_arena_calloc(packet_arena_t *arena, alloc_site_t site, size_t count, size_t size)
+{
+    void *ptr = NULL;
+
+    (void)site; /* only charged with ALLOC_TRACK */
+
+    if (arena == NULL)
+    {
+        return track_calloc(site, count, size);
+    }
+
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+
+    ptr = packet_arena_alloc(arena, count * size);
+
+    if (ptr != NULL)
+    {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_arena_release
+ *
+ *   Input:      arena        Arena ptr came from, NULL if it came from the heap
+ *               site         Subsystem charged for heap allocations
+ *               ptr          Memory from packet_arena_calloc, can be NULL
+ *
+ *   Description:            Frees heap memory. Arena memory is left for the next reset.
+ ******************************************************************************/
+void packet_arena_release(packet_arena_t *arena, alloc_site_t site, void *ptr)
+{
+    (void)site; /* only charged with ALLOC_TRACK */
+
+    if (arena == NULL)
+    {
+        track_free(site, ptr);
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_arena_reset
+ *
+ *   Input:      arena        Arena to empty
+ *
+ *   Description:            Releases everything allocated from the arena at once, in
+ *                           constant time. Blocks stay allocated and are reused in order.
+ ******************************************************************************/
+void packet_arena_reset(packet_arena_t *arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    arena->current = arena->first;
+    arena->used = 0;
+
+    return;
+}
+
+void packet_arena_free(packet_arena_t **arena_p)
+{
+    packet_arena_block_t *block = NULL;
+    packet_arena_block_t *next = NULL;
+
+    if (arena_p == NULL || *arena_p == NULL)
+    {
+        return;
+    }
+
+    for (block = (*arena_p)->first; block != NULL; block = next)
+    {
+        next = block->next;
+        track_free(ALLOC_SITE_PACKET_ARENA, block);
+    }
+
+    free(*arena_p);
+    *arena_p = NULL;
+
+    return;
+}
@@ -1,12 +1,18 @@
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc-track.h"
+#include "huge-alloc.h"
+#include "instrument.h"
 #include "ipv4-packet.h"
 #include "packet-counter.h"
 
 #define KEY_LENGTH (IP_ADDRESS_LENGTH * 2)
 
+_Static_assert(sizeof(packet_flow_key_t) == KEY_LENGTH, "packet_flow_key_t must be the key");
+
 #define FNV1A_INIT 0xcbf29ce484222325ULL
 #define FNV1A_PRIME 0x100000001b3ULL
 
@@ -23,7 +29,32 @@
 
 #define MAX(a, b) (((a) < (b)) ? (b) : (a))
 
-static uint64_t hash_table_hash_func(const void *key, uint64_t true_hash_size)
+#define FLOWS_INITIAL_CAPACITY 8
+#define FLOWS_MAX_CAPACITY UINT32_MAX
+#define FLOWS_COMPACT_MIN_HOLES 64 /* evicted records tolerated before compacting */
+#define BITS_PER_WORD 64
+
+/**
+ * Approximate heap usage of one flow: the record and its chain link (twice, both arrays double)
+ * and the buckets (the index is kept at most half full and doubles, so 2 to 4 per item).
+ * */
+#define BUCKETS_PER_ITEM 4
+#define BYTES_PER_FLOW                                                                             \
+    (2 * (sizeof(packet_node_t) + sizeof(uint32_t)) + BUCKETS_PER_ITEM * sizeof(uint32_t))
+
+/*****************************************************************************
+ *
+ *   Name:       packet_counter_hash_key
+ *
+ *   Input:      key              Flow key, source then destination address
+ *               true_hash_size   Number of buckets
+ *
+ *   Return:     Bucket of the key
+ *
+ *   Description:            Hash function of the counter's hash table, FNV-1a rejecting the
+ *                           top values so every bucket is equally likely.
+ ******************************************************************************/
+uint64_t packet_counter_hash_key(const void *key, uint64_t true_hash_size)
 {
     uint64_t i = 0;
     uint64_t hash = 0;
@@ -47,54 +78,117 @@ static uint64_t hash_table_hash_func(const void *key, uint64_t true_hash_size)
     return hash;
 }
 
-static bool hash_table_match_func(const ListNode_t *node, const void *key)
+static bool packet_counter_is_referenced(packet_counter_t *counter, uint32_t index)
+{
+    return (counter->referenced[index / BITS_PER_WORD] >> (index % BITS_PER_WORD)) & 1;
+}
+
+static void packet_counter_set_referenced(packet_counter_t *counter, uint32_t index, bool value)
 {
-    if (node == NULL || key == NULL)
+    if (value)
     {
-        return false;
+        counter->referenced[index / BITS_PER_WORD] |= 1ULL << (index % BITS_PER_WORD);
+    }
+    else
+    {
+        counter->referenced[index / BITS_PER_WORD] &= ~(1ULL << (index % BITS_PER_WORD));
     }
-
-    return memcmp(((HashNode_t *)node)->key, key, KEY_LENGTH) == 0;
 }
 
-static void hash_table_free_node(ListNode_t *node)
+static bool packet_counter_grow(packet_counter_t *counter)
 {
-    if (node == NULL)
+    packet_node_t *new_flows = NULL;
+    uint64_t *new_referenced = NULL;
+    uint64_t new_capacity = 0;
+    uint64_t old_words = 0;
+    uint64_t new_words = 0;
+
+    if (counter->flow_capacity == FLOWS_MAX_CAPACITY)
     {
-        return;
+        return false;
     }
 
-    free((void *)((HashNode_t *)node)->key); /* free key */
-    ((HashNode_t *)node)->key = NULL;
-    ((HashNode_t *)node)->data = NULL; /* No need to free data */
-    node->next = NULL;
+    new_capacity = (counter->flow_capacity == 0) ? FLOWS_INITIAL_CAPACITY
+                                                 : (uint64_t)counter->flow_capacity * 2;
+    new_capacity = (new_capacity > FLOWS_MAX_CAPACITY) ? FLOWS_MAX_CAPACITY : new_capacity;
+    old_words = (counter->flow_capacity + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    new_words = (new_capacity + BITS_PER_WORD - 1) / BITS_PER_WORD;
 
-    free(node);
-    node = NULL;
+    new_referenced = (uint64_t *)track_realloc(ALLOC_SITE_FLOW_TABLE, counter->referenced,
+                                               new_words * sizeof(uint64_t));
 
-    return;
+    if (new_referenced == NULL)
+    {
+        return false;
+    }
+
+    memset(new_referenced + old_words, 0, (new_words - old_words) * sizeof(uint64_t));
+    counter->referenced = new_referenced;
+
+    new_flows = (packet_node_t *)huge_realloc(ALLOC_SITE_FLOW_TABLE, counter->flows,
+                                              counter->flow_capacity * sizeof(packet_node_t),
+                                              new_capacity * sizeof(packet_node_t));
+
+    if (new_flows == NULL)
+    {
+        return false;
+    }
+
+    counter->flows = new_flows; /* the index holds record numbers, nothing to update */
+    counter->flow_capacity = (uint32_t)new_capacity;
+
+    return true;
 }
 
-static void *key_from_ip(ipv4_datagram_t *datagram)
+/* Squeezes out evicted records, keeping the insertion order of the remaining flows */
+static void packet_counter_compact(packet_counter_t *counter)
 {
-    uint8_t *key = NULL;
+    uint32_t *new_index = NULL;
+    uint32_t from = 0;
+    uint32_t to = 0;
+    uint32_t new_hand = 0;
+    bool hand_set = false;
+
+    new_index =
+        (uint32_t *)track_calloc(ALLOC_SITE_FLOW_TABLE, counter->flow_count, sizeof(uint32_t));
 
-    if (datagram == NULL || datagram->header == NULL)
+    if (new_index == NULL)
     {
-        return NULL;
+        return; /* holes are simply kept */
     }
 
-    key = (uint8_t *)calloc(2, sizeof(ip_addr_t));
+    for (from = 0; from < counter->flow_count; from++)
+    {
+        if (from >= counter->clock_hand && !hand_set)
+        {
+            new_hand = to;
+            hand_set = true;
+        }
 
-    if (key == NULL)
+        if (counter->flows[from].ref_counter == 0)
+        {
+            new_index[from] = FLOW_INDEX_NONE;
+            continue;
+        }
+
+        new_index[from] = to;
+        counter->flows[to] = counter->flows[from];
+        packet_counter_set_referenced(counter, to, packet_counter_is_referenced(counter, from));
+        to++;
+    }
+
+    for (from = to; from < counter->flow_count; from++)
     {
-        return NULL;
+        packet_counter_set_referenced(counter, from, false);
     }
 
-    memcpy(key, &datagram->header->source_address, sizeof(ip_addr_t));
-    memcpy(key + sizeof(ip_addr_t), &datagram->header->destination_address, sizeof(ip_addr_t));
+    flow_index_renumber(counter->index, new_index, counter->flow_count);
+    counter->flow_count = to;
+    counter->holes = 0;
+    counter->clock_hand = hand_set ? new_hand : 0;
 
-    return (void *)key;
+    track_free(ALLOC_SITE_FLOW_TABLE, new_index);
+    new_index = NULL;
 }
 
 void print_packet_counter_hash_table(packet_counter_t *counter)
@@ -103,17 +197,18 @@ void print_packet_counter_hash_table(packet_counter_t *counter)
     uint64_t total = 0;
     uint64_t count = 0;
     int char_printed = 0;
-    HashTable_t *hash_table = NULL;
-    HashNode_t *current = NULL;
+    flow_index_t *index = NULL;
+    uint32_t link = 0;
+    packet_node_t *flow = NULL;
 
-    if (counter == NULL || counter->hash_table == NULL)
+    if (counter == NULL || counter->index == NULL)
     {
         printf("No data.\n");
 
         return;
     }
 
-    hash_table = counter->hash_table;
+    index = counter->index;
 
 #ifdef USE_UNICODE
     printf("┌─────────────────────────────────────────────────────┐\n");
@@ -133,22 +228,23 @@ void print_packet_counter_hash_table(packet_counter_t *counter)
     printf("+-------+-----------------+-----------------+---------+\n");
 #endif
 
-    for (i = 0; i < hash_table->capacity; i++)
+    for (i = 0; i < index->capacity; i++)
     {
-        current = hash_table->table[i];
+        link = index->buckets[i]; /* index + 1 of the first record, 0 for an empty bucket */
 
-        if (current == NULL)
+        if (link == 0)
         {
             printf(PIPE " %*" PRIu64 " " PIPE " %*s " PIPE " %*s " PIPE " %*s " PIPE "\n",
                    SPACE_FOR_INDEX, i, SPACE_FOR_IP, "", SPACE_FOR_IP, "", SPACE_FOR_COUNT, "");
         }
 
-        while (current != NULL)
+        while (link != 0)
         {
-            count = ((packet_node_t *)(current->data))->ref_counter;
+            flow = &counter->flows[link - 1];
+            count = flow->ref_counter;
             total += count;
 
-            if (current == hash_table->table[i])
+            if (link == index->buckets[i])
             {
                 printf(PIPE " %*" PRIu64 " " PIPE " ", SPACE_FOR_INDEX, i);
             }
@@ -157,16 +253,16 @@ void print_packet_counter_hash_table(packet_counter_t *counter)
                 printf(PIPE "       " PIPE " ");
             }
 
-            char_printed = print_ip_addr((ip_addr_t *)current->key);
+            char_printed = print_ip_addr(&flow->src);
             printf("%*s " PIPE " ", MAX(SPACE_FOR_IP - char_printed, 0), "");
-            char_printed = print_ip_addr((ip_addr_t *)(current->key + sizeof(ip_addr_t)));
+            char_printed = print_ip_addr(&flow->dest);
             printf("%*s " PIPE " ", MAX(SPACE_FOR_IP - char_printed, 0), "");
             printf("%*" PRIu64 " " PIPE "\n", SPACE_FOR_COUNT, count);
-            current = (HashNode_t *)current->node.next;
+            link = index->next[link - 1];
         }
 
 #ifdef USE_UNICODE
-        if (i == hash_table->capacity - 1)
+        if (i == index->capacity - 1)
         {
             printf("├───────┴─────────────────┴─────────────────┼─────────┤\n");
         }
@@ -198,6 +294,7 @@ void print_packet_counter_linked_list(packet_counter_t *counter)
     int char_printed = 0;
     uint64_t i = 0;
     uint64_t total = 0;
+    uint32_t index = 0;
     packet_node_t *current = NULL;
 
     if (counter == NULL)
@@ -207,8 +304,6 @@ void print_packet_counter_linked_list(packet_counter_t *counter)
         return;
     }
 
-    current = counter->linked_list;
-
 #ifdef USE_UNICODE
     printf("┌─────────────────────────────────────────────────────┐\n");
     printf("│                     Linked List                     │\n");
@@ -223,8 +318,16 @@ void print_packet_counter_linked_list(packet_counter_t *counter)
     printf("+-------+-----------------+-----------------+---------+\n");
 #endif
 
-    while (current != NULL)
+    /* Newest flows first */
+    for (index = counter->flow_count; index-- > 0;)
     {
+        current = &counter->flows[index];
+
+        if (current->ref_counter == 0)
+        {
+            continue; /* evicted */
+        }
+
         printf(PIPE " %*" PRIu64 " " PIPE " ", SPACE_FOR_INDEX, ++i);
         char_printed = print_ip_addr(&current->src);
         printf("%*s " PIPE " ", MAX(SPACE_FOR_IP - char_printed, 0), "");
@@ -233,8 +336,6 @@ void print_packet_counter_linked_list(packet_counter_t *counter)
         printf("%*" PRIu64 " " PIPE "\n", SPACE_FOR_COUNT, current->ref_counter);
 
         total += current->ref_counter;
-
-        current = (packet_node_t *)current->node.next;
     }
 
 #ifdef USE_UNICODE
@@ -256,58 +357,453 @@ packet_counter_t *packet_counter_create()
 {
     packet_counter_t *counter = NULL;
 
-    counter = (packet_counter_t *)calloc(1, sizeof(packet_counter_t));
+    counter = (packet_counter_t *)track_calloc(ALLOC_SITE_FLOW_TABLE, 1, sizeof(packet_counter_t));
 
     if (counter == NULL)
     {
         return NULL;
     }
 
-    counter->hash_table = hash_table_create(HASH_TABLE_INITIAL_CAPACITY, hash_table_hash_func,
-                                            hash_table_match_func, hash_table_free_node);
-    counter->hash_key_from_ipv4 = key_from_ip;
-    counter->list_node_free = (free_data_t)free;
+    /* src and dest at the start of every record are the key */
+    counter->index = flow_index_create(HASH_TABLE_INITIAL_CAPACITY, packet_counter_hash_key,
+                                       KEY_LENGTH, sizeof(packet_node_t));
+
+    if (counter->index == NULL)
+    {
+        track_free(ALLOC_SITE_FLOW_TABLE, counter);
+        counter = NULL;
+
+        return NULL;
+    }
 
     return counter;
 }
 
+/*****************************************************************************
+ *
+ *   Name:       packet_counter_set_limit
+ *
+ *   Input:      counter      Counter to limit
+ *               max_entries  Maximum number of flows kept in memory, 0 for unlimited
+ *               sink         Function receiving the final count of evicted flows, can be NULL
+ *               context      Passed unchanged to sink
+ *
+ *   Return:     Success      true
+ *               Failed       false if counter is NULL
+ *
+ *   Description:            Once the counter holds max_entries flows, every new flow evicts
+ *                           a cold one chosen with the CLOCK policy: flows hit since the
+ *                           hand last passed them get a second chance.
+ ******************************************************************************/
+bool packet_counter_set_limit(packet_counter_t *counter, uint64_t max_entries,
+                              packet_counter_sink_t sink, void *context)
+{
+    if (counter == NULL)
+    {
+        return false;
+    }
+
+    counter->max_entries = max_entries;
+    counter->overflow_sink = sink;
+    counter->overflow_context = context;
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_counter_entries_for_memory
+ *
+ *   Input:      max_bytes    Memory budget of the counter in bytes
+ *
+ *   Return:     Number of flows that fit in the budget, at least 1
+ *
+ *   Description:            Converts a memory budget to a limit for packet_counter_set_limit.
+ ******************************************************************************/
+uint64_t packet_counter_entries_for_memory(uint64_t max_bytes)
+{
+    return MAX(max_bytes / BYTES_PER_FLOW, 1);
+}
+
+/* Sweeps the CLOCK hand until a flow without its reference bit is found and evicts it */
+static void packet_counter_evict(packet_counter_t *counter)
+{
+    packet_node_t *victim = NULL;
+    uint64_t steps = 0;
+
+    /* Two full sweeps clear every reference bit, so a victim is always found */
+    for (steps = 0; steps < 2 * (uint64_t)counter->flow_count; steps++)
+    {
+        if (counter->clock_hand >= counter->flow_count)
+        {
+            counter->clock_hand = 0;
+        }
+
+        victim = &counter->flows[counter->clock_hand];
+
+        if (victim->ref_counter != 0 &&
+            !packet_counter_is_referenced(counter, counter->clock_hand))
+        {
+            break;
+        }
+
+        packet_counter_set_referenced(counter, counter->clock_hand, false);
+        counter->clock_hand++;
+        victim = NULL;
+    }
+
+    if (victim == NULL)
+    {
+        return;
+    }
+
+    if (counter->overflow_sink != NULL)
+    {
+        counter->overflow_sink(counter->overflow_context, &victim->src, &victim->dest,
+                               victim->ref_counter);
+    }
+
+    flow_index_remove(counter->index, counter->flows, counter->clock_hand);
+    victim->ref_counter = 0; /* leave a hole, records after it keep their index */
+    counter->clock_hand++;
+    counter->holes++;
+    counter->evicted++;
+
+    if (counter->holes >= FLOWS_COMPACT_MIN_HOLES && counter->holes * 2 >= counter->flow_count)
+    {
+        packet_counter_compact(counter);
+    }
+}
+
+/**
+ * Adds count to the flow found by a lookup, index is FLOW_INDEX_NONE if the key has to be
+ * inserted. Returns the index of the flow, FLOW_INDEX_NONE if it could not be inserted.
+ * */
+static uint32_t packet_counter_update(packet_counter_t *counter, const uint8_t *key,
+                                      uint32_t index, uint64_t count)
+{
+    packet_node_t *new_flow = NULL;
+
+    if (index != FLOW_INDEX_NONE)
+    {
+        counter->flows[index].ref_counter += count;
+        packet_counter_set_referenced(counter, index, true);
+
+        return index;
+    }
+
+    instrument_start(insert_start);
+
+    if (counter->max_entries != 0 && counter->index->size >= counter->max_entries)
+    {
+        packet_counter_evict(counter);
+    }
+
+    if (counter->flow_count == counter->flow_capacity && !packet_counter_grow(counter))
+    {
+        fprintf(stderr, "Unable to allocate memory for flow record.\n");
+
+        return FLOW_INDEX_NONE;
+    }
+
+    index = counter->flow_count;
+    new_flow = &counter->flows[index];
+    memcpy(new_flow, key, KEY_LENGTH); /* src and dest are laid out like the key */
+    new_flow->ref_counter = count;
+
+    if (!flow_index_add(counter->index, counter->flows, index))
+    {
+        fprintf(stderr, "Unable to add flow to hash table.\n");
+
+        return FLOW_INDEX_NONE;
+    }
+
+    /* New flows get a second chance, so they survive at least one sweep of the hand */
+    packet_counter_set_referenced(counter, index, true);
+    counter->flow_count++;
+    instrument_stop(INSTRUMENT_INSERT, insert_start);
+
+    return index;
+}
+
+static void packet_counter_add_key(packet_counter_t *counter, const uint8_t *key, uint64_t count)
+{
+    uint32_t index = FLOW_INDEX_NONE;
+    instrument_start(lookup_start);
+
+    index = flow_index_get(counter->index, counter->flows, key);
+    instrument_stop(INSTRUMENT_LOOKUP, lookup_start);
+    packet_counter_update(counter, key, index, count);
+
+    return;
+}
+
 void packet_counter_increase(packet_counter_t *counter, ipv4_datagram_t *datagram)
 {
-    void *key = NULL;
-    packet_node_t *result = NULL;
-    packet_node_t *new_node = NULL;
+    uint8_t key[KEY_LENGTH] = {0};
 
     if (counter == NULL || datagram == NULL || datagram->header == NULL)
     {
         return;
     }
 
-    key = counter->hash_key_from_ipv4(datagram);
-    result = (packet_node_t *)hash_table_get_item(counter->hash_table, key);
+    instrument_start(key_start);
+    memcpy(key, &datagram->header->source_address, sizeof(ip_addr_t));
+    memcpy(key + sizeof(ip_addr_t), &datagram->header->destination_address, sizeof(ip_addr_t));
+    instrument_stop(INSTRUMENT_KEY, key_start);
+    packet_counter_add_key(counter, key, 1);
+
+    return;
+}
+
+/**
+ * Counts one packet for every key of a batch of at most PACKET_COUNTER_BATCH_SIZE, NULL keys are
+ * skipped. Existing flows are found with one prefetching lookup, new flows are inserted after.
+ * */
+static void packet_counter_count_batch(packet_counter_t *counter, const void *const *key_p,
+                                       size_t batch)
+{
+    uint32_t results[PACKET_COUNTER_BATCH_SIZE] = {0};
+    size_t i = 0;
+    size_t j = 0;
+    bool inserted = false;
+    instrument_start(lookup_start);
 
-    if (result == NULL)
+    flow_index_get_many(counter->index, counter->flows, key_p, results, batch);
+    instrument_stop_many(INSTRUMENT_LOOKUP, lookup_start, batch);
+
+    for (i = 0; i < batch; i++)
     {
-        new_node = (packet_node_t *)calloc(1, sizeof(packet_node_t));
+        if (key_p[i] == NULL)
+        {
+            continue;
+        }
 
-        if (new_node == NULL)
+        /**
+         * An insert may evict and compact flows found earlier in the batch, so look
+         * again. The packet was already counted as one lookup.
+         * */
+        if (inserted && counter->max_entries != 0)
         {
-            return;
+            instrument_start(relookup_start);
+            results[i] = flow_index_get(counter->index, counter->flows, key_p[i]);
+            instrument_stop_many(INSTRUMENT_LOOKUP, relookup_start, 0);
         }
 
-        memcpy(&new_node->dest, &datagram->header->destination_address, sizeof(ip_addr_t));
-        memcpy(&new_node->src, &datagram->header->source_address, sizeof(ip_addr_t));
-        new_node->ref_counter = 1;
+        if (results[i] != FLOW_INDEX_NONE)
+        {
+            packet_counter_update(counter, key_p[i], results[i], 1);
+            continue;
+        }
 
-        linked_list_insert_at_head((ListNode_t **)&counter->linked_list, (ListNode_t *)new_node);
-        hash_table_add_item(counter->hash_table, key, (void *)new_node);
+        inserted = true;
+        results[i] = packet_counter_update(counter, key_p[i], FLOW_INDEX_NONE, 1);
 
-        new_node = NULL;
+        /* Later packets of the new flow were looked up before it existed */
+        for (j = i + 1; j < batch && results[i] != FLOW_INDEX_NONE; j++)
+        {
+            if (results[j] == FLOW_INDEX_NONE && key_p[j] != NULL &&
+                memcmp(key_p[j], key_p[i], KEY_LENGTH) == 0)
+            {
+                results[j] = results[i];
+            }
+        }
     }
-    else
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_counter_increase_many
+ *
+ *   Input:      counter      Counter to update
+ *               datagrams    Valid IPv4 datagrams to count
+ *               count        Number of datagrams
+ *
+ *   Return:     None
+ *
+ *   Description:            Counts a batch of datagrams. Existing flows are found with one
+ *                           prefetching flow_index_get_many call per batch, so the cache
+ *                           misses of the lookups overlap. New flows are then inserted
+ *                           one by one.
+ ******************************************************************************/
+void packet_counter_increase_many(packet_counter_t *counter, ipv4_datagram_t *const *datagrams,
+                                  size_t count)
+{
+    uint8_t keys[PACKET_COUNTER_BATCH_SIZE][KEY_LENGTH];
+    const void *key_p[PACKET_COUNTER_BATCH_SIZE] = {0};
+    size_t base = 0;
+    size_t batch = 0;
+    size_t i = 0;
+
+    if (counter == NULL || datagrams == NULL)
     {
-        result->ref_counter++;
-        free(key);
-        key = NULL;
+        return;
+    }
+
+    for (base = 0; base < count; base += batch)
+    {
+        batch = (count - base < PACKET_COUNTER_BATCH_SIZE) ? count - base
+                                                           : PACKET_COUNTER_BATCH_SIZE;
+        instrument_start(key_start);
+
+        for (i = 0; i < batch; i++)
+        {
+            key_p[i] = NULL;
+
+            if (datagrams[base + i] != NULL && datagrams[base + i]->header != NULL)
+            {
+                memcpy(keys[i], &datagrams[base + i]->header->source_address, sizeof(ip_addr_t));
+                memcpy(keys[i] + sizeof(ip_addr_t),
+                       &datagrams[base + i]->header->destination_address, sizeof(ip_addr_t));
+                key_p[i] = keys[i];
+            }
+        }
+
+        instrument_stop_many(INSTRUMENT_KEY, key_start, batch);
+        packet_counter_count_batch(counter, key_p, batch);
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_counter_add_many
+ *
+ *   Input:      counter      Counter to update
+ *               keys         Source and destination of every packet to count
+ *               count        Number of packets
+ *
+ *   Return:     None
+ *
+ *   Description:            Same as packet_counter_increase_many, for packets whose
+ *                           addresses were not decoded from a datagram.
+ ******************************************************************************/
+void packet_counter_add_many(packet_counter_t *counter, const packet_flow_key_t *keys,
+                             size_t count)
+{
+    const void *key_p[PACKET_COUNTER_BATCH_SIZE] = {0};
+    size_t base = 0;
+    size_t batch = 0;
+    size_t i = 0;
+
+    if (counter == NULL || keys == NULL)
+    {
+        return;
+    }
+
+    for (base = 0; base < count; base += batch)
+    {
+        batch = (count - base < PACKET_COUNTER_BATCH_SIZE) ? count - base
+                                                           : PACKET_COUNTER_BATCH_SIZE;
+
+        for (i = 0; i < batch; i++)
+        {
+            key_p[i] = &keys[base + i]; /* already laid out like the key */
+        }
+
+        packet_counter_count_batch(counter, key_p, batch);
+    }
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_counter_add
+ *
+ *   Input:      counter      Counter to update
+ *               src          Source address of the flow
+ *               dest         Destination address of the flow
+ *               count        Number of packets to add to the flow
+ *
+ *   Return:     None
+ *
+ *   Description:            Adds count packets to the flow, creating it if needed. Used to
+ *                           load and merge counts that were not decoded from a datagram.
+ ******************************************************************************/
+void packet_counter_add(packet_counter_t *counter, const ip_addr_t *src, const ip_addr_t *dest,
+                        uint64_t count)
+{
+    uint8_t key[KEY_LENGTH] = {0};
+
+    if (counter == NULL || src == NULL || dest == NULL || count == 0)
+    {
+        return;
+    }
+
+    memcpy(key, src, sizeof(ip_addr_t));
+    memcpy(key + sizeof(ip_addr_t), dest, sizeof(ip_addr_t));
+    packet_counter_add_key(counter, key, count);
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_counter_merge
+ *
+ *   Input:      counter      Counter receiving the flows
+ *               other        Counter whose flows are added, left unchanged
+ *
+ *   Return:     None
+ *
+ *   Description:            Adds every flow of other to counter, summing the counts of
+ *                           flows present in both, and accumulates the eviction count.
+ ******************************************************************************/
+void packet_counter_merge(packet_counter_t *counter, packet_counter_t *other)
+{
+    uint32_t i = 0;
+
+    if (counter == NULL || other == NULL)
+    {
+        return;
+    }
+
+    /* Flows are added in insertion order, evicted holes are skipped by packet_counter_add */
+    for (i = 0; i < other->flow_count; i++)
+    {
+        packet_counter_add(counter, &other->flows[i].src, &other->flows[i].dest,
+                           other->flows[i].ref_counter);
+    }
+
+    counter->evicted += other->evicted;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       packet_counter_merge_flows
+ *
+ *   Input:      counter      Counter receiving the flows
+ *               table        Packed flow counts, left unchanged
+ *
+ *   Return:     None
+ *
+ *   Description:            Adds every flow of the table to counter. Flows are added in
+ *                           slot order, a flow table keeps no insertion order.
+ ******************************************************************************/
+void packet_counter_merge_flows(packet_counter_t *counter, const flow_table_t *table)
+{
+    ip_addr_t src;
+    ip_addr_t dest;
+    uint64_t i = 0;
+
+    if (counter == NULL || table == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < table->capacity; i++)
+    {
+        if (table->records[i].count != 0)
+        {
+            flow_key_addresses(table->records[i].key, &src, &dest);
+            packet_counter_add(counter, &src, &dest, table->records[i].count);
+        }
     }
 
     return;
@@ -320,10 +816,16 @@ void packet_counter_free(packet_counter_t **counter_p)
         return;
     }
 
-    hash_table_free(&(*counter_p)->hash_table);
-    linked_list_delete_list((ListNode_t **)&(*counter_p)->linked_list,
-                            (*counter_p)->list_node_free);
-    free(*counter_p);
+    flow_index_free(&(*counter_p)->index);
+
+    huge_free(ALLOC_SITE_FLOW_TABLE, (*counter_p)->flows,
+              (*counter_p)->flow_capacity * sizeof(packet_node_t));
+    (*counter_p)->flows = NULL;
+
+    track_free(ALLOC_SITE_FLOW_TABLE, (*counter_p)->referenced);
+    (*counter_p)->referenced = NULL;
+
+    track_free(ALLOC_SITE_FLOW_TABLE, *counter_p);
     *counter_p = NULL;
 
     return;
@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instrument.h"
+#include "pcap-file.h"
+
+/* Copies the next length bytes of the file to dest, or into buffer if dest is NULL */
+static bool pcap_file_read(pcap_file_t *pcap_file, uint8_t *dest, dynamic_buffer_t *buffer,
+                           size_t length)
+{
+    size_t part = 0;
+
+    while (length > 0)
+    {
+        if (pcap_file->chunk_pos == pcap_file->chunk_length)
+        {
+            pcap_file->chunk = uring_reader_next(pcap_file->reader, &pcap_file->chunk_length);
+            pcap_file->chunk_pos = 0;
+
+            if (pcap_file->chunk == NULL)
+            {
+                pcap_file->chunk_length = 0;
+
+                return false;
+            }
+        }
+
+        part = pcap_file->chunk_length - pcap_file->chunk_pos;
+        part = (part > length) ? length : part;
+
+        if (dest != NULL)
+        {
+            memcpy(dest, pcap_file->chunk + pcap_file->chunk_pos, part);
+            dest += part;
+        }
+        else if (!dynamic_buffer_add_data(buffer, pcap_file->chunk + pcap_file->chunk_pos, part))
+        {
+            return false;
+        }
+
+        pcap_file->chunk_pos += part;
+        pcap_file->current_pos += (long)part;
+        length -= part;
+    }
+
+    return true;
+}
+
+static uint32_t pcap_file_u32(const pcap_file_t *pcap_file, uint32_t value)
+{
+    return pcap_file->swapped ? __builtin_bswap32(value) : value;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       pcap_file_probe
+ *
+ *   Input:      file_path    File to check
+ *
+ *   Return:     true if the file starts with a pcap magic number in either byte order
+ *
+ *   Description:            Tells pcap captures from Wireshark hex dumps.
+ ******************************************************************************/
+bool pcap_file_probe(const char *file_path)
+{
+    FILE *file = NULL;
+    uint32_t magic = 0;
+    bool pcap = false;
+
+    file = fopen(file_path, "rb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    if (fread(&magic, sizeof(magic), 1, file) == 1)
+    {
+        pcap = (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NANO ||
+                magic == __builtin_bswap32(PCAP_MAGIC) ||
+                magic == __builtin_bswap32(PCAP_MAGIC_NANO));
+    }
+
+    fclose(file);
+    file = NULL;
+
+    return pcap;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       pcap_file_create
+ *
+ *   Input:      file_path    pcap capture of Ethernet frames
+ *               direct       Read with O_DIRECT where the file system supports it
+ *
+ *   Return:     Success      A pointer to the new pcap_file_t, positioned at the first record
+ *               Failed       NULL if the file can not be read or is not an Ethernet pcap
+ *
+ *   Description:            Opens a pcap capture for pcap_file_get_next_packet. The file
+ *                           is read through a uring_reader_t.
+ ******************************************************************************/
+pcap_file_t *pcap_file_create(const char *file_path, bool direct)
+{
+    pcap_file_t *pcap_file = NULL;
+    pcap_file_header_t header;
+
+    if (file_path == NULL)
+    {
+        return NULL;
+    }
+
+    pcap_file = (pcap_file_t *)calloc(1, sizeof(pcap_file_t));
+
+    if (pcap_file == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for pcap_file_t\n");
+        goto cleanup;
+    }
+
+    pcap_file->file_path = (const char *)strdup(file_path);
+    pcap_file->reader = uring_reader_open(file_path, direct);
+
+    if (pcap_file->file_path == NULL || pcap_file->reader == NULL)
+    {
+        goto cleanup;
+    }
+
+    pcap_file->file_length = (long)pcap_file->reader->file_length;
+
+    if (!pcap_file_read(pcap_file, (uint8_t *)&header, NULL, sizeof(header)))
+    {
+        fprintf(stderr, "Truncated pcap header: %s\n", file_path);
+        goto cleanup;
+    }
+
+    pcap_file->swapped = (header.magic == __builtin_bswap32(PCAP_MAGIC) ||
+                          header.magic == __builtin_bswap32(PCAP_MAGIC_NANO));
+
+    if (pcap_file_u32(pcap_file, header.magic) != PCAP_MAGIC &&
+        pcap_file_u32(pcap_file, header.magic) != PCAP_MAGIC_NANO)
+    {
+        fprintf(stderr, "Not a pcap file: %s\n", file_path);
+        goto cleanup;
+    }
+
+    if (pcap_file_u32(pcap_file, header.linktype) != PCAP_LINKTYPE_ETHERNET)
+    {
+        fprintf(stderr, "Unsupported pcap link type %u: %s\n",
+                pcap_file_u32(pcap_file, header.linktype), file_path);
+        goto cleanup;
+    }
+
+    return pcap_file;
+
+cleanup:
+    pcap_file_free(&pcap_file);
+
+    return NULL;
+}
+
+bool pcap_file_readable(pcap_file_t *pcap_file)
+{
+    if (pcap_file == NULL)
+    {
+        return false;
+    }
+
+    return pcap_file->file_length > pcap_file->current_pos;
+}
+
+void pcap_file_free(pcap_file_t **pcap_file_p)
+{
+    if (pcap_file_p == NULL || (*pcap_file_p) == NULL)
+    {
+        return;
+    }
+
+    uring_reader_free(&(*pcap_file_p)->reader);
+
+    free((void *)(*pcap_file_p)->file_path);
+    (*pcap_file_p)->file_path = NULL;
+
+    free((*pcap_file_p));
+    (*pcap_file_p) = NULL;
+
+    return;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       pcap_file_read_packet
+ *
+ *   Input:      pcap_file    pcap file positioned at a record
+ *   Output:     buffer       Captured bytes of the next frame, replacing what it held
+ *
+ *   Return:     Success      true
+ *               Failed       false if the record is truncated or corrupt. The rest of the
+ *                            file is skipped, it can not be parsed any further.
+ *
+ *   Description:            Counterpart of wireshark_file_read_packet for pcap files.
+ ******************************************************************************/
+bool pcap_file_read_packet(pcap_file_t *pcap_file, dynamic_buffer_t *buffer)
+{
+    pcap_record_header_t record;
+    uint32_t length = 0;
+    instrument_start(read_start);
+
+    if (pcap_file == NULL || buffer == NULL)
+    {
+        return false;
+    }
+
+    dynamic_buffer_reset(buffer);
+
+    if (!pcap_file_read(pcap_file, (uint8_t *)&record, NULL, sizeof(record)))
+    {
+        fprintf(stderr, "Truncated pcap record: %s\n", pcap_file->file_path);
+        goto cleanup;
+    }
+
+    length = pcap_file_u32(pcap_file, record.incl_len);
+
+    if (length == 0 || length > PCAP_MAX_RECORD_LEN)
+    {
+        fprintf(stderr, "Corrupt pcap record at offset %ld: %s\n", pcap_file->current_pos,
+                pcap_file->file_path);
+        goto cleanup;
+    }
+
+    if (!dynamic_buffer_reserve(buffer, length))
+    {
+        fprintf(stderr, "Error growing dynamic buffer.\n");
+        goto cleanup;
+    }
+
+    if (!pcap_file_read(pcap_file, NULL, buffer, length))
+    {
+        fprintf(stderr, "Truncated pcap record: %s\n", pcap_file->file_path);
+        goto cleanup;
+    }
+
+    instrument_stop(INSTRUMENT_READ, read_start);
+
+    return true;
+
+cleanup:
+    pcap_file->current_pos = pcap_file->file_length;
+    instrument_stop(INSTRUMENT_READ, read_start);
+
+    return false;
+}
+
+dynamic_buffer_t *pcap_file_get_next_packet(pcap_file_t *pcap_file)
+{
+    dynamic_buffer_t *buffer = NULL;
+
+    if (pcap_file == NULL)
+    {
+        return NULL;
+    }
+
+    buffer = dynamic_buffer_create(DYNAMIC_BUFFER_INLINE_SIZE);
+
+    if (buffer == NULL)
+    {
+        fprintf(stderr, "Error creating dynamic buffer.\n");
+
+        return NULL;
+    }
+
+    if (!pcap_file_read_packet(pcap_file, buffer))
+    {
+        dynamic_buffer_free(&buffer);
+    }
+
+    return buffer;
+}
@@ -0,0 +1,236 @@
+#include <endian.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "output-buffer.h"
+#include "report-export.h"
+
+#define OCTET_VALUES 256
+#define OCTET_MAX_DIGITS 3
+
+#define CSV_HEADER "source,destination,count\n"
+#define JSON_SOURCE "{\"source\":\""
+#define JSON_DESTINATION "\",\"destination\":\""
+#define JSON_COUNT "\",\"count\":"
+#define JSON_END "}\n"
+
+typedef struct octet_text
+{
+    char text[OCTET_MAX_DIGITS];
+    uint8_t length;
+} octet_text_t;
+
+static octet_text_t octet_table[OCTET_VALUES];
+static pthread_once_t octet_table_once = PTHREAD_ONCE_INIT;
+
+static void octet_table_init(void)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < OCTET_VALUES; i++)
+    {
+        octet_table[i].length = (uint8_t)output_buffer_format_u64(i, octet_table[i].text);
+    }
+}
+
+/* Appends a dotted quad, each octet is copied from the precomputed table */
+static bool report_put_ip(output_buffer_t *out, const ip_addr_t *ip)
+{
+    char text[IP_ADDRESS_LENGTH * (OCTET_MAX_DIGITS + 1)];
+    size_t length = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < IP_ADDRESS_LENGTH; i++)
+    {
+        if (i != 0)
+        {
+            text[length++] = '.';
+        }
+
+        memcpy(text + length, octet_table[ip->byte[i]].text, OCTET_MAX_DIGITS);
+        length += octet_table[ip->byte[i]].length;
+    }
+
+    return output_buffer_write(out, text, length);
+}
+
+static bool report_put_csv(output_buffer_t *out, const packet_node_t *flow)
+{
+    return report_put_ip(out, &flow->src) && output_buffer_putc(out, ',') &&
+           report_put_ip(out, &flow->dest) && output_buffer_putc(out, ',') &&
+           output_buffer_put_u64(out, flow->ref_counter) && output_buffer_putc(out, '\n');
+}
+
+static bool report_put_json(output_buffer_t *out, const packet_node_t *flow)
+{
+    return output_buffer_write(out, JSON_SOURCE, sizeof(JSON_SOURCE) - 1) &&
+           report_put_ip(out, &flow->src) &&
+           output_buffer_write(out, JSON_DESTINATION, sizeof(JSON_DESTINATION) - 1) &&
+           report_put_ip(out, &flow->dest) &&
+           output_buffer_write(out, JSON_COUNT, sizeof(JSON_COUNT) - 1) &&
+           output_buffer_put_u64(out, flow->ref_counter) &&
+           output_buffer_write(out, JSON_END, sizeof(JSON_END) - 1);
+}
+
+static bool report_put_binary_header(output_buffer_t *out)
+{
+    uint32_t version = htole32(REPORT_BINARY_VERSION);
+    uint32_t record_size = htole32(sizeof(report_binary_record_t));
+
+    return output_buffer_write(out, REPORT_BINARY_MAGIC, REPORT_BINARY_MAGIC_LENGTH) &&
+           output_buffer_write(out, (const char *)&version, sizeof(version)) &&
+           output_buffer_write(out, (const char *)&record_size, sizeof(record_size));
+}
+
+static bool report_put_binary(output_buffer_t *out, const packet_node_t *flow)
+{
+    report_binary_record_t record;
+
+    record.src = flow->src;
+    record.dest = flow->dest;
+    record.count = htole64(flow->ref_counter);
+
+    return output_buffer_write(out, (const char *)&record, sizeof(record));
+}
+
+/*****************************************************************************
+ *
+ *   Name:       report_format_from_string
+ *
+ *   Input:      name         "csv", "jsonl" or "bin"
+ *   Output:     format       Matching report format
+ *
+ *   Return:     Success      true
+ *               Failed       false if the name is unknown
+ *
+ *   Description:            Parses the name of an export format.
+ ******************************************************************************/
+bool report_format_from_string(const char *name, report_format_t *format)
+{
+    if (name == NULL || format == NULL)
+    {
+        return false;
+    }
+
+    if (strcmp(name, "csv") == 0)
+    {
+        *format = REPORT_FORMAT_CSV;
+    }
+    else if (strcmp(name, "jsonl") == 0)
+    {
+        *format = REPORT_FORMAT_JSON_LINES;
+    }
+    else if (strcmp(name, "bin") == 0)
+    {
+        *format = REPORT_FORMAT_BINARY;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       report_export
+ *
+ *   Input:      counter      Counter to export
+ *               format       Export format
+ *               file_path    File to create, "-" for stdout
+ *
+ *   Return:     Success      true
+ *               Failed       false if the file could not be written
+ *
+ *   Description:            Writes one row per flow in insertion order. Rows are built in
+ *                           a single output buffer from a precomputed octet table and
+ *                           hand-rolled integer formatting, without printf.
+ ******************************************************************************/
+bool report_export(packet_counter_t *counter, report_format_t format, const char *file_path)
+{
+    FILE *file = NULL;
+    output_buffer_t *out = NULL;
+    uint32_t i = 0;
+    bool success = false;
+
+    if (counter == NULL || file_path == NULL)
+    {
+        return false;
+    }
+
+    pthread_once(&octet_table_once, octet_table_init);
+
+    file = (strcmp(file_path, REPORT_PATH_STDOUT) == 0) ? stdout : fopen(file_path, "wb");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file for writing: %s\n", file_path);
+
+        return false;
+    }
+
+    out = output_buffer_create(file, OUTPUT_BUFFER_DEFAULT_SIZE);
+
+    if (out == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for export buffer.\n");
+        goto cleanup;
+    }
+
+    switch (format)
+    {
+        case REPORT_FORMAT_CSV:
+            success = output_buffer_write(out, CSV_HEADER, sizeof(CSV_HEADER) - 1);
+            break;
+        case REPORT_FORMAT_BINARY:
+            success = report_put_binary_header(out);
+            break;
+        default:
+            success = true;
+            break;
+    }
+
+    for (i = 0; i < counter->flow_count && success; i++)
+    {
+        if (counter->flows[i].ref_counter == 0)
+        {
+            continue; /* evicted */
+        }
+
+        switch (format)
+        {
+            case REPORT_FORMAT_CSV:
+                success = report_put_csv(out, &counter->flows[i]);
+                break;
+            case REPORT_FORMAT_JSON_LINES:
+                success = report_put_json(out, &counter->flows[i]);
+                break;
+            case REPORT_FORMAT_BINARY:
+                success = report_put_binary(out, &counter->flows[i]);
+                break;
+        }
+    }
+
+    success = output_buffer_flush(out) && success;
+
+cleanup:
+    output_buffer_free(&out);
+
+    if (file == stdout)
+    {
+        success = (fflush(file) == 0) && success;
+    }
+    else
+    {
+        success = (fclose(file) == 0) && success;
+    }
+
+    if (!success)
+    {
+        fprintf(stderr, "Failed to export report to %s\n", file_path);
+    }
+
+    return success;
+}
@@ -0,0 +1,169 @@
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "spsc-ring.h"
+
+#define SPIN_LIMIT 64 /* empty or full polls before yielding the CPU */
+
+/*****************************************************************************
+ *
+ *   Name:       spsc_ring_create
+ *
+ *   Input:      capacity     Minimum number of items, rounded up to a power of two
+ *
+ *   Return:     Success      A pointer to the new ring
+ *               Failed       NULL
+ *
+ *   Description:            Creates an empty, open ring.
+ ******************************************************************************/
+spsc_ring_t *spsc_ring_create(size_t capacity)
+{
+    spsc_ring_t *ring = NULL;
+    size_t size = 2;
+
+    while (size < capacity)
+    {
+        size *= 2;
+    }
+
+    ring = (spsc_ring_t *)aligned_alloc(SPSC_RING_CACHE_LINE, sizeof(spsc_ring_t));
+
+    if (ring == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for ring.\n");
+
+        return NULL;
+    }
+
+    ring->slots = (void **)calloc(size, sizeof(void *));
+
+    if (ring->slots == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for ring slots.\n");
+        free(ring);
+
+        return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->closed, false);
+    ring->cached_head = 0;
+    ring->cached_tail = 0;
+    ring->mask = size - 1;
+
+    return ring;
+}
+
+/* Producer only. Returns false if the ring is full. */
+bool spsc_ring_try_push(spsc_ring_t *ring, void *item)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - ring->cached_tail > ring->mask)
+    {
+        /* Looks full, read the consumer position again */
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (head - ring->cached_tail > ring->mask)
+        {
+            return false;
+        }
+    }
+
+    ring->slots[head & ring->mask] = item;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+/* Producer only. Waits while the ring is full, which is the backpressure of the pipeline. */
+void spsc_ring_push(spsc_ring_t *ring, void *item)
+{
+    unsigned spins = 0;
+
+    while (!spsc_ring_try_push(ring, item))
+    {
+        spsc_ring_backoff(&spins);
+    }
+}
+
+/* Consumer only. Returns NULL if the ring is empty. */
+void *spsc_ring_try_pop(spsc_ring_t *ring)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    void *item = NULL;
+
+    if (tail == ring->cached_head)
+    {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        if (tail == ring->cached_head)
+        {
+            return NULL;
+        }
+    }
+
+    item = ring->slots[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return item;
+}
+
+/* Producer only, after its last push */
+void spsc_ring_close(spsc_ring_t *ring)
+{
+    atomic_store_explicit(&ring->closed, true, memory_order_release);
+}
+
+/* Consumer only. True once the producer closed the ring and every item was popped. */
+bool spsc_ring_drained(spsc_ring_t *ring)
+{
+    /* closed is read first, so a push made before closing is always seen below */
+    return atomic_load_explicit(&ring->closed, memory_order_acquire) &&
+           atomic_load_explicit(&ring->tail, memory_order_relaxed) ==
+               atomic_load_explicit(&ring->head, memory_order_acquire);
+}
+
+/* Spins for a while, then yields, so waiting threads do not starve the others of CPU */
+void spsc_ring_backoff(unsigned *spins)
+{
+    if (++(*spins) < SPIN_LIMIT)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    else
+    {
+        sched_yield();
+    }
+}
+
+/*****************************************************************************
+ *
+ *   Name:       spsc_ring_free
+ *
+ *   Input:      ring_p       A pointer to the ring to free
+ *
+ *   Return:     None
+ *
+ *   Description:            Frees the ring, items still queued are not freed. The pointer
+ *                           is set to NULL.
+ ******************************************************************************/
+void spsc_ring_free(spsc_ring_t **ring_p)
+{
+    if (ring_p == NULL || *ring_p == NULL)
+    {
+        return;
+    }
+
+    free((*ring_p)->slots);
+    (*ring_p)->slots = NULL;
+
+    free(*ring_p);
+    *ring_p = NULL;
+
+    return;
+}
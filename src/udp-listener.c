@@ -0,0 +1,360 @@
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "instrument.h"
+#include "udp-listener.h"
+
+#define MICROSECONDS_PER_MILLISECOND 1000
+#define PORT_MAX 65535
+
+typedef struct udp_listener
+{
+    pthread_t thread;
+    unsigned index;
+    const struct sockaddr_in *address;
+    const ingest_config_t *config;
+    volatile sig_atomic_t *stop;
+    bool reuse_port;
+    int fd;
+    packet_counter_t *counter;
+    hhh_t *hhh;
+    ingest_stats_t stats;
+    bool success;
+} udp_listener_t;
+
+/*****************************************************************************
+ *
+ *   Name:       udp_listener_parse_address
+ *
+ *   Input:      str          port, or IPv4 address and port as address:port
+ *   Output:     address      Address to bind to, any local address if only a port is given
+ *
+ *   Return:     Success      true
+ *               Failed       false for a malformed address or port
+ *
+ *   Description:            Parses the address given to -u.
+ ******************************************************************************/
+bool udp_listener_parse_address(const char *str, struct sockaddr_in *address)
+{
+    char host[INET_ADDRSTRLEN] = {0};
+    const char *port = NULL;
+    char *endptr = NULL;
+    unsigned long number = 0;
+
+    if (str == NULL || address == NULL)
+    {
+        return false;
+    }
+
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_addr.s_addr = htonl(INADDR_ANY);
+    port = strrchr(str, ':');
+
+    if (port != NULL)
+    {
+        if ((size_t)(port - str) >= sizeof(host))
+        {
+            return false;
+        }
+
+        memcpy(host, str, (size_t)(port - str));
+
+        if (inet_pton(AF_INET, host, &address->sin_addr) != 1)
+        {
+            return false;
+        }
+
+        port++;
+    }
+    else
+    {
+        port = str;
+    }
+
+    number = strtoul(port, &endptr, 10);
+
+    if (endptr == port || *endptr != '\0' || number == 0 || number > PORT_MAX)
+    {
+        return false;
+    }
+
+    address->sin_port = htons((uint16_t)number);
+
+    return true;
+}
+
+static bool udp_listener_open(udp_listener_t *listener)
+{
+    struct timeval timeout = {0, UDP_LISTENER_POLL_MS * MICROSECONDS_PER_MILLISECOND};
+    int buffer_size = UDP_LISTENER_BUFFER_SIZE;
+    int enable = 1;
+
+    listener->fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    if (listener->fd < 0)
+    {
+        perror("Unable to open UDP socket");
+
+        return false;
+    }
+
+    /* The destination of every datagram comes with it, also when bound to any address */
+    if (setsockopt(listener->fd, IPPROTO_IP, IP_PKTINFO, &enable, sizeof(enable)) != 0 ||
+        setsockopt(listener->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        (listener->reuse_port &&
+         setsockopt(listener->fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) != 0))
+    {
+        perror("Unable to set UDP socket options");
+
+        return false;
+    }
+
+    /* Only a hint, the kernel caps it at net.core.rmem_max */
+    setsockopt(listener->fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+
+    if (bind(listener->fd, (const struct sockaddr *)listener->address,
+             sizeof(*listener->address)) != 0)
+    {
+        perror("Unable to bind UDP socket");
+
+        return false;
+    }
+
+    return true;
+}
+
+/* Destination address of a received datagram, from its IP_PKTINFO control message */
+static bool udp_listener_destination(struct msghdr *header, ip_addr_t *dest)
+{
+    struct cmsghdr *control = NULL;
+    struct in_pktinfo info;
+
+    for (control = CMSG_FIRSTHDR(header); control != NULL;
+         control = CMSG_NXTHDR(header, control))
+    {
+        if (control->cmsg_level == IPPROTO_IP && control->cmsg_type == IP_PKTINFO)
+        {
+            memcpy(&info, CMSG_DATA(control), sizeof(info));
+            memcpy(dest->byte, &info.ipi_addr, sizeof(dest->byte));
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void *udp_listener_thread(void *arg)
+{
+    udp_listener_t *listener = (udp_listener_t *)arg;
+    struct mmsghdr messages[UDP_LISTENER_BATCH];
+    struct sockaddr_in sources[UDP_LISTENER_BATCH];
+    uint8_t controls[UDP_LISTENER_BATCH][CMSG_SPACE(sizeof(struct in_pktinfo))];
+    uint8_t payload = 0; /* payloads are not needed, every datagram is truncated into this */
+    struct iovec vector = {&payload, sizeof(payload)};
+    ingest_metrics_delta_t delta = {0};
+    packet_flow_key_t keys[UDP_LISTENER_BATCH];
+    int received = 0;
+    int i = 0;
+
+    cpu_affinity_pin(listener->config->cpus, listener->index);
+    ingest_metrics_publish(listener->config->metrics, &delta,
+                           listener->counter->flow_count - listener->counter->holes,
+                           listener->counter->index->capacity);
+
+    while (!*listener->stop)
+    {
+        for (i = 0; i < UDP_LISTENER_BATCH; i++)
+        {
+            memset(&messages[i], 0, sizeof(messages[i]));
+            messages[i].msg_hdr.msg_name = &sources[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+            messages[i].msg_hdr.msg_iov = &vector;
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = controls[i];
+            messages[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+        }
+
+        /* Blocks for the first datagram only, then takes whatever else is queued */
+        received = recvmmsg(listener->fd, messages, UDP_LISTENER_BATCH,
+                            MSG_WAITFORONE | MSG_TRUNC, NULL);
+
+        if (received < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("Unable to receive datagrams");
+            listener->success = false;
+            break;
+        }
+
+        for (i = 0; i < received; i++)
+        {
+            memcpy(keys[i].src.byte, &sources[i].sin_addr, sizeof(keys[i].src.byte));
+
+            if (!udp_listener_destination(&messages[i].msg_hdr, &keys[i].dest))
+            {
+                memcpy(keys[i].dest.byte, &listener->address->sin_addr,
+                       sizeof(keys[i].dest.byte));
+            }
+
+            hhh_update(listener->hhh, &keys[i].src, &keys[i].dest);
+            delta.bytes_read += messages[i].msg_len; /* full length thanks to MSG_TRUNC */
+        }
+
+        packet_counter_add_many(listener->counter, keys, (size_t)received);
+
+        listener->stats.packet_total += (uint64_t)received;
+        listener->stats.packet_valid += (uint64_t)received;
+        delta.packets_read += (uint64_t)received;
+        delta.packets_valid += (uint64_t)received;
+        ingest_metrics_publish(listener->config->metrics, &delta,
+                               listener->counter->flow_count - listener->counter->holes,
+                               listener->counter->index->capacity);
+    }
+
+    instrument_thread_done();
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       udp_listener_run
+ *
+ *   Input:      address      Local address and port to receive on
+ *               threads      Receiving threads, each with its own SO_REUSEPORT socket
+ *               config       Ingest options, flow limit, metrics and cpus are used here
+ *               counter      Counter receiving the merged counts
+ *               hhh          Detector receiving the merged heavy hitters, can be NULL
+ *               stop         Receiving ends once this is set, by a signal handler
+ *   Output:     stats        Datagrams received
+ *
+ *   Return:     Success      true
+ *               Failed       false if a socket could not be bound or a thread not started
+ *
+ *   Description:            Counts the (source, destination) pair of every datagram sent
+ *                           to the address, draining them in batches with recvmmsg. With
+ *                           several threads the kernel spreads senders over the sockets
+ *                           by hash, every thread counts into its own counter and the
+ *                           counters are merged once receiving stops.
+ ******************************************************************************/
+bool udp_listener_run(const struct sockaddr_in *address, unsigned threads,
+                      const ingest_config_t *config, packet_counter_t *counter, hhh_t *hhh,
+                      ingest_stats_t *stats, volatile sig_atomic_t *stop)
+{
+    udp_listener_t *listeners = NULL;
+    unsigned opened = 0;
+    unsigned started = 0;
+    unsigned i = 0;
+    bool success = true;
+
+    if (address == NULL || config == NULL || counter == NULL || stats == NULL || stop == NULL)
+    {
+        return false;
+    }
+
+    threads = (threads == 0) ? 1 : threads;
+    threads = (threads > UDP_LISTENER_MAX_THREADS) ? UDP_LISTENER_MAX_THREADS : threads;
+    listeners = (udp_listener_t *)calloc(threads, sizeof(udp_listener_t));
+
+    if (listeners == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for UDP listeners.\n");
+
+        return false;
+    }
+
+    for (opened = 0; opened < threads && success; opened++)
+    {
+        listeners[opened].index = opened;
+        listeners[opened].fd = -1;
+        listeners[opened].address = address;
+        listeners[opened].config = config;
+        listeners[opened].stop = stop;
+        listeners[opened].reuse_port = (threads > 1);
+        listeners[opened].success = true;
+        listeners[opened].counter = (threads == 1) ? counter : packet_counter_create();
+        listeners[opened].hhh = (threads == 1 || hhh == NULL) ? hhh
+                                                              : hhh_create(HHH_DEFAULT_COUNTERS);
+
+        if (listeners[opened].counter == NULL || (hhh != NULL && listeners[opened].hhh == NULL))
+        {
+            fprintf(stderr, "Unable to create counter for UDP listener.\n");
+            success = false;
+        }
+        else if (threads > 1)
+        {
+            packet_counter_set_limit(listeners[opened].counter, config->max_entries,
+                                     config->overflow_sink, config->overflow_context);
+        }
+
+        success = success && udp_listener_open(&listeners[opened]);
+    }
+
+    if (success && threads == 1)
+    {
+        udp_listener_thread(&listeners[0]);
+        started = 0;
+    }
+    else if (success)
+    {
+        for (started = 0; started < threads; started++)
+        {
+            if (pthread_create(&listeners[started].thread, NULL, udp_listener_thread,
+                               &listeners[started]) != 0)
+            {
+                fprintf(stderr, "Unable to start UDP listener.\n");
+                *stop = 1; /* the started ones are not waited for any longer */
+                success = false;
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(listeners[i].thread, NULL);
+    }
+
+    for (i = 0; i < opened; i++)
+    {
+        success = success && listeners[i].success;
+        stats->packet_total += listeners[i].stats.packet_total;
+        stats->packet_valid += listeners[i].stats.packet_valid;
+
+        if (listeners[i].fd >= 0)
+        {
+            close(listeners[i].fd);
+            listeners[i].fd = -1;
+        }
+
+        if (listeners[i].counter != counter)
+        {
+            packet_counter_merge(counter, listeners[i].counter);
+            hhh_merge(hhh, listeners[i].hhh);
+            packet_counter_free(&listeners[i].counter);
+            hhh_free(&listeners[i].hhh);
+        }
+    }
+
+    ingest_metrics_set_table(config->metrics, counter->flow_count - counter->holes,
+                             counter->index->capacity);
+    free(listeners);
+    listeners = NULL;
+
+    return success;
+}
@@ -6,7 +6,7 @@
 #include "common.h"
 #include "udp-packet.h"
 
-udp_packet_t *udp_packet_from_ipv4_datagram(ipv4_datagram_t *datagram)
+static udp_packet_t *udp_packet_decode(ipv4_datagram_t *datagram, packet_arena_t *arena)
 {
     udp_packet_t *packet = NULL;
     udp_header_t *header = NULL;
@@ -32,7 +32,8 @@ udp_packet_t *udp_packet_from_ipv4_datagram(ipv4_datagram_t *datagram)
         goto cleanup;
     }
 
-    header = (udp_header_t *)calloc(1, sizeof(udp_header_t));
+    header =
+        (udp_header_t *)packet_arena_calloc(arena, ALLOC_SITE_UDP, 1, sizeof(udp_header_t));
 
     if (header == NULL)
     {
@@ -63,7 +64,8 @@ udp_packet_t *udp_packet_from_ipv4_datagram(ipv4_datagram_t *datagram)
     }
 
     data_len = datagram->data_len - sizeof(udp_header_t);
-    packet = (udp_packet_t *)calloc(1, sizeof(udp_packet_t) + data_len);
+    packet = (udp_packet_t *)packet_arena_calloc(arena, ALLOC_SITE_UDP, 1,
+                                                 sizeof(udp_packet_t) + data_len);
 
     if (packet == NULL)
     {
@@ -78,15 +80,32 @@ udp_packet_t *udp_packet_from_ipv4_datagram(ipv4_datagram_t *datagram)
     return packet;
 
 cleanup:
-    free(header);
+    packet_arena_release(arena, ALLOC_SITE_UDP, header);
     header = NULL;
 
-    free(packet);
+    packet_arena_release(arena, ALLOC_SITE_UDP, packet);
     packet = NULL;
 
     return NULL;
 }
 
+udp_packet_t *udp_packet_from_ipv4_datagram(ipv4_datagram_t *datagram)
+{
+    return udp_packet_decode(datagram, NULL);
+}
+
+/* Same as udp_packet_from_ipv4_datagram, allocated from arena until it is reset, not freed */
+udp_packet_t *udp_packet_from_ipv4_datagram_arena(ipv4_datagram_t *datagram,
+                                                  packet_arena_t *arena)
+{
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+
+    return udp_packet_decode(datagram, arena);
+}
+
 void udp_packet_free(udp_packet_t **packet_p)
 {
     if (packet_p == NULL || *packet_p == NULL)
@@ -94,10 +113,10 @@ void udp_packet_free(udp_packet_t **packet_p)
         return;
     }
 
-    free((*packet_p)->header);
+    track_free(ALLOC_SITE_UDP, (*packet_p)->header);
     (*packet_p)->header = NULL;
 
-    free((*packet_p));
+    track_free(ALLOC_SITE_UDP, (*packet_p));
     (*packet_p) = NULL;
 
     return;
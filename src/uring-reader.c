@@ -0,0 +1,540 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "uring-reader.h"
+
+#define STAT_OK 0
+
+static int uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static void uring_queues_destroy(uring_queues_t *queues)
+{
+    if (queues->sqes != NULL)
+    {
+        munmap(queues->sqes, queues->sqes_size);
+        queues->sqes = NULL;
+    }
+
+    if (queues->cq_map != NULL && queues->cq_map != queues->sq_map)
+    {
+        munmap(queues->cq_map, queues->cq_map_size);
+    }
+
+    queues->cq_map = NULL;
+
+    if (queues->sq_map != NULL)
+    {
+        munmap(queues->sq_map, queues->sq_map_size);
+        queues->sq_map = NULL;
+    }
+
+    if (queues->fd >= 0)
+    {
+        close(queues->fd);
+        queues->fd = -1;
+    }
+}
+
+static bool uring_queues_init(uring_queues_t *queues, uring_slot_t *slots, unsigned count)
+{
+    struct io_uring_params params;
+    struct iovec iovecs[URING_READER_BUFFERS];
+    unsigned i = 0;
+
+    memset(&params, 0, sizeof(params));
+    memset(queues, 0, sizeof(*queues));
+    queues->fd = uring_setup(count, &params);
+
+    if (queues->fd < 0)
+    {
+        return false; /* old kernel or io_uring disabled, the caller falls back to pread */
+    }
+
+    queues->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    queues->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        queues->sq_map_size = (queues->cq_map_size > queues->sq_map_size) ? queues->cq_map_size
+                                                                          : queues->sq_map_size;
+    }
+
+    queues->sq_map = mmap(NULL, queues->sq_map_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, queues->fd, IORING_OFF_SQ_RING);
+
+    if (queues->sq_map == MAP_FAILED)
+    {
+        queues->sq_map = NULL;
+        goto cleanup;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        queues->cq_map = queues->sq_map;
+    }
+    else
+    {
+        queues->cq_map = mmap(NULL, queues->cq_map_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, queues->fd, IORING_OFF_CQ_RING);
+
+        if (queues->cq_map == MAP_FAILED)
+        {
+            queues->cq_map = NULL;
+            goto cleanup;
+        }
+    }
+
+    queues->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    queues->sqes = mmap(NULL, queues->sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, queues->fd, IORING_OFF_SQES);
+
+    if (queues->sqes == MAP_FAILED)
+    {
+        queues->sqes = NULL;
+        goto cleanup;
+    }
+
+    queues->sq_head = (unsigned *)((uint8_t *)queues->sq_map + params.sq_off.head);
+    queues->sq_tail = (unsigned *)((uint8_t *)queues->sq_map + params.sq_off.tail);
+    queues->sq_mask = (unsigned *)((uint8_t *)queues->sq_map + params.sq_off.ring_mask);
+    queues->sq_array = (unsigned *)((uint8_t *)queues->sq_map + params.sq_off.array);
+    queues->cq_head = (unsigned *)((uint8_t *)queues->cq_map + params.cq_off.head);
+    queues->cq_tail = (unsigned *)((uint8_t *)queues->cq_map + params.cq_off.tail);
+    queues->cq_mask = (unsigned *)((uint8_t *)queues->cq_map + params.cq_off.ring_mask);
+    queues->cqes = (uint8_t *)queues->cq_map + params.cq_off.cqes;
+
+    /* Registered buffers are pinned once instead of on every read, plain reads work without */
+    for (i = 0; i < count; i++)
+    {
+        iovecs[i].iov_base = slots[i].data;
+        iovecs[i].iov_len = URING_READER_BUFFER_SIZE;
+    }
+
+    queues->fixed_buffers =
+        (uring_register(queues->fd, IORING_REGISTER_BUFFERS, iovecs, count) == 0);
+
+    return true;
+
+cleanup:
+    uring_queues_destroy(queues);
+
+    return false;
+}
+
+/* Queues the read of the unfilled part of a slot, submitted by uring_reader_flush */
+static void uring_reader_queue(uring_reader_t *reader, unsigned slot_index)
+{
+    uring_queues_t *queues = &reader->queues;
+    uring_slot_t *slot = &reader->slots[slot_index];
+    struct io_uring_sqe *sqe = NULL;
+    unsigned tail = *queues->sq_tail; /* only this thread produces submissions */
+    unsigned index = tail & *queues->sq_mask;
+
+    sqe = &((struct io_uring_sqe *)queues->sqes)[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = queues->fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = reader->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(slot->data + slot->filled);
+    sqe->len = (uint32_t)(URING_READER_BUFFER_SIZE - slot->filled);
+    sqe->off = slot->chunk * URING_READER_BUFFER_SIZE + slot->filled;
+    sqe->buf_index = queues->fixed_buffers ? (uint16_t)slot_index : 0;
+    sqe->user_data = slot_index;
+
+    queues->sq_array[index] = index;
+    __atomic_store_n(queues->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static bool uring_reader_flush(uring_reader_t *reader, unsigned queued)
+{
+    int result = 0;
+
+    while (queued > 0)
+    {
+        result = uring_enter(reader->queues.fd, queued, 0, 0);
+
+        if (result < 0 && errno != EINTR)
+        {
+            perror("Unable to submit reads");
+
+            return false;
+        }
+
+        if (result == 0)
+        {
+            fprintf(stderr, "Unable to submit reads: the kernel accepted none of them.\n");
+
+            return false;
+        }
+
+        queued -= (result > 0) ? (unsigned)result : 0;
+    }
+
+    return true;
+}
+
+/**
+ * Where the read of a slot continues after a short read of filled bytes. O_DIRECT offsets must
+ * stay aligned, so the partial block is read again. Returns false if that makes no progress.
+ * */
+static bool uring_reader_resume(const uring_reader_t *reader, uring_slot_t *slot, size_t previous)
+{
+    size_t resume = slot->filled;
+
+    if (reader->direct)
+    {
+        resume -= resume % URING_READER_ALIGNMENT;
+    }
+
+    if (resume <= previous)
+    {
+        fprintf(stderr, "Short read at offset %" PRIu64 " cannot be resumed.\n",
+                slot->chunk * URING_READER_BUFFER_SIZE + slot->filled);
+
+        return false;
+    }
+
+    slot->filled = resume;
+
+    return true;
+}
+
+/* Waits for one completion and records it, or queues the rest of a short read */
+static bool uring_reader_reap(uring_reader_t *reader, bool resubmit)
+{
+    uring_queues_t *queues = &reader->queues;
+    struct io_uring_cqe *cqe = NULL;
+    uring_slot_t *slot = NULL;
+    unsigned head = 0;
+    size_t previous = 0;
+    int result = 0;
+
+    head = *queues->cq_head;
+
+    while (head == __atomic_load_n(queues->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        if (uring_enter(queues->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            perror("Unable to wait for reads");
+
+            return false;
+        }
+    }
+
+    cqe = &((struct io_uring_cqe *)queues->cqes)[head & *queues->cq_mask];
+    slot = &reader->slots[cqe->user_data];
+    result = cqe->res;
+    __atomic_store_n(queues->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    if (result < 0)
+    {
+        fprintf(stderr, "Error reading at offset %" PRIu64 ": %s\n",
+                slot->chunk * URING_READER_BUFFER_SIZE, strerror(-result));
+        slot->state = URING_SLOT_READY;
+        reader->read_error = true;
+
+        return true;
+    }
+
+    previous = slot->filled;
+    slot->filled += (size_t)result;
+
+    /* Regular files rarely return short reads before the end, but they may */
+    if (resubmit && result > 0 && slot->filled < URING_READER_BUFFER_SIZE &&
+        (off_t)(slot->chunk * URING_READER_BUFFER_SIZE + slot->filled) < reader->file_length)
+    {
+        if (!uring_reader_resume(reader, slot, previous))
+        {
+            slot->state = URING_SLOT_READY;
+            reader->read_error = true;
+
+            return true;
+        }
+
+        uring_reader_queue(reader, (unsigned)cqe->user_data);
+
+        return uring_reader_flush(reader, 1);
+    }
+
+    slot->state = URING_SLOT_READY;
+
+    return true;
+}
+
+static bool uring_reader_pread(uring_reader_t *reader, uring_slot_t *slot)
+{
+    ssize_t result = 0;
+    size_t previous = 0;
+
+    slot->chunk = reader->next_consume;
+    slot->filled = 0;
+
+    while (slot->filled < URING_READER_BUFFER_SIZE)
+    {
+        result = pread(reader->fd, slot->data + slot->filled,
+                       URING_READER_BUFFER_SIZE - slot->filled,
+                       (off_t)(slot->chunk * URING_READER_BUFFER_SIZE + slot->filled));
+
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (result < 0)
+        {
+            perror("Error reading file");
+
+            return false;
+        }
+
+        if (result == 0)
+        {
+            break;
+        }
+
+        previous = slot->filled;
+        slot->filled += (size_t)result;
+
+        if (slot->filled < URING_READER_BUFFER_SIZE &&
+            (off_t)(slot->chunk * URING_READER_BUFFER_SIZE + slot->filled) < reader->file_length &&
+            !uring_reader_resume(reader, slot, previous))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       uring_reader_open
+ *
+ *   Input:      file_path    File to read from start to end
+ *               direct       Bypass the page cache with O_DIRECT where supported
+ *
+ *   Return:     Success      A pointer to the new reader
+ *               Failed       NULL
+ *
+ *   Description:            Opens a file for sequential reading through io_uring, with
+ *                           URING_READER_BUFFERS large aligned reads in flight, so that
+ *                           one thread can keep a fast device busy. Falls back to pread
+ *                           when io_uring is not available.
+ ******************************************************************************/
+uring_reader_t *uring_reader_open(const char *file_path, bool direct)
+{
+    uring_reader_t *reader = NULL;
+    struct stat file_stat;
+    unsigned i = 0;
+
+    if (file_path == NULL)
+    {
+        return NULL;
+    }
+
+    reader = (uring_reader_t *)calloc(1, sizeof(uring_reader_t));
+
+    if (reader == NULL)
+    {
+        fprintf(stderr, "Could not allocate memory for uring_reader_t\n");
+
+        return NULL;
+    }
+
+    reader->queues.fd = -1;
+    reader->fd = direct ? open(file_path, O_RDONLY | O_DIRECT) : -1;
+    reader->direct = (reader->fd >= 0);
+
+    if (reader->fd < 0)
+    {
+        /* Some file systems refuse O_DIRECT, the page cache path still works */
+        reader->fd = open(file_path, O_RDONLY);
+    }
+
+    if (reader->fd < 0 || fstat(reader->fd, &file_stat) != STAT_OK)
+    {
+        fprintf(stderr, "Error opening file for reading: %s\n", file_path);
+        goto cleanup;
+    }
+
+    reader->file_length = file_stat.st_size;
+
+    for (i = 0; i < URING_READER_BUFFERS; i++)
+    {
+        if (posix_memalign((void **)&reader->slots[i].data, URING_READER_ALIGNMENT,
+                           URING_READER_BUFFER_SIZE) != 0)
+        {
+            reader->slots[i].data = NULL;
+            fprintf(stderr, "Could not allocate read buffers\n");
+            goto cleanup;
+        }
+    }
+
+    reader->use_uring = uring_queues_init(&reader->queues, reader->slots, URING_READER_BUFFERS);
+
+    if (!reader->use_uring)
+    {
+        posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    return reader;
+
+cleanup:
+    uring_reader_free(&reader);
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       uring_reader_next
+ *
+ *   Input:      reader       Reader of the file
+ *   Output:     length       Bytes in the returned chunk
+ *
+ *   Return:     Success      The next chunk of the file, valid until the next call
+ *               Failed       NULL at the end of the file or on a read error
+ *
+ *   Description:            Hands out the file in order, one buffer at a time. The
+ *                           buffer returned by the previous call is read again, and the
+ *                           other buffers stay in flight while the caller works.
+ ******************************************************************************/
+const uint8_t *uring_reader_next(uring_reader_t *reader, size_t *length)
+{
+    uring_slot_t *slot = NULL;
+    unsigned queued = 0;
+
+    if (reader == NULL || length == NULL)
+    {
+        return NULL;
+    }
+
+    *length = 0;
+
+    if (reader->holding)
+    {
+        reader->slots[(reader->next_consume - 1) % URING_READER_BUFFERS].state = URING_SLOT_FREE;
+        reader->holding = false;
+    }
+
+    if ((off_t)(reader->next_consume * URING_READER_BUFFER_SIZE) >= reader->file_length)
+    {
+        return NULL;
+    }
+
+    slot = &reader->slots[reader->next_consume % URING_READER_BUFFERS];
+
+    if (!reader->use_uring)
+    {
+        if (!uring_reader_pread(reader, slot))
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        while (reader->next_submit < reader->next_consume + URING_READER_BUFFERS &&
+               (off_t)(reader->next_submit * URING_READER_BUFFER_SIZE) < reader->file_length)
+        {
+            reader->slots[reader->next_submit % URING_READER_BUFFERS].chunk = reader->next_submit;
+            reader->slots[reader->next_submit % URING_READER_BUFFERS].filled = 0;
+            reader->slots[reader->next_submit % URING_READER_BUFFERS].state = URING_SLOT_IN_FLIGHT;
+            uring_reader_queue(reader, reader->next_submit % URING_READER_BUFFERS);
+            reader->next_submit++;
+            queued++;
+        }
+
+        if (!uring_reader_flush(reader, queued))
+        {
+            return NULL;
+        }
+
+        /* Completions of later chunks are recorded on the way */
+        while (slot->state != URING_SLOT_READY)
+        {
+            if (!uring_reader_reap(reader, true))
+            {
+                return NULL;
+            }
+        }
+
+        if (reader->read_error)
+        {
+            return NULL;
+        }
+    }
+
+    reader->next_consume++;
+    reader->holding = true;
+    *length = slot->filled;
+
+    return (slot->filled != 0) ? slot->data : NULL;
+}
+
+void uring_reader_free(uring_reader_t **reader_p)
+{
+    uring_reader_t *reader = NULL;
+    unsigned i = 0;
+    bool in_flight = false;
+
+    if (reader_p == NULL || *reader_p == NULL)
+    {
+        return;
+    }
+
+    reader = *reader_p;
+
+    /* The kernel may still write into the buffers until their reads complete */
+    do
+    {
+        in_flight = false;
+
+        for (i = 0; i < URING_READER_BUFFERS && reader->use_uring; i++)
+        {
+            in_flight = in_flight || (reader->slots[i].state == URING_SLOT_IN_FLIGHT);
+        }
+    } while (in_flight && uring_reader_reap(reader, false));
+
+    uring_queues_destroy(&reader->queues);
+
+    for (i = 0; i < URING_READER_BUFFERS; i++)
+    {
+        free(reader->slots[i].data);
+        reader->slots[i].data = NULL;
+    }
+
+    if (reader->fd >= 0)
+    {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+
+    free(reader);
+    *reader_p = NULL;
+
+    return;
+}
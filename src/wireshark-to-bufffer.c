@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "instrument.h"
 #include "wireshark-to-buffer.h"
 
 #define LINE_BUF_LEN 80     /* Buffer size to store 1 line from file */
@@ -12,8 +13,6 @@
 #define FSEEK_OK 0
 #define BASE_HEX 16
 
-#define DYNAMIC_BUFFER_INIT_SIZE 128 /* Buffer is initialized with this capacity */
-
 wireshark_file_t *wireshark_file_create(const char *file_path)
 {
     wireshark_file_t *ws_file = NULL;
@@ -91,6 +90,77 @@ bool wireshark_file_readable(wireshark_file_t *ws_file)
     return ws_file->file_length > ws_file->current_pos;
 }
 
+/*****************************************************************************
+ *
+ *   Name:       wireshark_file_packet_start
+ *
+ *   Input:      ws_file      Wireshark file
+ *               offset       Byte offset anywhere in the file
+ *
+ *   Return:     Success      Offset of the first packet that starts after the first
+ *                           packet separator at or after offset, 0 for offset 0, or the
+ *                           file length if there is none
+ *               Failed       -1 if the file could not be read
+ *
+ *   Description:            Finds a packet boundary near offset, so that byte ranges of a
+ *                           file can be read independently. Ranges that share their
+ *                           bounds through this function cover every packet once.
+ ******************************************************************************/
+long wireshark_file_packet_start(wireshark_file_t *ws_file, long offset)
+{
+    FILE *file = NULL;
+    char line_buf[LINE_BUF_LEN] = {0};
+    long position = -1;
+    bool line_start = false;
+
+    if (ws_file == NULL || offset < 0)
+    {
+        return -1;
+    }
+
+    if (offset == 0 || offset >= ws_file->file_length)
+    {
+        return (offset == 0) ? 0 : ws_file->file_length;
+    }
+
+    file = fopen(ws_file->file_path, "r");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Error opening file for reading: %s\n", ws_file->file_path);
+
+        return -1;
+    }
+
+    if (fseek(file, offset, SEEK_SET) != FSEEK_OK)
+    {
+        fprintf(stderr, "Error on fseek to %ld on file: %s\n", offset, ws_file->file_path);
+        fclose(file);
+
+        return -1;
+    }
+
+    position = ws_file->file_length;
+
+    /* The rest of the line holding offset is skipped, it may be the tail of a data line */
+    while (fgets(line_buf, LINE_BUF_LEN, file))
+    {
+        if (line_start && strnlen(line_buf, LINE_DATA_END) < LINE_DATA_START)
+        {
+            /* Packets are separated by a line too short to hold data */
+            position = ftell(file);
+            break;
+        }
+
+        line_start = (strchr(line_buf, '\n') != NULL);
+    }
+
+    fclose(file);
+    file = NULL;
+
+    return position;
+}
+
 void wireshark_file_free(wireshark_file_t **ws_file_p)
 {
     if (ws_file_p == NULL || (*ws_file_p) == NULL)
@@ -107,9 +177,22 @@ void wireshark_file_free(wireshark_file_t **ws_file_p)
     return;
 }
 
-dynamic_buffer_t *wireshark_file_get_next_packet(wireshark_file_t *ws_file)
+/*****************************************************************************
+ *
+ *   Name:       wireshark_file_read_packet
+ *
+ *   Input:      ws_file      Wireshark file
+ *   Output:     buffer       Bytes of the next packet, replacing what it held
+ *
+ *   Return:     Success      true
+ *               Failed       false at the end of the file or if it could not be read
+ *
+ *   Description:            Decodes the hex lines of the next packet into a buffer the
+ *                           caller keeps across packets, so reading allocates only when a
+ *                           packet is larger than any before.
+ ******************************************************************************/
+bool wireshark_file_read_packet(wireshark_file_t *ws_file, dynamic_buffer_t *buffer)
 {
-    dynamic_buffer_t *buffer = NULL;
     FILE *file = NULL;
     char line_buf[LINE_BUF_LEN] = {0};
     uint8_t content[LINE_MAX_CONTENT] = {0};
@@ -118,12 +201,15 @@ dynamic_buffer_t *wireshark_file_get_next_packet(wireshark_file_t *ws_file)
     char *startptr = NULL;
     long temp_value = 0;
     bool success = false;
+    instrument_start(read_start);
+    instrument_declare(hex_ticks); /* hex decoding time, reported apart from reading */
 
-    if (ws_file == NULL)
+    if (ws_file == NULL || buffer == NULL)
     {
-        return NULL;
+        return false;
     }
 
+    dynamic_buffer_reset(buffer);
     file = fopen(ws_file->file_path, "r");
 
     if (file == NULL)
@@ -152,14 +238,6 @@ dynamic_buffer_t *wireshark_file_get_next_packet(wireshark_file_t *ws_file)
         goto cleanup;
     }
 
-    buffer = dynamic_buffer_create(DYNAMIC_BUFFER_INIT_SIZE);
-
-    if (buffer == NULL)
-    {
-        fprintf(stderr, "Error creating dynamic buffer.\n");
-        goto cleanup;
-    }
-
     success = true;
 
     while ((ws_file->current_pos < ws_file->file_length) && success)
@@ -179,6 +257,7 @@ dynamic_buffer_t *wireshark_file_get_next_packet(wireshark_file_t *ws_file)
             break;
         }
 
+        instrument_start(hex_start);
         startptr = line_buf + LINE_DATA_START;
         content_pos = 0;
 
@@ -204,12 +283,12 @@ dynamic_buffer_t *wireshark_file_get_next_packet(wireshark_file_t *ws_file)
         }
 
         success = success && dynamic_buffer_add_data(buffer, content, content_pos);
+        instrument_add(hex_ticks, hex_start);
     }
 
     if (success == false)
     {
         fprintf(stderr, "Failed to add data to buffer\n");
-        dynamic_buffer_free(&buffer);
     }
 
 cleanup:
@@ -220,5 +299,34 @@ cleanup:
         file = NULL;
     }
 
+    instrument_stop_excluding(INSTRUMENT_READ, read_start, hex_ticks);
+    instrument_record_total(INSTRUMENT_HEX_DECODE, hex_ticks);
+
+    return success;
+}
+
+dynamic_buffer_t *wireshark_file_get_next_packet(wireshark_file_t *ws_file)
+{
+    dynamic_buffer_t *buffer = NULL;
+
+    if (ws_file == NULL)
+    {
+        return NULL;
+    }
+
+    buffer = dynamic_buffer_create(DYNAMIC_BUFFER_INLINE_SIZE);
+
+    if (buffer == NULL)
+    {
+        fprintf(stderr, "Error creating dynamic buffer.\n");
+
+        return NULL;
+    }
+
+    if (!wireshark_file_read_packet(ws_file, buffer))
+    {
+        dynamic_buffer_free(&buffer);
+    }
+
     return buffer;
 }
\ No newline at end of file
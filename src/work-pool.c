@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "instrument.h"
+#include "work-pool.h"
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+typedef struct work_pool_worker
+{
+    work_pool_t *pool;
+    unsigned index;
+} work_pool_worker_t;
+
+static bool work_deque_init(work_deque_t *deque)
+{
+    deque->tasks = (work_task_t *)calloc(DEQUE_INITIAL_CAPACITY, sizeof(work_task_t));
+
+    if (deque->tasks == NULL)
+    {
+        return false;
+    }
+
+    deque->capacity = DEQUE_INITIAL_CAPACITY;
+    deque->top = 0;
+    deque->bottom = 0;
+    pthread_mutex_init(&deque->lock, NULL);
+
+    return true;
+}
+
+static bool work_deque_push(work_deque_t *deque, work_task_t task)
+{
+    work_task_t *new_tasks = NULL;
+    size_t i = 0;
+    bool success = true;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom - deque->top == deque->capacity)
+    {
+        new_tasks = (work_task_t *)calloc(deque->capacity * 2, sizeof(work_task_t));
+
+        if (new_tasks != NULL)
+        {
+            for (i = deque->top; i < deque->bottom; i++)
+            {
+                new_tasks[i & (deque->capacity * 2 - 1)] = deque->tasks[i & (deque->capacity - 1)];
+            }
+
+            free(deque->tasks);
+            deque->tasks = new_tasks;
+            deque->capacity *= 2;
+        }
+        else
+        {
+            success = false;
+        }
+    }
+
+    if (success)
+    {
+        deque->tasks[deque->bottom & (deque->capacity - 1)] = task;
+        deque->bottom++;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return success;
+}
+
+/* Newest task first for the owner, it is the most likely to be in cache */
+static bool work_deque_pop(work_deque_t *deque, work_task_t *task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom != deque->top)
+    {
+        deque->bottom--;
+        *task = deque->tasks[deque->bottom & (deque->capacity - 1)];
+        found = true;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+/* Oldest task for thieves, usually the largest piece of work left */
+static bool work_deque_steal(work_deque_t *deque, work_task_t *task)
+{
+    bool found = false;
+
+    if (pthread_mutex_trylock(&deque->lock) != 0)
+    {
+        return false; /* busy, try another victim */
+    }
+
+    if (deque->bottom != deque->top)
+    {
+        *task = deque->tasks[deque->top & (deque->capacity - 1)];
+        deque->top++;
+        found = true;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return found;
+}
+
+static void *work_pool_worker_run(void *arg)
+{
+    work_pool_worker_t *worker = (work_pool_worker_t *)arg;
+    work_pool_t *pool = worker->pool;
+    work_task_t task;
+    size_t seen = 0;
+    unsigned victim = 0;
+    unsigned i = 0;
+    bool found = false;
+
+    cpu_affinity_pin(pool->cpus, worker->index);
+
+    while (atomic_load(&pool->pending) != 0)
+    {
+        pthread_mutex_lock(&pool->idle_lock);
+        seen = pool->submitted;
+        pthread_mutex_unlock(&pool->idle_lock);
+
+        found = work_deque_pop(&pool->deques[worker->index], &task);
+
+        for (i = 1; i < pool->worker_count && !found; i++)
+        {
+            victim = (worker->index + i) % pool->worker_count;
+            found = work_deque_steal(&pool->deques[victim], &task);
+        }
+
+        if (!found)
+        {
+            /* Tasks still running may submit more, sleep until they do or all are done */
+            pthread_mutex_lock(&pool->idle_lock);
+
+            while (pool->submitted == seen && atomic_load(&pool->pending) != 0)
+            {
+                pthread_cond_wait(&pool->work_ready, &pool->idle_lock);
+            }
+
+            pthread_mutex_unlock(&pool->idle_lock);
+            continue;
+        }
+
+        task.func(pool, worker->index, task.arg);
+
+        if (atomic_fetch_sub(&pool->pending, 1) == 1)
+        {
+            pthread_mutex_lock(&pool->idle_lock);
+            pthread_cond_broadcast(&pool->work_ready);
+            pthread_mutex_unlock(&pool->idle_lock);
+        }
+    }
+
+    instrument_thread_done();
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       work_pool_create
+ *
+ *   Input:      worker_count Number of worker threads, at least 1
+ *               cpus         CPUs the workers are pinned to in order, can be NULL
+ *
+ *   Return:     Success      A pointer to the new pool
+ *               Failed       NULL
+ *
+ *   Description:            Creates a work stealing pool. Tasks are submitted with
+ *                           work_pool_submit and run by work_pool_run.
+ ******************************************************************************/
+work_pool_t *work_pool_create(unsigned worker_count, const cpu_list_t *cpus)
+{
+    work_pool_t *pool = NULL;
+    unsigned i = 0;
+
+    if (worker_count == 0)
+    {
+        return NULL;
+    }
+
+    pool = (work_pool_t *)calloc(1, sizeof(work_pool_t));
+
+    if (pool == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for work pool.\n");
+
+        return NULL;
+    }
+
+    pool->deques = (work_deque_t *)calloc(worker_count, sizeof(work_deque_t));
+    pool->threads = (pthread_t *)calloc(worker_count, sizeof(pthread_t));
+
+    if (pool->deques == NULL || pool->threads == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for work pool.\n");
+        goto cleanup;
+    }
+
+    for (pool->worker_count = 0; pool->worker_count < worker_count; pool->worker_count++)
+    {
+        if (!work_deque_init(&pool->deques[pool->worker_count]))
+        {
+            fprintf(stderr, "Unable to allocate memory for work deque.\n");
+            goto cleanup;
+        }
+    }
+
+    pool->cpus = cpus;
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->next_worker, 0);
+    pthread_mutex_init(&pool->idle_lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pool->submitted = 0;
+
+    return pool;
+
+cleanup:
+    for (i = 0; i < pool->worker_count; i++)
+    {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+
+    free(pool->deques);
+    free(pool->threads);
+    free(pool);
+
+    return NULL;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       work_pool_submit
+ *
+ *   Input:      pool         Pool receiving the task
+ *               worker       Deque of this worker, or -1 to spread tasks round robin
+ *               func         Task function
+ *               arg          Passed to func
+ *
+ *   Return:     Success      true
+ *               Failed       false if the task could not be queued
+ *
+ *   Description:            Queues a task. Running tasks pass their own worker index, so
+ *                           the tasks they create stay local unless another worker steals
+ *                           them, and wakes one idle worker.
+ ******************************************************************************/
+bool work_pool_submit(work_pool_t *pool, int worker, work_task_func_t func, void *arg)
+{
+    work_task_t task = {func, arg};
+    unsigned index = 0;
+
+    if (pool == NULL || func == NULL)
+    {
+        return false;
+    }
+
+    index = (worker >= 0) ? (unsigned)worker : atomic_fetch_add(&pool->next_worker, 1);
+    atomic_fetch_add(&pool->pending, 1);
+
+    if (!work_deque_push(&pool->deques[index % pool->worker_count], task))
+    {
+        atomic_fetch_sub(&pool->pending, 1);
+        fprintf(stderr, "Unable to queue task.\n");
+
+        return false;
+    }
+
+    pthread_mutex_lock(&pool->idle_lock);
+    pool->submitted++;
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->idle_lock);
+
+    return true;
+}
+
+/*****************************************************************************
+ *
+ *   Name:       work_pool_run
+ *
+ *   Input:      pool         Pool with submitted tasks
+ *
+ *   Return:     Success      true
+ *               Failed       false if no worker thread could be started
+ *
+ *   Description:            Runs the tasks, and the tasks they submit, on the worker
+ *                           threads and returns once all of them are done. Every worker
+ *                           has its own thread, so pinning them leaves the affinity of the
+ *                           calling thread alone. Workers without a task sleep until one is
+ *                           submitted or the last one finishes.
+ ******************************************************************************/
+bool work_pool_run(work_pool_t *pool)
+{
+    work_pool_worker_t *workers = NULL;
+    unsigned started = 0;
+    unsigned i = 0;
+
+    if (pool == NULL)
+    {
+        return false;
+    }
+
+    workers = (work_pool_worker_t *)calloc(pool->worker_count, sizeof(work_pool_worker_t));
+
+    if (workers == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for work pool workers.\n");
+
+        return false;
+    }
+
+    for (i = 0; i < pool->worker_count; i++)
+    {
+        workers[i].pool = pool;
+        workers[i].index = i;
+    }
+
+    /* Tasks on the deque of a worker that did not start are stolen by the others */
+    for (started = 0; started < pool->worker_count; started++)
+    {
+        if (pthread_create(&pool->threads[started], NULL, work_pool_worker_run,
+                           &workers[started]) != 0)
+        {
+            fprintf(stderr, "Unable to start work pool worker.\n");
+            break;
+        }
+    }
+
+    for (i = 0; i < started; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(workers);
+
+    return started != 0;
+}
+
+void work_pool_free(work_pool_t **pool_p)
+{
+    unsigned i = 0;
+
+    if (pool_p == NULL || *pool_p == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < (*pool_p)->worker_count; i++)
+    {
+        pthread_mutex_destroy(&(*pool_p)->deques[i].lock);
+        free((*pool_p)->deques[i].tasks);
+        (*pool_p)->deques[i].tasks = NULL;
+    }
+
+    free((*pool_p)->deques);
+    (*pool_p)->deques = NULL;
+
+    free((*pool_p)->threads);
+    (*pool_p)->threads = NULL;
+
+    pthread_cond_destroy(&(*pool_p)->work_ready);
+    pthread_mutex_destroy(&(*pool_p)->idle_lock);
+
+    free(*pool_p);
+    *pool_p = NULL;
+
+    return;
+}
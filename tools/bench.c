@@ -0,0 +1,625 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "ethernet-frame.h"
+#include "flow-index.h"
+#include "flow-table.h"
+#include "ipv4-packet.h"
+#include "packet-arena.h"
+#include "packet-counter.h"
+#include "wireshark-to-buffer.h"
+
+#define OPTION_STRING "c:n:p:k:F:z:s:"
+
+#define DEFAULT_CAPTURE "data/multi.txt"
+#define DEFAULT_OPERATIONS 1000000ULL  /* operations of the in memory benchmarks */
+#define DEFAULT_PACKETS 20000ULL       /* packets read by the file benchmark */
+#define DEFAULT_MAX_KEYS 1000000ULL    /* largest hash table benchmark */
+#define DEFAULT_FLOWS 100000ULL        /* distinct flows of the counter benchmarks */
+#define DEFAULT_ZIPF_SKEW 1.0
+#define DEFAULT_SEED 0x9e3779b97f4a7c15ULL
+
+#define MIN_KEYS 1000ULL
+#define KEYS_STEP 10ULL
+#define KEY_LENGTH 8 /* source and destination address, like the counter keys */
+
+#define SPLITMIX_INCREMENT 0x9e3779b97f4a7c15ULL
+#define SPLITMIX_MULTIPLIER_1 0xbf58476d1ce4e5b9ULL
+#define SPLITMIX_MULTIPLIER_2 0x94d049bb133111ebULL
+
+typedef struct bench_config
+{
+    const char *capture_path;
+    uint64_t operations;
+    uint64_t packets;
+    uint64_t max_keys;
+    uint64_t flows;
+    double zipf_skew;
+    uint64_t seed;
+} bench_config_t;
+
+static uint64_t random_state = DEFAULT_SEED;
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-c capture] [-n operations] [-p packets] [-k max_keys] [-F flows] "
+            "[-z skew] [-s seed]\n",
+            program);
+    fprintf(stderr, "  -c capture    Wireshark capture used by the decoding benchmarks\n");
+    fprintf(stderr, "  -n ops        operations of the in memory benchmarks, default %llu\n",
+            DEFAULT_OPERATIONS);
+    fprintf(stderr, "  -p packets    packets read by the hex decoding benchmark, default %llu\n",
+            DEFAULT_PACKETS);
+    fprintf(stderr, "  -k max_keys   largest hash table, from 1e3 in steps of 10, default %llu\n",
+            DEFAULT_MAX_KEYS);
+    fprintf(stderr, "  -F flows      distinct flows of the counter benchmarks, default %llu\n",
+            DEFAULT_FLOWS);
+    fprintf(stderr, "  -z skew       Zipf skew of the counter benchmark, default %.1f\n",
+            DEFAULT_ZIPF_SKEW);
+    fprintf(stderr, "  -s seed       random seed\n");
+}
+
+/* splitmix64, a bijection of the counter, so distinct inputs give distinct keys */
+static uint64_t splitmix64(uint64_t value)
+{
+    value += SPLITMIX_INCREMENT;
+    value = (value ^ (value >> 30)) * SPLITMIX_MULTIPLIER_1;
+    value = (value ^ (value >> 27)) * SPLITMIX_MULTIPLIER_2;
+
+    return value ^ (value >> 31);
+}
+
+static uint64_t random_next(void)
+{
+    random_state = splitmix64(random_state);
+
+    return random_state;
+}
+
+static double random_unit(void)
+{
+    return (double)(random_next() >> 11) / (double)(1ULL << 53);
+}
+
+static double now_seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / NANOSECONDS_PER_SECOND;
+}
+
+/* One line per benchmark, fixed columns so that runs can be diffed */
+static void report(const char *name, uint64_t operations, double seconds)
+{
+    double ns_per_op = 0;
+    double per_second = 0;
+
+    if (operations != 0 && seconds > 0)
+    {
+        ns_per_op = seconds * NANOSECONDS_PER_SECOND / (double)operations;
+        per_second = (double)operations / seconds;
+    }
+
+    printf("%-40s %12" PRIu64 " ops %12.1f ns/op %14.0f pkts/s\n", name, operations, ns_per_op,
+           per_second);
+    fflush(stdout);
+}
+
+/* Reads packets from the capture until count packets were decoded, restarting at its end */
+static bool bench_hex_decode(const bench_config_t *config)
+{
+    wireshark_file_t *ws_file = NULL;
+    dynamic_buffer_t *buf = NULL;
+    uint64_t decoded = 0;
+    double start = 0;
+
+    buf = dynamic_buffer_create(DYNAMIC_BUFFER_INLINE_SIZE); /* reused like the readers do */
+
+    if (buf == NULL)
+    {
+        return false;
+    }
+
+    start = now_seconds();
+
+    while (decoded < config->packets)
+    {
+        if (!wireshark_file_readable(ws_file))
+        {
+            wireshark_file_free(&ws_file);
+            ws_file = wireshark_file_create(config->capture_path);
+
+            if (!wireshark_file_readable(ws_file))
+            {
+                fprintf(stderr, "Capture is empty or unreadable: %s\n", config->capture_path);
+                wireshark_file_free(&ws_file);
+                dynamic_buffer_free(&buf);
+
+                return false;
+            }
+        }
+
+        wireshark_file_read_packet(ws_file, buf);
+        decoded++;
+    }
+
+    report("wireshark_file_read_packet", decoded, now_seconds() - start);
+    wireshark_file_free(&ws_file);
+    dynamic_buffer_free(&buf);
+
+    return true;
+}
+
+/* Decodes Ethernet and IPv4 headers of packets that were read into memory beforehand */
+static bool bench_frame_decode(const bench_config_t *config)
+{
+    wireshark_file_t *ws_file = NULL;
+    dynamic_buffer_t **buffers = NULL;
+    dynamic_buffer_t **new_buffers = NULL;
+    ethernet_frame_t **frames = NULL;
+    ethernet_frame_t *frame = NULL;
+    ipv4_datagram_t *datagram = NULL;
+    packet_arena_t *arena = NULL;
+    size_t buffer_count = 0;
+    size_t buffer_capacity = 0;
+    uint64_t i = 0;
+    double start = 0;
+    double frame_seconds = 0;
+    double ipv4_seconds = 0;
+    double arena_seconds = 0;
+    bool success = false;
+
+    ws_file = wireshark_file_create(config->capture_path);
+
+    while (wireshark_file_readable(ws_file))
+    {
+        if (buffer_count == buffer_capacity)
+        {
+            buffer_capacity = (buffer_capacity == 0) ? 1024 : buffer_capacity * 2;
+            new_buffers = (dynamic_buffer_t **)realloc(buffers,
+                                                        buffer_capacity * sizeof(*buffers));
+
+            if (new_buffers == NULL)
+            {
+                fprintf(stderr, "Unable to allocate memory for packets.\n");
+                goto cleanup;
+            }
+
+            buffers = new_buffers;
+        }
+
+        buffers[buffer_count] = wireshark_file_get_next_packet(ws_file);
+
+        if (buffers[buffer_count] != NULL)
+        {
+            buffer_count++;
+        }
+    }
+
+    if (buffer_count == 0)
+    {
+        fprintf(stderr, "Capture is empty or unreadable: %s\n", config->capture_path);
+        goto cleanup;
+    }
+
+    start = now_seconds();
+
+    for (i = 0; i < config->operations; i++)
+    {
+        frame = ethernet_frame_from_dynamic_buffer(buffers[i % buffer_count]);
+        ethernet_frame_free(&frame);
+    }
+
+    frame_seconds = now_seconds() - start;
+
+    /* IPv4 decoding is timed alone, on frames that were decoded beforehand */
+    frames = (ethernet_frame_t **)calloc(buffer_count, sizeof(ethernet_frame_t *));
+
+    if (frames == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for frames.\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < buffer_count; i++)
+    {
+        frames[i] = ethernet_frame_from_dynamic_buffer(buffers[i]);
+    }
+
+    start = now_seconds();
+
+    for (i = 0; i < config->operations; i++)
+    {
+        datagram = ipv4_datagram_from_ethernet_frame(frames[i % buffer_count]);
+        ipv4_datagram_free(&datagram);
+    }
+
+    ipv4_seconds = now_seconds() - start;
+
+    /* Both decoders from a bump arena that is reset after every packet */
+    arena = packet_arena_create(0);
+
+    if (arena == NULL)
+    {
+        goto cleanup;
+    }
+
+    start = now_seconds();
+
+    for (i = 0; i < config->operations; i++)
+    {
+        frame = ethernet_frame_from_dynamic_buffer_arena(buffers[i % buffer_count], arena);
+        datagram = ipv4_datagram_from_ethernet_frame_arena(frame, arena);
+        packet_arena_reset(arena);
+    }
+
+    arena_seconds = now_seconds() - start;
+    frame = NULL;
+    datagram = NULL;
+
+    report("ethernet_frame_from_dynamic_buffer", config->operations, frame_seconds);
+    report("ipv4_datagram_from_ethernet_frame", config->operations, ipv4_seconds);
+    report("ethernet_and_ipv4_from_arena", config->operations, arena_seconds);
+    success = true;
+
+cleanup:
+    for (i = 0; i < buffer_count; i++)
+    {
+        dynamic_buffer_free(&buffers[i]);
+
+        if (frames != NULL)
+        {
+            ethernet_frame_free(&frames[i]);
+        }
+    }
+
+    free(frames);
+    free(buffers);
+    packet_arena_free(&arena);
+    wireshark_file_free(&ws_file);
+
+    return success;
+}
+
+/* Inserts keys distinct keys into the counter's flow index, then looks them up in random order */
+static bool bench_flow_index(uint64_t keys, uint64_t operations)
+{
+    flow_index_t *index = NULL;
+    uint64_t *key_data = NULL;
+    uint64_t lookups = 0;
+    uint64_t found = 0;
+    uint64_t i = 0;
+    char name[64];
+    double start = 0;
+    bool success = false;
+
+    key_data = (uint64_t *)malloc(keys * sizeof(uint64_t));
+    index = flow_index_create(1, packet_counter_hash_key, KEY_LENGTH, sizeof(uint64_t));
+
+    if (key_data == NULL || index == NULL || keys > UINT32_MAX)
+    {
+        fprintf(stderr, "Unable to allocate memory for %" PRIu64 " keys.\n", keys);
+        goto cleanup;
+    }
+
+    for (i = 0; i < keys; i++)
+    {
+        key_data[i] = splitmix64(i ^ random_state);
+    }
+
+    start = now_seconds();
+
+    for (i = 0; i < keys; i++)
+    {
+        flow_index_add(index, key_data, (uint32_t)i);
+    }
+
+    snprintf(name, sizeof(name), "flow_index_add keys=%" PRIu64, keys);
+    report(name, keys, now_seconds() - start);
+
+    lookups = (operations > keys) ? operations : keys;
+    start = now_seconds();
+
+    for (i = 0; i < lookups; i++)
+    {
+        found += flow_index_get(index, key_data, &key_data[random_next() % keys]) !=
+                 FLOW_INDEX_NONE;
+    }
+
+    snprintf(name, sizeof(name), "flow_index_get keys=%" PRIu64, keys);
+    report(name, lookups, now_seconds() - start);
+    success = found == lookups;
+
+    if (!success)
+    {
+        fprintf(stderr, "Only %" PRIu64 " of %" PRIu64 " keys were found.\n", found, lookups);
+    }
+
+cleanup:
+    flow_index_free(&index);
+    free(key_data);
+
+    return success;
+}
+
+/* Flow indices drawn uniformly, or from a Zipf distribution through its inverted CDF */
+static uint32_t *bench_flow_sequence(uint64_t flows, uint64_t count, double skew, bool zipf)
+{
+    uint32_t *sequence = NULL;
+    double *cdf = NULL;
+    double total = 0;
+    double target = 0;
+    uint64_t low = 0;
+    uint64_t high = 0;
+    uint64_t middle = 0;
+    uint64_t i = 0;
+
+    sequence = (uint32_t *)malloc(count * sizeof(uint32_t));
+    cdf = zipf ? (double *)malloc(flows * sizeof(double)) : NULL;
+
+    if (sequence == NULL || (zipf && cdf == NULL))
+    {
+        fprintf(stderr, "Unable to allocate memory for the flow sequence.\n");
+        free(sequence);
+        free(cdf);
+
+        return NULL;
+    }
+
+    for (i = 0; zipf && i < flows; i++)
+    {
+        total += 1.0 / pow((double)(i + 1), skew);
+        cdf[i] = total;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (!zipf)
+        {
+            sequence[i] = (uint32_t)(random_next() % flows);
+            continue;
+        }
+
+        target = random_unit() * total;
+        low = 0;
+        high = flows - 1;
+
+        while (low < high)
+        {
+            middle = low + (high - low) / 2;
+
+            if (cdf[middle] < target)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+
+        sequence[i] = (uint32_t)low;
+    }
+
+    free(cdf);
+
+    return sequence;
+}
+
+static bool bench_packet_counter(const bench_config_t *config, bool zipf, bool batched)
+{
+    packet_counter_t *counter = NULL;
+    ipv4_header_t *headers = NULL;
+    ipv4_datagram_t **datagrams = NULL;
+    ipv4_datagram_t *batch[PACKET_COUNTER_BATCH_SIZE] = {0};
+    uint32_t *sequence = NULL;
+    uint64_t address = 0;
+    uint64_t i = 0;
+    uint64_t j = 0;
+    char name[64];
+    double start = 0;
+    bool success = false;
+
+    counter = packet_counter_create();
+    headers = (ipv4_header_t *)calloc(config->flows, sizeof(ipv4_header_t));
+    datagrams = (ipv4_datagram_t **)calloc(config->flows, sizeof(ipv4_datagram_t *));
+    sequence = bench_flow_sequence(config->flows, config->operations, config->zipf_skew, zipf);
+
+    if (counter == NULL || headers == NULL || datagrams == NULL || sequence == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the counter benchmark.\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < config->flows; i++)
+    {
+        datagrams[i] = (ipv4_datagram_t *)calloc(1, sizeof(ipv4_datagram_t));
+
+        if (datagrams[i] == NULL)
+        {
+            fprintf(stderr, "Unable to allocate memory for the counter benchmark.\n");
+            goto cleanup;
+        }
+
+        address = splitmix64(i ^ random_state);
+        headers[i].protocol = IPV4_PROTOCOL_UDP;
+        memcpy(&headers[i].source_address, &address, sizeof(ip_addr_t));
+        memcpy(&headers[i].destination_address, (uint8_t *)&address + sizeof(ip_addr_t),
+               sizeof(ip_addr_t));
+        datagrams[i]->header = &headers[i];
+    }
+
+    start = now_seconds();
+
+    for (i = 0; i < config->operations; i++)
+    {
+        if (!batched)
+        {
+            packet_counter_increase(counter, datagrams[sequence[i]]);
+            continue;
+        }
+
+        batch[j++] = datagrams[sequence[i]];
+
+        if (j == PACKET_COUNTER_BATCH_SIZE || i + 1 == config->operations)
+        {
+            packet_counter_increase_many(counter, batch, j);
+            j = 0;
+        }
+    }
+
+    snprintf(name, sizeof(name), "packet_counter_increase%s %s", batched ? "_many" : "",
+             zipf ? "zipf" : "uniform");
+    report(name, config->operations, now_seconds() - start);
+    success = true;
+
+cleanup:
+    for (i = 0; datagrams != NULL && i < config->flows; i++)
+    {
+        free(datagrams[i]);
+    }
+
+    free(datagrams);
+    free(headers);
+    free(sequence);
+    packet_counter_free(&counter);
+
+    return success;
+}
+
+/* Counts the same flow sequences as bench_packet_counter into the packed flow table */
+static bool bench_flow_table(const bench_config_t *config, bool zipf)
+{
+    flow_table_t *table = NULL;
+    uint64_t *keys = NULL;
+    uint64_t batch[FLOW_TABLE_PREFETCH_BATCH] = {0};
+    uint32_t *sequence = NULL;
+    uint64_t i = 0;
+    uint64_t j = 0;
+    char name[64];
+    double start = 0;
+    bool success = false;
+
+    table = flow_table_create(0);
+    keys = (uint64_t *)calloc(config->flows, sizeof(uint64_t));
+    sequence = bench_flow_sequence(config->flows, config->operations, config->zipf_skew, zipf);
+
+    if (table == NULL || keys == NULL || sequence == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for the flow table benchmark.\n");
+        goto cleanup;
+    }
+
+    for (i = 0; i < config->flows; i++)
+    {
+        keys[i] = splitmix64(i ^ random_state);
+    }
+
+    start = now_seconds();
+
+    for (i = 0; i < config->operations; i++)
+    {
+        batch[j++] = keys[sequence[i]];
+
+        if (j == FLOW_TABLE_PREFETCH_BATCH || i + 1 == config->operations)
+        {
+            flow_table_add_many(table, batch, j);
+            j = 0;
+        }
+    }
+
+    snprintf(name, sizeof(name), "flow_table_add_many %s", zipf ? "zipf" : "uniform");
+    report(name, config->operations, now_seconds() - start);
+    success = true;
+
+cleanup:
+    free(keys);
+    free(sequence);
+    flow_table_free(&table);
+
+    return success;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_config_t config = {
+        .capture_path = DEFAULT_CAPTURE,
+        .operations = DEFAULT_OPERATIONS,
+        .packets = DEFAULT_PACKETS,
+        .max_keys = DEFAULT_MAX_KEYS,
+        .flows = DEFAULT_FLOWS,
+        .zipf_skew = DEFAULT_ZIPF_SKEW,
+        .seed = DEFAULT_SEED,
+    };
+    uint64_t keys = 0;
+    int option = 0;
+    bool success = true;
+
+    while ((option = getopt(argc, argv, OPTION_STRING)) != -1)
+    {
+        switch (option)
+        {
+            case 'c':
+                config.capture_path = optarg;
+                break;
+            case 'n':
+                config.operations = strtoull(optarg, NULL, 10);
+                break;
+            case 'p':
+                config.packets = strtoull(optarg, NULL, 10);
+                break;
+            case 'k':
+                config.max_keys = strtoull(optarg, NULL, 10);
+                break;
+            case 'F':
+                config.flows = strtoull(optarg, NULL, 10);
+                break;
+            case 'z':
+                config.zipf_skew = strtod(optarg, NULL);
+                break;
+            case 's':
+                config.seed = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                print_usage(argv[0]);
+
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (config.operations == 0 || config.packets == 0 || config.flows == 0 ||
+        config.flows > UINT32_MAX)
+    {
+        print_usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    random_state = config.seed;
+
+    success = bench_hex_decode(&config) && success;
+    success = bench_frame_decode(&config) && success;
+
+    for (keys = MIN_KEYS; keys <= config.max_keys; keys *= KEYS_STEP)
+    {
+        success = bench_flow_index(keys, config.operations) && success;
+    }
+
+    success = bench_packet_counter(&config, false, false) && success;
+    success = bench_packet_counter(&config, true, false) && success;
+    success = bench_packet_counter(&config, false, true) && success;
+    success = bench_packet_counter(&config, true, true) && success;
+    success = bench_flow_table(&config, false) && success;
+    success = bench_flow_table(&config, true) && success;
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
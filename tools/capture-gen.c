@@ -0,0 +1,567 @@
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ethernet-frame.h"
+#include "ipv4-packet.h"
+#include "output-buffer.h"
+#include "pcap-file.h"
+
+#define OPTION_STRING "n:F:z:6:a:f:O:P:s:bo:"
+
+#define DEFAULT_PACKETS 1000ULL
+#define DEFAULT_FLOWS 100ULL
+#define DEFAULT_PAYLOAD_MIN 16
+#define DEFAULT_PAYLOAD_MAX 512
+#define DEFAULT_SEED 1ULL
+
+#define ETHERTYPE_ARP 0x0806
+#define ETHERNET_HEADER_LEN 14
+#define ETHERNET_MINIMUM_FRAME_LEN 60 /* without the frame check sequence */
+#define MAX_FRAME_LEN 1514
+#define IPV4_HEADER_LEN 20
+#define IPV4_MAX_OPTIONS_LEN 40
+#define IPV4_VERSION_IHL 0x45
+#define IPV4_DEFAULT_TTL 64
+#define IPV4_FLAG_MORE_FRAGMENTS 0x2000
+#define IPV4_FRAGMENT_UNIT 8
+#define IPV4_OPTION_NOP 0x01
+#define IPV4_OPTION_END 0x00
+#define IPV6_HEADER_LEN 40
+#define IPV6_VERSION 0x60
+#define IPV6_NEXT_HEADER_UDP 17
+#define IPV6_DEFAULT_HOP_LIMIT 64
+#define UDP_HEADER_LEN 8
+#define UDP_BASE_PORT 1024
+#define UDP_PORT_RANGE 60000
+#define ARP_LEN 28
+
+#define BYTES_PER_LINE 16
+#define LINE_ASCII_START 56 /* offset, hex bytes and two spaces come before the ASCII column */
+#define PRINTABLE_FIRST 0x20
+#define PRINTABLE_LAST 0x7e
+
+#define MICROSECONDS_PER_PACKET 10
+
+#define SPLITMIX_INCREMENT 0x9e3779b97f4a7c15ULL
+#define SPLITMIX_MULTIPLIER_1 0xbf58476d1ce4e5b9ULL
+#define SPLITMIX_MULTIPLIER_2 0x94d049bb133111ebULL
+#define MICROSECONDS_PER_SECOND 1000000ULL
+
+typedef struct generator_config
+{
+    uint64_t packets;
+    uint64_t flows;
+    double zipf_skew;      /* 0 draws flows uniformly */
+    double ipv6_rate;      /* share of IPv6 UDP packets */
+    double non_ip_rate;    /* share of ARP packets */
+    double fragment_rate;  /* share of IPv4 packets that are fragments */
+    double options_rate;   /* share of IPv4 packets with header options */
+    uint32_t payload_min;  /* UDP payload size range */
+    uint32_t payload_max;
+    uint64_t seed;
+    bool pcap;             /* write a pcap file instead of a Wireshark hex dump */
+    const char *output_path;
+} generator_config_t;
+
+static uint64_t random_state = DEFAULT_SEED;
+static char hex_table[UINT8_MAX + 1][2];
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-n packets] [-F flows] [-z skew] [-6 rate] [-a rate] [-f rate] [-O rate] "
+            "[-P min:max] [-s seed] [-b] [-o file]\n",
+            program);
+    fprintf(stderr, "  -n packets    packets to generate, default %llu\n", DEFAULT_PACKETS);
+    fprintf(stderr, "  -F flows      distinct source and destination pairs, default %llu\n",
+            DEFAULT_FLOWS);
+    fprintf(stderr, "  -z skew       Zipf skew of the flow popularity, 0 for uniform\n");
+    fprintf(stderr, "  -6 rate       share of IPv6 UDP packets (0 to 1)\n");
+    fprintf(stderr, "  -a rate       share of non IP (ARP) packets (0 to 1)\n");
+    fprintf(stderr, "  -f rate       share of IPv4 packets that are fragments (0 to 1)\n");
+    fprintf(stderr, "  -O rate       share of IPv4 packets with header options (0 to 1)\n");
+    fprintf(stderr, "  -P min:max    UDP payload size range, default %d:%d\n",
+            DEFAULT_PAYLOAD_MIN, DEFAULT_PAYLOAD_MAX);
+    fprintf(stderr, "  -s seed       random seed, equal seeds give equal captures\n");
+    fprintf(stderr, "  -b            write a pcap file instead of a Wireshark hex dump\n");
+    fprintf(stderr, "  -o file       output file, default stdout\n");
+}
+
+static uint64_t splitmix64(uint64_t value)
+{
+    value += SPLITMIX_INCREMENT;
+    value = (value ^ (value >> 30)) * SPLITMIX_MULTIPLIER_1;
+    value = (value ^ (value >> 27)) * SPLITMIX_MULTIPLIER_2;
+
+    return value ^ (value >> 31);
+}
+
+static uint64_t random_next(void)
+{
+    random_state = splitmix64(random_state);
+
+    return random_state;
+}
+
+static double random_unit(void)
+{
+    return (double)(random_next() >> 11) / (double)(1ULL << 53);
+}
+
+static uint32_t random_range(uint32_t min, uint32_t max)
+{
+    return min + (uint32_t)(random_next() % ((uint64_t)max - min + 1));
+}
+
+static bool parse_rate(const char *str, double *rate)
+{
+    char *endptr = NULL;
+
+    *rate = strtod(str, &endptr);
+
+    return endptr != str && *endptr == '\0' && *rate >= 0 && *rate <= 1;
+}
+
+/* Cumulative Zipf weights, flows are drawn by a binary search over a uniform variate */
+static double *generator_flow_cdf(uint64_t flows, double skew)
+{
+    double *cdf = NULL;
+    double total = 0;
+    uint64_t i = 0;
+
+    cdf = (double *)malloc(flows * sizeof(double));
+
+    if (cdf == NULL)
+    {
+        fprintf(stderr, "Unable to allocate memory for %" PRIu64 " flows.\n", flows);
+
+        return NULL;
+    }
+
+    for (i = 0; i < flows; i++)
+    {
+        total += 1.0 / pow((double)(i + 1), skew);
+        cdf[i] = total;
+    }
+
+    return cdf;
+}
+
+static uint64_t generator_next_flow(const double *cdf, uint64_t flows)
+{
+    double target = random_unit() * cdf[flows - 1];
+    uint64_t low = 0;
+    uint64_t high = flows - 1;
+    uint64_t middle = 0;
+
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+
+        if (cdf[middle] < target)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static uint16_t ipv4_checksum(const uint8_t *header, size_t length)
+{
+    uint32_t sum = 0;
+    size_t i = 0;
+
+    for (i = 0; i + 1 < length; i += 2)
+    {
+        sum += (uint32_t)(header[i] << 8 | header[i + 1]);
+    }
+
+    while (sum >> 16)
+    {
+        sum = (sum & UINT16_MAX) + (sum >> 16);
+    }
+
+    return (uint16_t)~sum;
+}
+
+static void put_u16(uint8_t *data, uint16_t value)
+{
+    value = htons(value);
+    memcpy(data, &value, sizeof(value));
+}
+
+static size_t build_ethernet(uint8_t *frame, uint64_t flow, uint16_t ethertype)
+{
+    uint64_t mac = splitmix64(flow);
+
+    memcpy(frame, &mac, MAC_LENGTH);
+    frame[0] &= 0xfe; /* unicast destination */
+    mac = splitmix64(mac);
+    memcpy(frame + MAC_LENGTH, &mac, MAC_LENGTH);
+    frame[MAC_LENGTH] &= 0xfe;
+    put_u16(frame + 2 * MAC_LENGTH, ethertype);
+
+    return ETHERNET_HEADER_LEN;
+}
+
+static size_t build_udp(uint8_t *data, uint64_t flow, uint32_t payload_len)
+{
+    uint64_t ports = splitmix64(flow ^ SPLITMIX_INCREMENT);
+    uint32_t i = 0;
+
+    put_u16(data, (uint16_t)(UDP_BASE_PORT + ports % UDP_PORT_RANGE));
+    put_u16(data + 2, (uint16_t)(UDP_BASE_PORT + (ports >> 32) % UDP_PORT_RANGE));
+    put_u16(data + 4, (uint16_t)(UDP_HEADER_LEN + payload_len));
+    put_u16(data + 6, 0); /* checksum is optional over IPv4 */
+
+    for (i = 0; i < payload_len; i++)
+    {
+        data[UDP_HEADER_LEN + i] = (uint8_t)(random_next() & UINT8_MAX);
+    }
+
+    return UDP_HEADER_LEN + payload_len;
+}
+
+static size_t build_ipv4(uint8_t *frame, const generator_config_t *config, uint64_t flow,
+                         uint32_t payload_len)
+{
+    uint8_t *header = frame + ETHERNET_HEADER_LEN;
+    uint64_t addresses = splitmix64(flow);
+    size_t options_len = 0;
+    size_t data_len = 0;
+    uint16_t fragment = 0;
+    uint32_t i = 0;
+
+    build_ethernet(frame, flow, ETHERTYPE_IPV4);
+
+    if (random_unit() < config->options_rate)
+    {
+        options_len = random_range(1, IPV4_MAX_OPTIONS_LEN / 4) * 4;
+
+        for (i = 0; i + 1 < options_len; i++)
+        {
+            header[IPV4_HEADER_LEN + i] = IPV4_OPTION_NOP;
+        }
+
+        header[IPV4_HEADER_LEN + options_len - 1] = IPV4_OPTION_END;
+    }
+
+    if (random_unit() < config->fragment_rate)
+    {
+        /* Either the first fragment with the UDP header, or a later one with payload only */
+        fragment = (random_next() & 1) ? IPV4_FLAG_MORE_FRAGMENTS
+                                       : (uint16_t)random_range(1, UINT8_MAX);
+    }
+
+    if (fragment == 0 || fragment == IPV4_FLAG_MORE_FRAGMENTS)
+    {
+        data_len = build_udp(header + IPV4_HEADER_LEN + options_len, flow, payload_len);
+    }
+    else
+    {
+        data_len = payload_len / IPV4_FRAGMENT_UNIT * IPV4_FRAGMENT_UNIT + IPV4_FRAGMENT_UNIT;
+
+        for (i = 0; i < data_len; i++)
+        {
+            header[IPV4_HEADER_LEN + options_len + i] = (uint8_t)(random_next() & UINT8_MAX);
+        }
+    }
+
+    header[0] = (uint8_t)(IPV4_VERSION_IHL + options_len / 4);
+    header[1] = 0;
+    put_u16(header + 2, (uint16_t)(IPV4_HEADER_LEN + options_len + data_len));
+    put_u16(header + 4, (uint16_t)(random_next() & UINT16_MAX));
+    put_u16(header + 6, fragment);
+    header[8] = IPV4_DEFAULT_TTL;
+    header[9] = IPV4_PROTOCOL_UDP;
+    put_u16(header + 10, 0);
+    memcpy(header + 12, &addresses, 2 * IP_ADDRESS_LENGTH);
+    put_u16(header + 10, ipv4_checksum(header, IPV4_HEADER_LEN + options_len));
+
+    return ETHERNET_HEADER_LEN + IPV4_HEADER_LEN + options_len + data_len;
+}
+
+static size_t build_ipv6(uint8_t *frame, uint64_t flow, uint32_t payload_len)
+{
+    uint8_t *header = frame + ETHERNET_HEADER_LEN;
+    uint64_t address = 0;
+    size_t data_len = 0;
+    uint32_t i = 0;
+
+    build_ethernet(frame, flow, ETHERTYPE_IPV6);
+    data_len = build_udp(header + IPV6_HEADER_LEN, flow, payload_len);
+
+    memset(header, 0, IPV6_HEADER_LEN);
+    header[0] = IPV6_VERSION;
+    put_u16(header + 4, (uint16_t)data_len);
+    header[6] = IPV6_NEXT_HEADER_UDP;
+    header[7] = IPV6_DEFAULT_HOP_LIMIT;
+
+    for (i = 0; i < 4; i++)
+    {
+        address = splitmix64(flow + i);
+        memcpy(header + 8 + i * sizeof(uint64_t), &address, sizeof(uint64_t));
+    }
+
+    return ETHERNET_HEADER_LEN + IPV6_HEADER_LEN + data_len;
+}
+
+static size_t build_arp(uint8_t *frame, uint64_t flow)
+{
+    uint8_t *arp = frame + ETHERNET_HEADER_LEN;
+    uint32_t i = 0;
+
+    build_ethernet(frame, flow, ETHERTYPE_ARP);
+
+    for (i = 0; i < ARP_LEN; i++)
+    {
+        arp[i] = (uint8_t)(random_next() & UINT8_MAX);
+    }
+
+    return ETHERNET_HEADER_LEN + ARP_LEN;
+}
+
+/* Writes one packet in the layout of a Wireshark "Copy as Hex Dump", read by wireshark_file_t */
+static bool write_hex_dump(output_buffer_t *out, const uint8_t *frame, size_t length)
+{
+    char line[LINE_ASCII_START + BYTES_PER_LINE + 1];
+    size_t offset = 0;
+    size_t i = 0;
+    size_t line_len = 0;
+    bool success = true;
+
+    for (offset = 0; offset < length && success; offset += BYTES_PER_LINE)
+    {
+        memset(line, ' ', LINE_ASCII_START);
+        snprintf(line, sizeof(line), "%04zx", offset);
+        line[4] = ' ';
+        line_len = LINE_ASCII_START;
+
+        for (i = 0; i < BYTES_PER_LINE && offset + i < length; i++)
+        {
+            memcpy(line + 6 + i * 3, hex_table[frame[offset + i]], 2);
+            line[line_len++] = (frame[offset + i] >= PRINTABLE_FIRST &&
+                                frame[offset + i] <= PRINTABLE_LAST)
+                                   ? (char)frame[offset + i]
+                                   : '.';
+        }
+
+        line[line_len++] = '\n';
+        success = output_buffer_write(out, line, line_len);
+    }
+
+    return success;
+}
+
+static bool write_pcap_record(output_buffer_t *out, const uint8_t *frame, size_t length,
+                              uint64_t index)
+{
+    pcap_record_header_t record;
+    uint64_t timestamp = index * MICROSECONDS_PER_PACKET;
+
+    record.ts_sec = (uint32_t)(timestamp / MICROSECONDS_PER_SECOND);
+    record.ts_usec = (uint32_t)(timestamp % MICROSECONDS_PER_SECOND);
+    record.incl_len = (uint32_t)length;
+    record.orig_len = (uint32_t)length;
+
+    return output_buffer_write(out, (const char *)&record, sizeof(record)) &&
+           output_buffer_write(out, (const char *)frame, length);
+}
+
+static bool generate(const generator_config_t *config, output_buffer_t *out)
+{
+    uint8_t frame[MAX_FRAME_LEN + IPV4_MAX_OPTIONS_LEN + IPV4_FRAGMENT_UNIT] = {0};
+    pcap_file_header_t pcap_header = {PCAP_MAGIC, PCAP_VERSION_MAJOR, PCAP_VERSION_MINOR, 0, 0,
+                                      MAX_FRAME_LEN, PCAP_LINKTYPE_ETHERNET};
+    double *cdf = NULL;
+    double kind = 0;
+    uint64_t flow = 0;
+    uint64_t i = 0;
+    uint32_t payload_len = 0;
+    size_t length = 0;
+    bool success = true;
+
+    cdf = generator_flow_cdf(config->flows, config->zipf_skew);
+
+    if (cdf == NULL)
+    {
+        return false;
+    }
+
+    if (config->pcap)
+    {
+        success = output_buffer_write(out, (const char *)&pcap_header, sizeof(pcap_header));
+    }
+
+    for (i = 0; i < config->packets && success; i++)
+    {
+        flow = generator_next_flow(cdf, config->flows);
+        payload_len = random_range(config->payload_min, config->payload_max);
+        kind = random_unit();
+
+        if (kind < config->non_ip_rate)
+        {
+            length = build_arp(frame, flow);
+        }
+        else if (kind < config->non_ip_rate + config->ipv6_rate)
+        {
+            length = build_ipv6(frame, flow, payload_len);
+        }
+        else
+        {
+            length = build_ipv4(frame, config, flow, payload_len);
+        }
+
+        if (length < ETHERNET_MINIMUM_FRAME_LEN)
+        {
+            memset(frame + length, 0, ETHERNET_MINIMUM_FRAME_LEN - length);
+            length = ETHERNET_MINIMUM_FRAME_LEN;
+        }
+
+        if (config->pcap)
+        {
+            success = write_pcap_record(out, frame, length, i);
+        }
+        else
+        {
+            success = (i == 0 || output_buffer_putc(out, '\n')) &&
+                      write_hex_dump(out, frame, length);
+        }
+    }
+
+    free(cdf);
+
+    return success;
+}
+
+int main(int argc, char *argv[])
+{
+    generator_config_t config = {
+        .packets = DEFAULT_PACKETS,
+        .flows = DEFAULT_FLOWS,
+        .payload_min = DEFAULT_PAYLOAD_MIN,
+        .payload_max = DEFAULT_PAYLOAD_MAX,
+        .seed = DEFAULT_SEED,
+    };
+    FILE *file = stdout;
+    output_buffer_t *out = NULL;
+    unsigned payload_min = 0;
+    unsigned payload_max = 0;
+    uint32_t i = 0;
+    int option = 0;
+    bool valid = true;
+    bool success = false;
+
+    while ((option = getopt(argc, argv, OPTION_STRING)) != -1 && valid)
+    {
+        switch (option)
+        {
+            case 'n':
+                config.packets = strtoull(optarg, NULL, 10);
+                break;
+            case 'F':
+                config.flows = strtoull(optarg, NULL, 10);
+                valid = config.flows != 0;
+                break;
+            case 'z':
+                config.zipf_skew = strtod(optarg, NULL);
+                valid = config.zipf_skew >= 0;
+                break;
+            case '6':
+                valid = parse_rate(optarg, &config.ipv6_rate);
+                break;
+            case 'a':
+                valid = parse_rate(optarg, &config.non_ip_rate);
+                break;
+            case 'f':
+                valid = parse_rate(optarg, &config.fragment_rate);
+                break;
+            case 'O':
+                valid = parse_rate(optarg, &config.options_rate);
+                break;
+            case 'P':
+                valid = sscanf(optarg, "%u:%u", &payload_min, &payload_max) == 2 &&
+                        payload_min <= payload_max;
+                config.payload_min = payload_min;
+                config.payload_max = payload_max;
+                break;
+            case 's':
+                config.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'b':
+                config.pcap = true;
+                break;
+            case 'o':
+                config.output_path = optarg;
+                break;
+            default:
+                valid = false;
+                break;
+        }
+    }
+
+    /* Headers, options and a rounded up fragment must still fit in one Ethernet frame */
+    if (!valid || optind != argc || config.ipv6_rate + config.non_ip_rate > 1 ||
+        config.payload_max > MAX_FRAME_LEN - ETHERNET_HEADER_LEN - IPV6_HEADER_LEN -
+                                 IPV4_MAX_OPTIONS_LEN - UDP_HEADER_LEN)
+    {
+        print_usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i <= UINT8_MAX; i++)
+    {
+        hex_table[i][0] = "0123456789abcdef"[i >> 4];
+        hex_table[i][1] = "0123456789abcdef"[i & 0xf];
+    }
+
+    random_state = config.seed;
+
+    if (config.output_path != NULL)
+    {
+        file = fopen(config.output_path, config.pcap ? "wb" : "w");
+
+        if (file == NULL)
+        {
+            fprintf(stderr, "Error opening file for writing: %s\n", config.output_path);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    out = output_buffer_create(file, OUTPUT_BUFFER_DEFAULT_SIZE);
+
+    if (out != NULL)
+    {
+        success = generate(&config, out);
+        success = output_buffer_flush(out) && success;
+        output_buffer_free(&out);
+    }
+
+    if (file != stdout)
+    {
+        success = (fclose(file) == 0) && success;
+    }
+    else
+    {
+        success = (fflush(file) == 0) && success;
+    }
+
+    if (!success)
+    {
+        fprintf(stderr, "Failed to write capture.\n");
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,88 @@
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "counter-snapshot.h"
+
+#define OPTION_STRING "o:p:"
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s -o <output> <snapshot>...\n", program);
+    fprintf(stderr, "       %s -p <snapshot>\n", program);
+    fprintf(stderr, "  -o output     merge snapshots into output, summing counts of equal flows\n");
+    fprintf(stderr, "  -p snapshot   print the flows of a snapshot as text\n");
+}
+
+static bool print_snapshot(const char *file_path)
+{
+    counter_snapshot_t *snapshot = NULL;
+    ip_addr_t src;
+    ip_addr_t dest;
+    uint64_t count = 0;
+    bool success = false;
+
+    snapshot = counter_snapshot_open(file_path);
+
+    if (snapshot == NULL)
+    {
+        return false;
+    }
+
+    while (counter_snapshot_next(snapshot, &src, &dest, &count))
+    {
+        printf("%u.%u.%u.%u %u.%u.%u.%u %" PRIu64 "\n", src.byte[0], src.byte[1], src.byte[2],
+               src.byte[3], dest.byte[0], dest.byte[1], dest.byte[2], dest.byte[3], count);
+    }
+
+    printf("%" PRIu64 " flows, %" PRIu64 " packets\n", snapshot->flow_count,
+           snapshot->packet_count);
+    success = snapshot->flows_read == snapshot->flow_count;
+    counter_snapshot_close(&snapshot);
+
+    return success;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output_path = NULL;
+    const char *print_path = NULL;
+    int option = 0;
+
+    while ((option = getopt(argc, argv, OPTION_STRING)) != -1)
+    {
+        switch (option)
+        {
+            case 'o':
+                output_path = optarg;
+                break;
+            case 'p':
+                print_path = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (print_path != NULL && output_path == NULL && optind == argc)
+    {
+        return print_snapshot(print_path) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (output_path == NULL || print_path != NULL || optind == argc)
+    {
+        print_usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    if (!counter_snapshot_merge((const char *const *)&argv[optind], argc - optind, output_path))
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}